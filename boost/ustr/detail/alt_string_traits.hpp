@@ -15,6 +15,7 @@
 #include <iterator>
 #include <boost/ustr/detail/util.hpp>
 #include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/type_traits.hpp>
@@ -129,6 +130,13 @@ class alt_string_traits {
         static void reset(const_strptr_type& str, raw_strptr_type new_str) {
             const_cast<string_type&>(str).assign(new_str);
         }
+
+        /*
+         * Strings held by value have no shared buffer to keep metadata in.
+         */
+        static util::buffer_metadata* metadata(const const_strptr_type& str) {
+            return 0;
+        }
     };
 
     struct mutable_strptr {
@@ -144,10 +152,41 @@ class alt_string_traits {
             str.push_back(codeunit);
         }
 
+        template <typename CodeunitIterator>
+        static void append(mutable_strptr_type& str, CodeunitIterator begin, CodeunitIterator end) {
+            str.insert(str.end(), begin, end);
+        }
+
         static void check_and_initialize(mutable_strptr_type& str) {
 
         }
 
+        static void reserve_space(mutable_strptr_type& str, size_t length) {
+            util::reserve_codeunits(str, length);
+        }
+
+        static size_t size(const mutable_strptr_type& str) {
+            return str.size();
+        }
+
+        static codeunit_iterator_type codeunit_begin(const mutable_strptr_type& str) {
+            return str.begin();
+        }
+
+        static codeunit_iterator_type codeunit_end(const mutable_strptr_type& str) {
+            return str.end();
+        }
+
+        static codeunit_type* append_space(mutable_strptr_type& str, size_t length) {
+            size_t size = str.size();
+            str.resize(size + length);
+            return &str[0] + size;
+        }
+
+        static void shrink_space(mutable_strptr_type& str, size_t length) {
+            str.resize(str.size() - length);
+        }
+
         static codeunit_output_iterator_type output_iterator(mutable_strptr_type& str) {
             return std::back_inserter(str);
         } 
@@ -0,0 +1,337 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <new>
+#include <string>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
+#include <boost/ustr/detail/monotonic_arena.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Creates a string holding the code units from begin to end, allocated
+ * along with its code units from the arena current on this thread.
+ */
+template <typename StringT, typename Iterator>
+StringT* new_arena_string(Iterator begin, Iterator end) {
+    typedef typename StringT::allocator_type                allocator_type;
+    typedef typename allocator_type::template
+        rebind<StringT>::other                              string_allocator_type;
+
+    allocator_type allocator;
+    string_allocator_type string_allocator(allocator);
+    StringT* str = string_allocator.allocate(1);
+
+    try {
+        return new (str) StringT(begin, end, allocator);
+    } catch(...) {
+        string_allocator.deallocate(str, 1);
+        throw;
+    }
+}
+
+/*
+ * Destroys a string created by new_arena_string(), giving its memory back
+ * to the heap if that is where it came from.
+ */
+template <typename StringT>
+void delete_arena_string(const StringT* str) {
+    typedef typename StringT::allocator_type::template
+        rebind<StringT>::other                              string_allocator_type;
+
+    string_allocator_type string_allocator(str->get_allocator());
+    str->~StringT();
+    string_allocator.deallocate(const_cast<StringT*>(str), 1);
+}
+
+/*
+ * Deleter of the shared buffers created by arena_string_traits, keeping
+ * the buffer metadata in the control block like util::metadata_deleter.
+ */
+template <typename StringT>
+class arena_metadata_deleter {
+  public:
+    void operator()(const StringT* str) const {
+        delete_arena_string(str);
+    }
+
+    buffer_metadata metadata;
+};
+
+/*
+ * Sole owner of a string created by new_arena_string(), as a unique_ptr.
+ */
+template <typename StringT>
+class arena_string_ptr {
+  public:
+    arena_string_ptr() :
+        _str(0)
+    { }
+
+    explicit arena_string_ptr(StringT* str) :
+        _str(str)
+    { }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    arena_string_ptr(arena_string_ptr&& other) :
+        _str(other.release())
+    { }
+#endif
+
+    ~arena_string_ptr() {
+        reset();
+    }
+
+    StringT* get() const {
+        return _str;
+    }
+
+    StringT& operator *() const {
+        return *_str;
+    }
+
+    StringT* operator ->() const {
+        return _str;
+    }
+
+    StringT* release() {
+        StringT* str = _str;
+        _str = 0;
+        return str;
+    }
+
+    void reset(StringT* str = 0) {
+        if(_str) {
+            delete_arena_string(_str);
+        }
+        _str = str;
+    }
+
+  private:
+    arena_string_ptr(const arena_string_ptr&);
+    arena_string_ptr& operator =(const arena_string_ptr&);
+
+    StringT* _str;
+};
+
+} // namespace util
+
+/*
+ * String traits allocating strings, their code units, the control blocks
+ * of their shared pointers and the buffers of builders from the
+ * util::monotonic_arena made current on the thread by a
+ * util::monotonic_arena::scope, or from the heap outside of any scope.
+ * Strings created in a scope all go away at once when the arena is reset,
+ * and must not be used anymore afterwards; copies of them made outside of
+ * the scope live on the heap.
+ *
+ *   typedef unicode_string_adapter<
+ *       arena_string_traits<char>::string_type,
+ *       arena_string_traits<char> >         arena_u8_string;
+ *
+ *   util::monotonic_arena arena;
+ *   {
+ *       util::monotonic_arena::scope scope(arena);
+ *       // build and use arena_u8_string objects
+ *   }
+ *   arena.reset();
+ */
+template <typename CharT>
+class arena_string_traits {
+  public:
+    typedef arena_string_traits<CharT>              this_traits;
+    typedef std::basic_string<CharT,
+        std::char_traits<CharT>,
+        util::arena_allocator<CharT> >              string_type;
+
+    typedef CharT                                   codeunit_type;
+
+    static const size_t codeunit_size = sizeof(codeunit_type);
+
+    typedef string_type*                            raw_strptr_type;
+    typedef const string_type*                      const_raw_strptr_type;
+
+#ifdef BOOST_USTR_CPP0X
+    typedef std::shared_ptr<const string_type>      const_strptr_type;
+#else
+    typedef boost::shared_ptr<const string_type>    const_strptr_type;
+#endif
+    typedef util::arena_string_ptr<string_type>     mutable_strptr_type;
+
+    typedef const codeunit_type*                    codeunit_iterator_type;
+    typedef
+        std::back_insert_iterator<string_type>      codeunit_output_iterator_type;
+
+    typedef typename util::get_raw_char_type<
+        codeunit_type>::type                        raw_char_type;
+    typedef std::basic_string<raw_char_type>        raw_string_type;
+
+    static raw_strptr_type new_string(const string_type& str) {
+        return util::new_arena_string<string_type>(str.begin(), str.end());
+    }
+
+    static raw_strptr_type new_string() {
+        const codeunit_type* empty = 0;
+        return util::new_arena_string<string_type>(empty, empty);
+    }
+
+    static raw_strptr_type clone_string(raw_strptr_type str) {
+        return str ? new_string(*str) : new_string();
+    }
+
+    struct string {
+      public:
+        static bool equals(const string_type& str1, const string_type& str2) {
+            return str1.size() == str2.size() &&
+                std::equal(str1.begin(), str1.end(), str2.begin());
+        }
+
+        template <typename Iterator>
+        static string_type from_iter(Iterator begin, Iterator end) {
+            return string_type(begin, end);
+        }
+    };
+
+    struct raw_strptr {
+      public:
+        static bool equals(raw_strptr_type str1, raw_strptr_type str2) {
+            if(str1 && str2) {
+                return string::equals(*str1, *str2);
+            }
+            return (str1 ? str1->size() : 0) == (str2 ? str2->size() : 0);
+        }
+
+        static bool equals(raw_strptr_type str1, const string_type& str2) {
+            return str1 ? string::equals(*str1, str2) : str2.empty();
+        }
+
+        static void delete_string(raw_strptr_type str) {
+            if(str) {
+                util::delete_arena_string(str);
+            }
+        }
+    };
+
+    struct const_strptr {
+      private:
+        typedef util::arena_metadata_deleter<string_type>   deleter_type;
+
+      public:
+        static const_raw_strptr_type get(const const_strptr_type& str) {
+            return str.get();
+        }
+
+        static codeunit_iterator_type
+        codeunit_begin(const const_strptr_type& str) {
+            return str ? str->data() : 0;
+        }
+
+        static codeunit_iterator_type
+        codeunit_end(const const_strptr_type& str) {
+            return str ? str->data() + str->size() : 0;
+        }
+
+        static bool equals(const const_strptr_type& str1, const const_strptr_type& str2) {
+            return raw_strptr::equals(
+                const_cast<raw_strptr_type>(str1.get()),
+                const_cast<raw_strptr_type>(str2.get()));
+        }
+
+        /*
+         * The control block is allocated from the same arena as new_str.
+         */
+        static void reset(const_strptr_type& str, raw_strptr_type new_str) {
+            str.reset(new_str, deleter_type(), new_str->get_allocator());
+        }
+
+        static util::buffer_metadata* metadata(const const_strptr_type& str) {
+#ifdef BOOST_USTR_CPP0X
+            deleter_type* deleter = std::get_deleter<deleter_type>(str);
+#else
+            deleter_type* deleter = boost::get_deleter<deleter_type>(str);
+#endif
+            return deleter ? &deleter->metadata : 0;
+        }
+    };
+
+    struct mutable_strptr {
+        static raw_strptr_type release(mutable_strptr_type& str) {
+            return str.get() ? str.release() : new_string();
+        }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        static raw_strptr_type release(mutable_strptr_type&& str) {
+            return str.get() ? str.release() : new_string();
+        }
+#endif
+
+        static raw_strptr_type get(mutable_strptr_type& str) {
+            return str.get();
+        }
+
+        static void append(mutable_strptr_type& str, codeunit_type codeunit) {
+            check_and_initialize(str);
+            str->push_back(codeunit);
+        }
+
+        template <typename CodeunitIterator>
+        static void append(mutable_strptr_type& str, CodeunitIterator begin, CodeunitIterator end) {
+            check_and_initialize(str);
+            str->append(begin, end);
+        }
+
+        static void reserve_space(mutable_strptr_type& str, size_t length) {
+            check_and_initialize(str);
+            util::reserve_codeunits(*str, length);
+        }
+
+        static codeunit_type* append_space(mutable_strptr_type& str, size_t length) {
+            check_and_initialize(str);
+            size_t size = str->size();
+            str->resize(size + length);
+            return &(*str)[0] + size;
+        }
+
+        static void shrink_space(mutable_strptr_type& str, size_t length) {
+            str->resize(str->size() - length);
+        }
+
+        static codeunit_output_iterator_type output_iterator(mutable_strptr_type& str) {
+            check_and_initialize(str);
+            return std::back_inserter(*str);
+        }
+
+        static size_t size(const mutable_strptr_type& str) {
+            return str.get() ? str->size() : 0;
+        }
+
+        static codeunit_iterator_type codeunit_begin(const mutable_strptr_type& str) {
+            return str.get() ? str->data() : 0;
+        }
+
+        static codeunit_iterator_type codeunit_end(const mutable_strptr_type& str) {
+            return str.get() ? str->data() + str->size() : 0;
+        }
+
+        static void check_and_initialize(mutable_strptr_type& str) {
+            if(!str.get()) {
+                str.reset(new_string());
+            }
+        }
+    };
+};
+
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,115 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * ASCII run detection over contiguous code units.
+ *
+ * In UTF-8, UTF-16 and UTF-32 alike, a code unit below 0x80 is a complete
+ * code point with the same value. Text that is mostly ASCII can therefore be
+ * scanned a block at a time and only the remaining code units need decoding.
+ */
+
+template <typename CodeUnit>
+inline bool is_ascii_codeunit(const CodeUnit& codeunit) {
+    // negative values of signed char wrap around to large code points
+    return static_cast<codepoint_type>(codeunit) < 0x80;
+}
+
+template <size_t CodeunitSize>
+class unsigned_codeunit { };
+
+template <>
+class unsigned_codeunit<1> {
+  public:
+    typedef boost::uint8_t      type;
+    static const boost::uint64_t non_ascii_mask = 0x8080808080808080ull;
+};
+
+template <>
+class unsigned_codeunit<2> {
+  public:
+    typedef boost::uint16_t     type;
+    static const boost::uint64_t non_ascii_mask = 0xFF80FF80FF80FF80ull;
+};
+
+template <>
+class unsigned_codeunit<4> {
+  public:
+    typedef boost::uint32_t     type;
+    static const boost::uint64_t non_ascii_mask = 0xFFFFFF80FFFFFF80ull;
+};
+
+/*
+ * Returns the position of the first code unit that is not ASCII,
+ * or end if there is none.
+ */
+template <typename CodeUnit>
+inline const CodeUnit* find_non_ascii(const CodeUnit* begin, const CodeUnit* end) {
+    typedef unsigned_codeunit<sizeof(CodeUnit)>     unit;
+    typedef typename unit::type                     unit_type;
+
+    const unit_type* current = reinterpret_cast<const unit_type*>(begin);
+    const unit_type* last = reinterpret_cast<const unit_type*>(end);
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const ptrdiff_t block = 32 / sizeof(CodeUnit);
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(unit::non_ascii_mask));
+
+    while(last - current >= 2 * block) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + block));
+
+        if(!_mm256_testz_si256(_mm256_or_si256(first, second), mask)) {
+            break;
+        }
+        current += 2 * block;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const ptrdiff_t block = 16 / sizeof(CodeUnit);
+    const __m128i mask = _mm_set1_epi64x(static_cast<long long>(unit::non_ascii_mask));
+
+    while(last - current >= 2 * block) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + block));
+
+        if(!_mm_testz_si128(_mm_or_si128(first, second), mask)) {
+            break;
+        }
+        current += 2 * block;
+    }
+#endif
+
+    const ptrdiff_t word_length = sizeof(boost::uint64_t) / sizeof(CodeUnit);
+    while(last - current >= word_length) {
+        boost::uint64_t word;
+        std::memcpy(&word, current, sizeof(word));
+
+        if(word & unit::non_ascii_mask) {
+            break;
+        }
+        current += word_length;
+    }
+
+    while(current != last && *current < 0x80) {
+        ++current;
+    }
+
+    return reinterpret_cast<const CodeUnit*>(current);
+}
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
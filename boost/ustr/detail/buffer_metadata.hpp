@@ -0,0 +1,159 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/codepoint_index.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Facts about the code units of an immutable shared buffer, computed once
+ * and shared by every adapter referring to the buffer.
+ *
+ * The code point length is usually recorded while the buffer is being
+ * constructed, but a buffer shared before it was validated has it recorded
+ * by whichever adapter validates it first. The hash is likewise computed
+ * lazily by whichever adapter asks first, as is whether the code units are
+ * in the shortest form. All of them may be written concurrently, so they are
+ * kept atomically; racing writers all store the same value.
+ *
+ * The code point index is also built lazily, on first random access, and
+ * published atomically. It is owned by the metadata object holding it and
+ * is not copied along with the other facts, as copies are only made while
+ * the shared pointer is being set up, long before any random access.
+ */
+class buffer_metadata {
+  public:
+    buffer_metadata() :
+        _codepoint_length(unknown_length), _hash(unknown_hash),
+        _shortest_form(unknown_form), _index(0)
+    { }
+
+    buffer_metadata(const buffer_metadata& other) :
+        _codepoint_length(other._codepoint_length.load(boost::memory_order_relaxed)),
+        _hash(other._hash.load(boost::memory_order_relaxed)),
+        _shortest_form(other._shortest_form.load(boost::memory_order_relaxed)),
+        _index(0)
+    { }
+
+    ~buffer_metadata() {
+        delete _index.load(boost::memory_order_acquire);
+    }
+
+    buffer_metadata& operator =(const buffer_metadata& other) {
+        _codepoint_length.store(other._codepoint_length.load(boost::memory_order_relaxed),
+            boost::memory_order_relaxed);
+        _hash.store(other._hash.load(boost::memory_order_relaxed),
+            boost::memory_order_relaxed);
+        _shortest_form.store(other._shortest_form.load(boost::memory_order_relaxed),
+            boost::memory_order_relaxed);
+        return *this;
+    }
+
+    /*
+     * The code point length is only known for buffers that
+     * have been validated as well formed.
+     */
+    bool has_codepoint_length() const {
+        return _codepoint_length.load(boost::memory_order_relaxed) != unknown_length;
+    }
+
+    size_t codepoint_length() const {
+        return _codepoint_length.load(boost::memory_order_relaxed);
+    }
+
+    void set_codepoint_length(size_t length) {
+        _codepoint_length.store(length, boost::memory_order_relaxed);
+    }
+
+    /*
+     * Hash values are never zero, see util::codepoint_hasher.
+     */
+    bool has_hash() const {
+        return _hash.load(boost::memory_order_relaxed) != unknown_hash;
+    }
+
+    size_t hash() const {
+        return _hash.load(boost::memory_order_relaxed);
+    }
+
+    void set_hash(size_t hash) {
+        _hash.store(hash, boost::memory_order_relaxed);
+    }
+
+    /*
+     * Whether the code units spell every code point in as few code units
+     * as it takes, see utf_encoding_traits::shortest_form().
+     */
+    bool has_shortest_form() const {
+        return _shortest_form.load(boost::memory_order_relaxed) != unknown_form;
+    }
+
+    bool shortest_form() const {
+        return _shortest_form.load(boost::memory_order_relaxed) == shortest;
+    }
+
+    void set_shortest_form(bool is_shortest) {
+        _shortest_form.store(is_shortest ? shortest : longer, boost::memory_order_relaxed);
+    }
+
+    /*
+     * The code point index of the buffer, or NULL if none has been built.
+     */
+    const codepoint_index* index() const {
+        return _index.load(boost::memory_order_acquire);
+    }
+
+    /*
+     * Publishes index unless another one was published first, in which case
+     * index is deleted. Either way the published index is returned.
+     */
+    const codepoint_index* set_index(const codepoint_index* index) {
+        const codepoint_index* expected = 0;
+
+        if(_index.compare_exchange_strong(expected, index, boost::memory_order_acq_rel)) {
+            return index;
+        }
+
+        delete index;
+        return expected;
+    }
+
+  private:
+    static const size_t unknown_length = static_cast<size_t>(-1);
+    static const size_t unknown_hash = 0;
+
+    enum form { unknown_form, shortest, longer };
+
+    boost::atomic<size_t> _codepoint_length;
+    boost::atomic<size_t> _hash;
+    boost::atomic<int> _shortest_form;
+    boost::atomic<const codepoint_index*> _index;
+};
+
+/*
+ * Deleter of the shared buffers created by string_traits. Keeping the
+ * metadata in the deleter places it in the control block of the shared
+ * pointer, which is allocated anyway, so it costs neither an allocation
+ * nor any memory in the adapters sharing the buffer.
+ */
+template <typename StringT>
+class metadata_deleter {
+  public:
+    void operator()(const StringT* str) const {
+        delete str;
+    }
+
+    buffer_metadata metadata;
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,92 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <boost/ustr/detail/incl.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Sparse map from code point positions to code unit offsets in a buffer,
+ * recording the offset of every interval-th code point. Any code point is
+ * then at most interval - 1 code points away from a recorded one, which
+ * turns random access over variable width encodings into a table lookup
+ * and a short walk.
+ */
+class codepoint_index {
+  public:
+    static const size_t interval = 128;
+
+    /*
+     * Indexes the code unit range in the encoding of EncodingTraits. The
+     * offsets are only cheap to use for random access code unit iterators.
+     */
+    template <typename EncodingTraits, typename CodeunitIterator>
+    static codepoint_index* build(CodeunitIterator begin, CodeunitIterator end) {
+        codepoint_index* index = new codepoint_index();
+        index->_offsets.reserve(std::distance(begin, end) / interval + 1);
+
+        CodeunitIterator current = begin;
+        size_t length = 0;
+
+        // the first code point, or the end of an empty buffer
+        index->_offsets.push_back(0);
+
+        while(current != end) {
+            EncodingTraits::encoder::decode(current, end, typename EncodingTraits::policy());
+
+            if(++length % interval == 0 && current != end) {
+                index->_offsets.push_back(std::distance(begin, current));
+            }
+        }
+
+        index->_length = length;
+        return index;
+    }
+
+    /*
+     * Number of code points in the indexed buffer.
+     */
+    size_t length() const {
+        return _length;
+    }
+
+    /*
+     * Offset of the closest recorded code point at or before the code
+     * point at position, which is position rounded down to the interval.
+     */
+    size_t offset_before(size_t position) const {
+        return _offsets[position / interval];
+    }
+
+    /*
+     * Position of the last recorded code point starting at or before
+     * the code unit offset.
+     */
+    size_t position_before(size_t offset) const {
+        std::vector<size_t>::const_iterator block =
+            std::upper_bound(_offsets.begin(), _offsets.end(), offset);
+
+        return (block - _offsets.begin() - 1) * interval;
+    }
+
+  private:
+    codepoint_index() :
+        _length(0)
+    { }
+
+    std::vector<size_t> _offsets;
+    size_t _length;
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
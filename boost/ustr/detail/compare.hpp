@@ -0,0 +1,419 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/ascii.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
+#include <boost/ustr/detail/encoding_traits.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Maps the code units of an encoder to keys that order the same way as the
+ * code points they encode, so that strings of that encoder can be ordered
+ * by their first differing code unit without decoding.
+ *
+ * UTF-8 and UTF-32 code units already do. UTF-16 surrogates encode code
+ * points above U+FFFF but are themselves below U+E000, so they are moved
+ * above the code units from U+E000 to U+FFFF.
+ */
+template <typename Encoder>
+class codeunit_order {
+  public:
+    static const bool available = false;
+};
+
+template <>
+class codeunit_order<utf8_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename CodeUnit>
+    static boost::uint32_t key(const CodeUnit& codeunit) {
+        return static_cast<boost::uint8_t>(codeunit);
+    }
+};
+
+template <>
+class codeunit_order<utf16_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename CodeUnit>
+    static boost::uint32_t key(const CodeUnit& codeunit) {
+        boost::uint32_t value = static_cast<boost::uint16_t>(codeunit);
+
+        if(value >= 0xD800) {
+            return (value >= 0xE000) ? value - 0x800 : value + 0x2000;
+        }
+        return value;
+    }
+};
+
+template <>
+class codeunit_order<utf32_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename CodeUnit>
+    static boost::uint32_t key(const CodeUnit& codeunit) {
+        return static_cast<boost::uint32_t>(codeunit);
+    }
+};
+
+/*
+ * Code point comparison of two code unit ranges in the encodings of
+ * LeftTraits and RightTraits, both being utf_encoding_traits.
+ *
+ * The strategy is chosen at compile time:
+ *
+ *  - ranges of the same encoder and code unit size whose policies replace
+ *    malformed code units, and hence are well formed, are equal exactly
+ *    when their code units are, which is a memcmp for contiguous ranges,
+ *    provided both are in the shortest form; the UTF-8 decoder accepts
+ *    overlong forms, which spell the same code points differently,
+ *  - contiguous ranges of ASCII compatible encodings compare ASCII runs
+ *    code unit by code unit and decode the remaining code points,
+ *  - everything else is decoded side by side.
+ *
+ * Either way the ranges are walked in a single pass, so strings of different
+ * lengths are told apart without counting their code points first.
+ *
+ * compare() orders the ranges by code point the same way, except that code
+ * units are only compared directly for encoders with a codeunit_order, which
+ * for contiguous UTF-8 in the shortest form is a memcmp. It returns a negative value, zero or a
+ * positive value as the left range is less than, equal to or greater than
+ * the right range.
+ */
+template <typename LeftTraits, typename RightTraits>
+class codepoint_compare {
+  public:
+    typedef typename
+        LeftTraits::codeunit_iterator_type              left_iterator_type;
+    typedef typename
+        RightTraits::codeunit_iterator_type             right_iterator_type;
+    typedef typename LeftTraits::codeunit_type          left_codeunit_type;
+    typedef typename RightTraits::codeunit_type         right_codeunit_type;
+
+    typedef typename LeftTraits::encoder                left_encoder;
+    typedef typename RightTraits::encoder               right_encoder;
+
+    static bool equals(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end)
+    {
+        return equals(left_begin, left_end, right_begin, right_end,
+            LeftTraits::shortest_form(left_begin, left_end) &&
+            RightTraits::shortest_form(right_begin, right_end));
+    }
+
+    /*
+     * Equality of ranges already known to be both in the shortest form or
+     * not, see utf_encoding_traits::shortest_form().
+     */
+    static bool equals(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            bool shortest_form)
+    {
+        if(same_encoding && !shortest_form) {
+            return equals(left_begin, left_end, right_begin, right_end, decode_strategy());
+        }
+
+        return equals(left_begin, left_end, right_begin, right_end, strategy());
+    }
+
+    static int compare(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end)
+    {
+        return compare(left_begin, left_end, right_begin, right_end,
+            LeftTraits::shortest_form(left_begin, left_end) &&
+            RightTraits::shortest_form(right_begin, right_end));
+    }
+
+    static int compare(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            bool shortest_form)
+    {
+        if(same_encoding && !shortest_form) {
+            return compare(left_begin, left_end, right_begin, right_end, decode_strategy());
+        }
+
+        return compare(left_begin, left_end, right_begin, right_end, order_strategy());
+    }
+
+  private:
+    class compare_codeunits { };
+    class compare_ascii_runs { };
+    class decode_codepoints { };
+
+    static const bool same_encoding =
+        boost::is_same<left_encoder, right_encoder>::value &&
+        sizeof(left_codeunit_type) == sizeof(right_codeunit_type) &&
+        LeftTraits::replace_malformed && RightTraits::replace_malformed;
+
+    static const bool ascii_runs =
+        LeftTraits::has_kernel::value && RightTraits::has_kernel::value &&
+        encoder_kernel<left_encoder>::ascii_compatible &&
+        encoder_kernel<right_encoder>::ascii_compatible;
+
+    typedef typename boost::mpl::if_c<ascii_runs, compare_ascii_runs,
+        decode_codepoints>::type                        decode_strategy;
+
+    typedef typename boost::mpl::if_c<same_encoding, compare_codeunits,
+        decode_strategy>::type                          strategy;
+
+    typedef typename boost::mpl::if_c<
+        same_encoding && codeunit_order<left_encoder>::available, compare_codeunits,
+        decode_strategy>::type                          order_strategy;
+
+    static int compare_codepoints(codepoint_type left, codepoint_type right) {
+        return (left < right) ? -1 : (left != right);
+    }
+
+    static int compare_lengths(size_t left, size_t right) {
+        return (left < right) ? -1 : (left != right);
+    }
+
+    static bool equals(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            compare_codeunits)
+    {
+        return equal_codeunits(left_begin, left_end, right_begin, right_end,
+            boost::integral_constant<bool,
+                LeftTraits::has_kernel::value && RightTraits::has_kernel::value>());
+    }
+
+    static bool equal_codeunits(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            boost::true_type)
+    {
+        size_t length = left_end - left_begin;
+
+        if(length != static_cast<size_t>(right_end - right_begin)) {
+            return false;
+        } else if(length == 0) {
+            return true;
+        }
+
+        return std::memcmp(to_pointer(left_begin), to_pointer(right_begin),
+            length * sizeof(left_codeunit_type)) == 0;
+    }
+
+    static bool equal_codeunits(
+            left_iterator_type left, left_iterator_type left_end,
+            right_iterator_type right, right_iterator_type right_end,
+            boost::false_type)
+    {
+        for(; left != left_end && right != right_end; ++left, ++right) {
+            if(*left != *right) {
+                return false;
+            }
+        }
+
+        return left == left_end && right == right_end;
+    }
+
+    static bool equals(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            compare_ascii_runs)
+    {
+        if(left_begin == left_end || right_begin == right_end) {
+            return left_begin == left_end && right_begin == right_end;
+        }
+
+        const left_codeunit_type* left = to_pointer(left_begin);
+        const left_codeunit_type* left_last = left + (left_end - left_begin);
+        const right_codeunit_type* right = to_pointer(right_begin);
+        const right_codeunit_type* right_last = right + (right_end - right_begin);
+
+        while(left != left_last && right != right_last) {
+            if(is_ascii_codeunit(*left) && is_ascii_codeunit(*right)) {
+                // the longer run may go on where the other one has an
+                // overlong form of an ASCII code point, so only the shorter
+                // of the two runs is compared code unit by code unit
+                ptrdiff_t length = (std::min)(
+                    encoder_kernel<left_encoder>::skip_ascii(left, left_last) - left,
+                    encoder_kernel<right_encoder>::skip_ascii(right, right_last) - right);
+
+                if(!std::equal(left, left + length, right)) {
+                    return false;
+                }
+
+                left += length;
+                right += length;
+            } else if(left_encoder::decode(left, left_last, typename LeftTraits::policy()) !=
+                right_encoder::decode(right, right_last, typename RightTraits::policy()))
+            {
+                return false;
+            }
+        }
+
+        return left == left_last && right == right_last;
+    }
+
+    static bool equals(
+            left_iterator_type left, left_iterator_type left_end,
+            right_iterator_type right, right_iterator_type right_end,
+            decode_codepoints)
+    {
+        while(left != left_end && right != right_end) {
+            if(left_encoder::decode(left, left_end, typename LeftTraits::policy()) !=
+                right_encoder::decode(right, right_end, typename RightTraits::policy()))
+            {
+                return false;
+            }
+        }
+
+        return left == left_end && right == right_end;
+    }
+
+    static int compare(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            compare_codeunits)
+    {
+        return order_codeunits(left_begin, left_end, right_begin, right_end,
+            boost::integral_constant<bool,
+                LeftTraits::has_kernel::value && RightTraits::has_kernel::value>());
+    }
+
+    static int order_codeunits(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            boost::true_type)
+    {
+        typedef codeunit_order<left_encoder> order;
+
+        size_t left_length = left_end - left_begin;
+        size_t right_length = right_end - right_begin;
+        size_t length = (std::min)(left_length, right_length);
+
+        if(length != 0) {
+            const left_codeunit_type* left = to_pointer(left_begin);
+            const right_codeunit_type* right = to_pointer(right_begin);
+
+            if(sizeof(left_codeunit_type) == 1) {
+                int result = std::memcmp(left, right, length);
+                if(result != 0) {
+                    return result;
+                }
+            } else {
+                std::pair<const left_codeunit_type*, const right_codeunit_type*> mismatch =
+                    std::mismatch(left, left + length, right);
+
+                if(mismatch.first != left + length) {
+                    return compare_codepoints(
+                        order::key(*mismatch.first), order::key(*mismatch.second));
+                }
+            }
+        }
+
+        return compare_lengths(left_length, right_length);
+    }
+
+    static int order_codeunits(
+            left_iterator_type left, left_iterator_type left_end,
+            right_iterator_type right, right_iterator_type right_end,
+            boost::false_type)
+    {
+        typedef codeunit_order<left_encoder> order;
+
+        for(; left != left_end && right != right_end; ++left, ++right) {
+            if(*left != *right) {
+                return compare_codepoints(order::key(*left), order::key(*right));
+            }
+        }
+
+        return (left != left_end) - (right != right_end);
+    }
+
+    static int compare(
+            left_iterator_type left_begin, left_iterator_type left_end,
+            right_iterator_type right_begin, right_iterator_type right_end,
+            compare_ascii_runs)
+    {
+        if(left_begin == left_end || right_begin == right_end) {
+            return (left_begin != left_end) - (right_begin != right_end);
+        }
+
+        const left_codeunit_type* left = to_pointer(left_begin);
+        const left_codeunit_type* left_last = left + (left_end - left_begin);
+        const right_codeunit_type* right = to_pointer(right_begin);
+        const right_codeunit_type* right_last = right + (right_end - right_begin);
+
+        while(left != left_last && right != right_last) {
+            if(is_ascii_codeunit(*left) && is_ascii_codeunit(*right)) {
+                // ASCII code units are their own code points, so the shorter
+                // of the two runs is compared code unit by code unit
+                ptrdiff_t length = (std::min)(
+                    encoder_kernel<left_encoder>::skip_ascii(left, left_last) - left,
+                    encoder_kernel<right_encoder>::skip_ascii(right, right_last) - right);
+
+                std::pair<const left_codeunit_type*, const right_codeunit_type*> mismatch =
+                    std::mismatch(left, left + length, right);
+
+                if(mismatch.first != left + length) {
+                    return compare_codepoints(
+                        static_cast<codepoint_type>(*mismatch.first),
+                        static_cast<codepoint_type>(*mismatch.second));
+                }
+
+                left += length;
+                right += length;
+            } else {
+                codepoint_type left_codepoint =
+                    left_encoder::decode(left, left_last, typename LeftTraits::policy());
+                codepoint_type right_codepoint =
+                    right_encoder::decode(right, right_last, typename RightTraits::policy());
+
+                if(left_codepoint != right_codepoint) {
+                    return compare_codepoints(left_codepoint, right_codepoint);
+                }
+            }
+        }
+
+        return (left != left_last) - (right != right_last);
+    }
+
+    static int compare(
+            left_iterator_type left, left_iterator_type left_end,
+            right_iterator_type right, right_iterator_type right_end,
+            decode_codepoints)
+    {
+        while(left != left_end && right != right_end) {
+            codepoint_type left_codepoint =
+                left_encoder::decode(left, left_end, typename LeftTraits::policy());
+            codepoint_type right_codepoint =
+                right_encoder::decode(right, right_end, typename RightTraits::policy());
+
+            if(left_codepoint != right_codepoint) {
+                return compare_codepoints(left_codepoint, right_codepoint);
+            }
+        }
+
+        return (left != left_end) - (right != right_end);
+    }
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
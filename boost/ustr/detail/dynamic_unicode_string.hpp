@@ -4,6 +4,7 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/ustr/unicode_string_adapter.hpp>
 
 namespace boost {
@@ -66,6 +67,22 @@ class dynamic_unicode_string_object {
     virtual const unicode_string_type& get_type() const = 0;
     virtual dynamic_unicode_string_object* clone() const = 0;
 
+    /*
+     * Code point length of the string. The fallback walks the code
+     * points, implementations should count them more cheaply.
+     */
+    virtual size_t length() const {
+        size_t length = 0;
+        boost::scoped_ptr<dynamic_codepoint_iterator_object> it(begin());
+        boost::scoped_ptr<dynamic_codepoint_iterator_object> last(end());
+
+        for(; !it->equals(last.get()); it->increment()) {
+            ++length;
+        }
+
+        return length;
+    }
+
     virtual ~dynamic_unicode_string_object() { }
 };
 
@@ -159,11 +176,7 @@ class dynamic_unicode_string {
     }
 
     size_t length() const {
-        size_t length = 0;
-        for(dynamic_codepoint_iterator it = begin(); it != end(); ++it) {
-            ++length;
-        }
-        return length;
+        return get()->length();
     }
 
     bool operator ==(const dynamic_unicode_string& other) const {
@@ -268,6 +281,10 @@ class dynamic_unicode_string_impl : public dynamic_unicode_string_object {
         return new this_type(_str);
     }
 
+    virtual size_t length() const {
+        return _str.length();
+    }
+
     virtual ~dynamic_unicode_string_impl() { }
 
   private:
@@ -0,0 +1,343 @@
+
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/static_assert.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/ascii.hpp>
+#include <boost/ustr/detail/utf8_validate.hpp>
+#include <boost/ustr/detail/utf16_validate.hpp>
+#include <boost/ustr/detail/utf32_validate.hpp>
+#include <boost/ustr/detail/utf8_transcode.hpp>
+#include <boost/ustr/detail/utf16_transcode.hpp>
+#include <boost/ustr/detail/utf32_transcode.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Bulk operations of an encoder over contiguous code units.
+ *
+ * utf_encoding_traits selects these kernels when the code unit iterator of
+ * the string type is contiguous. Encoders without a specialization, including
+ * custom encoder traits, keep using the generic code point by code point loops.
+ *
+ * validate() may also count the code points of the range in the same pass,
+ * storing the length when the range is well formed. count_codepoints() only
+ * counts, which is exact for well formed ranges: UTF-8 counts the bytes that
+ * are not continuation bytes, UTF-16 the code units that are not low
+ * surrogates.
+ *
+ * ascii_compatible is set for encoders where every code unit below 0x80 is a
+ * code point of the same value. Such encoders may copy ASCII runs verbatim
+ * with skip_ascii() instead of decoding them.
+ */
+template <typename Encoder>
+class encoder_kernel {
+  public:
+    static const bool available = false;
+    static const bool ascii_compatible = false;
+
+    // nothing is known about the encoder, so assume the shortest
+    static const size_t max_codeunit_length = 1;
+};
+
+template <>
+class encoder_kernel<utf8_encoder> {
+  public:
+    static const bool available = true;
+    static const bool ascii_compatible = true;
+    static const size_t max_codeunit_length = 4;
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 1);
+
+        const unsigned char* first = reinterpret_cast<const unsigned char*>(begin);
+        const unsigned char* last = reinterpret_cast<const unsigned char*>(end);
+
+        return encoding::utf8::find_malformed(first, last) == last;
+    }
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end, size_t& length) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 1);
+
+        const unsigned char* first = reinterpret_cast<const unsigned char*>(begin);
+        const unsigned char* last = reinterpret_cast<const unsigned char*>(end);
+
+        return encoding::utf8::find_malformed(first, last, length) == last;
+    }
+
+    template <typename CodeUnit>
+    static size_t count_codepoints(const CodeUnit* begin, const CodeUnit* end) {
+        return encoding::utf8::utf32_length(
+            reinterpret_cast<const unsigned char*>(begin),
+            reinterpret_cast<const unsigned char*>(end));
+    }
+
+    template <typename CodeUnit>
+    static const CodeUnit* skip_ascii(const CodeUnit* begin, const CodeUnit* end) {
+        return find_non_ascii(begin, end);
+    }
+};
+
+template <>
+class encoder_kernel<utf16_encoder> {
+  public:
+    static const bool available = true;
+    static const bool ascii_compatible = true;
+    static const size_t max_codeunit_length = 2;
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 2);
+
+        const boost::uint16_t* first = reinterpret_cast<const boost::uint16_t*>(begin);
+        const boost::uint16_t* last = reinterpret_cast<const boost::uint16_t*>(end);
+
+        return encoding::utf16::find_malformed(first, last) == last;
+    }
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end, size_t& length) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 2);
+
+        const boost::uint16_t* first = reinterpret_cast<const boost::uint16_t*>(begin);
+        const boost::uint16_t* last = reinterpret_cast<const boost::uint16_t*>(end);
+
+        return encoding::utf16::find_malformed(first, last, length) == last;
+    }
+
+    template <typename CodeUnit>
+    static size_t count_codepoints(const CodeUnit* begin, const CodeUnit* end) {
+        return encoding::utf16::utf32_length(
+            reinterpret_cast<const boost::uint16_t*>(begin),
+            reinterpret_cast<const boost::uint16_t*>(end));
+    }
+
+    template <typename CodeUnit>
+    static const CodeUnit* skip_ascii(const CodeUnit* begin, const CodeUnit* end) {
+        return find_non_ascii(begin, end);
+    }
+};
+
+template <>
+class encoder_kernel<utf32_encoder> {
+  public:
+    static const bool available = true;
+    static const bool ascii_compatible = true;
+    static const size_t max_codeunit_length = 1;
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 4);
+
+        const boost::uint32_t* first = reinterpret_cast<const boost::uint32_t*>(begin);
+        const boost::uint32_t* last = reinterpret_cast<const boost::uint32_t*>(end);
+
+        return encoding::utf32::find_out_of_range(first, last) == last;
+    }
+
+    template <typename CodeUnit>
+    static bool validate(const CodeUnit* begin, const CodeUnit* end, size_t& length) {
+        BOOST_STATIC_ASSERT(sizeof(CodeUnit) == 4);
+
+        if(validate(begin, end)) {
+            length = end - begin;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename CodeUnit>
+    static size_t count_codepoints(const CodeUnit* begin, const CodeUnit* end) {
+        return end - begin;
+    }
+
+    template <typename CodeUnit>
+    static const CodeUnit* skip_ascii(const CodeUnit* begin, const CodeUnit* end) {
+        return find_non_ascii(begin, end);
+    }
+};
+
+/*
+ * Bulk conversion between two encoders over contiguous code units.
+ *
+ * length() returns the number of target code units needed to convert the
+ * source range, exact for well formed input and an upper bound otherwise.
+ * convert() writes into a buffer of that size, advancing out, and returns the
+ * position of the first source code point it leaves to the caller, or end.
+ * Such code points are malformed, or need a policy to be encoded.
+ */
+template <typename SourceEncoder, typename TargetEncoder>
+class transcode_kernel {
+  public:
+    static const bool available = false;
+};
+
+template <>
+class transcode_kernel<utf8_encoder, utf16_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf8::utf16_length(
+            reinterpret_cast<const unsigned char*>(begin),
+            reinterpret_cast<const unsigned char*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 1 && sizeof(TargetUnit) == 2);
+
+        boost::uint16_t* target = reinterpret_cast<boost::uint16_t*>(out);
+        const unsigned char* stop = encoding::utf8::convert_to_utf16(
+            reinterpret_cast<const unsigned char*>(begin),
+            reinterpret_cast<const unsigned char*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return begin + (stop - reinterpret_cast<const unsigned char*>(begin));
+    }
+};
+
+template <>
+class transcode_kernel<utf16_encoder, utf8_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf16::utf8_length(
+            reinterpret_cast<const boost::uint16_t*>(begin),
+            reinterpret_cast<const boost::uint16_t*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 2 && sizeof(TargetUnit) == 1);
+
+        unsigned char* target = reinterpret_cast<unsigned char*>(out);
+        const boost::uint16_t* stop = encoding::utf16::convert_to_utf8(
+            reinterpret_cast<const boost::uint16_t*>(begin),
+            reinterpret_cast<const boost::uint16_t*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return reinterpret_cast<const SourceUnit*>(stop);
+    }
+};
+
+template <>
+class transcode_kernel<utf8_encoder, utf32_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf8::utf32_length(
+            reinterpret_cast<const unsigned char*>(begin),
+            reinterpret_cast<const unsigned char*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 1 && sizeof(TargetUnit) == 4);
+
+        boost::uint32_t* target = reinterpret_cast<boost::uint32_t*>(out);
+        const unsigned char* stop = encoding::utf8::convert_to_utf32(
+            reinterpret_cast<const unsigned char*>(begin),
+            reinterpret_cast<const unsigned char*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return begin + (stop - reinterpret_cast<const unsigned char*>(begin));
+    }
+};
+
+template <>
+class transcode_kernel<utf16_encoder, utf32_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf16::utf32_length(
+            reinterpret_cast<const boost::uint16_t*>(begin),
+            reinterpret_cast<const boost::uint16_t*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 2 && sizeof(TargetUnit) == 4);
+
+        boost::uint32_t* target = reinterpret_cast<boost::uint32_t*>(out);
+        const boost::uint16_t* stop = encoding::utf16::convert_to_utf32(
+            reinterpret_cast<const boost::uint16_t*>(begin),
+            reinterpret_cast<const boost::uint16_t*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return reinterpret_cast<const SourceUnit*>(stop);
+    }
+};
+
+template <>
+class transcode_kernel<utf32_encoder, utf8_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf32::utf8_length(
+            reinterpret_cast<const boost::uint32_t*>(begin),
+            reinterpret_cast<const boost::uint32_t*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 4 && sizeof(TargetUnit) == 1);
+
+        unsigned char* target = reinterpret_cast<unsigned char*>(out);
+        const boost::uint32_t* stop = encoding::utf32::convert_to_utf8(
+            reinterpret_cast<const boost::uint32_t*>(begin),
+            reinterpret_cast<const boost::uint32_t*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return reinterpret_cast<const SourceUnit*>(stop);
+    }
+};
+
+template <>
+class transcode_kernel<utf32_encoder, utf16_encoder> {
+  public:
+    static const bool available = true;
+
+    template <typename SourceUnit>
+    static size_t length(const SourceUnit* begin, const SourceUnit* end) {
+        return encoding::utf32::utf16_length(
+            reinterpret_cast<const boost::uint32_t*>(begin),
+            reinterpret_cast<const boost::uint32_t*>(end));
+    }
+
+    template <typename SourceUnit, typename TargetUnit>
+    static const SourceUnit* convert(const SourceUnit* begin, const SourceUnit* end, TargetUnit*& out) {
+        BOOST_STATIC_ASSERT(sizeof(SourceUnit) == 4 && sizeof(TargetUnit) == 2);
+
+        boost::uint16_t* target = reinterpret_cast<boost::uint16_t*>(out);
+        const boost::uint32_t* stop = encoding::utf32::convert_to_utf16(
+            reinterpret_cast<const boost::uint32_t*>(begin),
+            reinterpret_cast<const boost::uint32_t*>(end), target);
+
+        out = reinterpret_cast<TargetUnit*>(target);
+        return reinterpret_cast<const SourceUnit*>(stop);
+    }
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
@@ -8,8 +8,11 @@
 
 #include <string>
 #include <iterator>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 #include <boost/ustr/detail/incl.hpp>
 #include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
 #include <boost/ustr/policy.hpp>
 
 namespace boost { 
@@ -32,6 +35,8 @@ class utf_encoding_traits {
     typedef StringTraits                                string_traits;
     typedef IteratorTag                                 iterator_tag;
 
+    typedef typename
+        string_traits::string_type                      string_type;
     typedef typename 
         string_traits::codeunit_type                    codeunit_type;
     typedef typename 
@@ -60,11 +65,11 @@ class utf_encoding_traits {
      * it is not possible to get the precise code unit length without looking
      * through every single code point of the target string.
      *
-     * Still, this is a good way to estimate the memory needed for allocation and
-     * can potentially save some memory reallocation effort.
+     * The estimate is the worst case for the encoder, so that reserving it
+     * up front leaves no reallocation to do. It is exact for UTF-32.
      */
     static size_t estimate_codeunit_length(size_t codepoint_length) {
-        return codepoint_length;
+        return codepoint_length * util::encoder_kernel<encoder>::max_codeunit_length;
     }
 
     static void append_codepoint(mutable_strptr_type& str, const codepoint_type& codepoint) {
@@ -73,16 +78,206 @@ class utf_encoding_traits {
     }
 
     static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end) {
-        try {
-            while(begin != end) {
-                encoder::decode(begin, end, error_policy());
+        return validate(begin, end, has_kernel());
+    }
+
+    /*
+     * Validate the code units and count their code points in the same pass.
+     * The length is only stored if the code units are well formed.
+     */
+    static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end, size_t& length) {
+        return validate(begin, end, length, has_kernel());
+    }
+
+    /*
+     * Validate code units that may stop in the middle of a code point, as a
+     * block of appended code units may. A code point cut short at the end is
+     * left unchecked: begin is moved up to it and the number of code points
+     * before it is added to length. If the code units before it are
+     * malformed, false is returned and begin and length are left alone.
+     */
+    static bool validate_prefix(codeunit_iterator_type& begin, codeunit_iterator_type end, size_t& length) {
+        codeunit_iterator_type cut = incomplete_suffix(begin, end);
+        size_t prefix_length;
+
+        if(!validate(begin, cut, prefix_length)) {
+            return false;
+        }
+
+        begin = cut;
+        length += prefix_length;
+        return true;
+    }
+
+    /*
+     * Count the code points of a well formed code unit range, a block at
+     * a time where the kernels are available.
+     */
+    static size_t codepoint_length(codeunit_iterator_type begin, codeunit_iterator_type end) {
+        return codepoint_length(begin, end, has_kernel());
+    }
+
+    /*
+     * True when every code point of the code units is spelled in as few
+     * code units as it takes. The UTF-8 decoder accepts the longer three
+     * and four byte forms, so equal strings may differ in their code units
+     * unless both are in the shortest form. UTF-16 and UTF-32 have a single
+     * form for every code point.
+     */
+    static bool shortest_form(codeunit_iterator_type begin, codeunit_iterator_type end) {
+        return shortest_form(begin, end, has_longer_forms());
+    }
+
+    /*
+     * Append the code units in [begin, end) to str, replacing every malformed
+     * sequence with the code point chosen by Policy. Well formed code points
+     * of a single code unit are copied through unchanged, so only the
+     * malformed parts pay for the policy call. Longer ones are encoded again,
+     * which spells overlong UTF-8 forms in the shortest form.
+     */
+    template <typename CodeunitInputIterator>
+    static void sanitize(CodeunitInputIterator begin, CodeunitInputIterator end, mutable_strptr_type& str) {
+        string_traits::mutable_strptr::check_and_initialize(str);
+
+        while(begin != end) {
+            CodeunitInputIterator sequence_start = begin;
+            decode_result result = encoder::try_decode(begin, end);
+
+            if(result.valid() && result.consumed == 1) {
+                string_traits::mutable_strptr::append(str, *sequence_start);
+            } else if(result.valid()) {
+                encoder::encode(result.codepoint,
+                    string_traits::mutable_strptr::output_iterator(str), Policy());
+            } else {
+                encoder::encode(resolve_decode_result(result, Policy()),
+                    string_traits::mutable_strptr::output_iterator(str), Policy());
+            }
+        }
+    }
+
+    /*
+     * True when the code units are contiguous in memory and the encoder
+     * has bulk kernels, i.e. when util::encoder_kernel<encoder> may be
+     * applied to the code units through util::to_pointer().
+     */
+    typedef boost::integral_constant<bool,
+        util::is_contiguous_range<string_type, codeunit_iterator_type>::value &&
+        util::encoder_kernel<encoder>::available>       has_kernel;
+
+  private:
+    typedef util::encoder_kernel<encoder>               kernel;
+
+  public:
+    /*
+     * Start of a code point cut short by end, or end if there is none,
+     * found by decoding from each of the last few code units in turn.
+     * Cuts a block of well formed code units at a code point boundary.
+     */
+    static codeunit_iterator_type incomplete_suffix(codeunit_iterator_type begin, codeunit_iterator_type end) {
+        codeunit_iterator_type start = end;
+
+        for(size_t i = 1; i < kernel::max_codeunit_length && start != begin; ++i) {
+            codeunit_iterator_type current = --start;
+            decode_status status = encoder::try_decode(current, end).status;
+
+            if(status == decode_incomplete) {
+                return start;
+            } else if(status != decode_malformed) {
+                break;
+            }
+        }
+
+        return end;
+    }
+
+  private:
+    typedef boost::integral_constant<bool,
+        boost::is_same<encoder, util::utf8_encoder>::value> has_longer_forms;
+
+    static bool shortest_form(codeunit_iterator_type, codeunit_iterator_type, boost::false_type) {
+        return true;
+    }
+
+    // the overlong two byte forms are malformed, which leaves the three byte
+    // forms led by 0xE0 and the four byte forms led by 0xF0
+    static bool shortest_form(codeunit_iterator_type begin, codeunit_iterator_type end, boost::true_type) {
+        while(begin != end) {
+            unsigned char byte = *begin++;
+
+            if((byte == 0xE0 || byte == 0xF0) && begin != end) {
+                unsigned char next = *begin;
+
+                if(next >= 0x80 && next < (byte == 0xE0 ? 0xA0 : 0x90)) {
+                    return false;
+                }
             }
+        }
+        return true;
+    }
+
+    static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end, boost::true_type) {
+        if(begin == end) {
             return true;
-        } catch(encoding_error) {
-            return false;
         }
+
+        const codeunit_type* first = util::to_pointer(begin);
+        return kernel::validate(first, first + (end - begin));
     }
-    
+
+    static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end, boost::false_type) {
+        while(begin != end) {
+            if(!encoder::try_decode(begin, end).valid()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end,
+            size_t& length, boost::true_type)
+    {
+        if(begin == end) {
+            length = 0;
+            return true;
+        }
+
+        const codeunit_type* first = util::to_pointer(begin);
+        return kernel::validate(first, first + (end - begin), length);
+    }
+
+    static bool validate(codeunit_iterator_type begin, codeunit_iterator_type end,
+            size_t& length, boost::false_type)
+    {
+        size_t codepoints = 0;
+        while(begin != end) {
+            if(!encoder::try_decode(begin, end).valid()) {
+                return false;
+            }
+            ++codepoints;
+        }
+
+        length = codepoints;
+        return true;
+    }
+
+    static size_t codepoint_length(codeunit_iterator_type begin, codeunit_iterator_type end, boost::true_type) {
+        if(begin == end) {
+            return 0;
+        }
+
+        const codeunit_type* first = util::to_pointer(begin);
+        return kernel::count_codepoints(first, first + (end - begin));
+    }
+
+    static size_t codepoint_length(codeunit_iterator_type begin, codeunit_iterator_type end, boost::false_type) {
+        size_t length = 0;
+        while(begin != end) {
+            encoder::decode(begin, end, Policy());
+            ++length;
+        }
+        return length;
+    }
+
 };
 
 template <
@@ -131,14 +326,14 @@ class codepoint_iterator :
     const codepoint_type operator *() const {
         if(_current == _next) {
             // the iterator has just been incremented
-            return encoder::decode(_next, _end, Policy());
+            return decode(_next, _end);
         } else {
             // the iterator has been dereferenced before
             // since the last increment. This shouldn't
             // happen often as most code only dereference the
             // iterator once for each increment.
             codeunit_iterator_type clone(_current);
-            return encoder::decode(clone, _end, Policy());
+            return decode(clone, _end);
         }
     }
 
@@ -184,7 +379,7 @@ class codepoint_iterator :
                 // Even without dereference, the decoding still
                 // needs to be performed as we can't otherwise
                 // know which position is the next codepoint.
-                encoder::decode(_next, _end, Policy());
+                decode(_next, _end);
             }
             
             _current = _next;
@@ -197,12 +392,12 @@ class codepoint_iterator :
                 // Since _next == _current, after decrementing _next 
                 // will point right after _current so _next still
                 // remains valid.
-                encoder::decode_previous(_begin, _current, Policy());
+                decode_previous(_begin, _current);
             } else {
                 // If _next is already pointing after _current then 
                 // after decrement _next would become invalid. 
                 // Hence we'll reset _next to be the same as _current.
-                encoder::decode_previous(_begin, _current, Policy());
+                decode_previous(_begin, _current);
                 _next = _current;
             }
         }
@@ -216,13 +411,107 @@ class codepoint_iterator :
         return !(_current == other._current);
     }
 
+    /*
+     * The code unit iterator at the first code unit of the current code point.
+     */
+    codeunit_iterator_type get_codeunit_iterator() const {
+        return _current;
+    }
+
+    /*
+     * Number of code points from first to last. Contiguous code units are
+     * validated and counted by the kernels in one pass, and only malformed
+     * ranges are walked code point by code point, as the policy decides how
+     * many code points their malformed sequences decode to.
+     */
+    static ptrdiff_t distance(const codepoint_iterator& first, const codepoint_iterator& last) {
+        return distance(first, last, boost::integral_constant<bool,
+                util::is_contiguous_iterator<codeunit_iterator_type>::value &&
+                util::encoder_kernel<encoder>::available>());
+    }
+
   private:
+    static ptrdiff_t distance(const codepoint_iterator& first, const codepoint_iterator& last,
+            boost::true_type)
+    {
+        if(first._current == last._current) {
+            return 0;
+        }
+
+        typedef typename std::iterator_traits<codeunit_iterator_type>::value_type codeunit_type;
+
+        const codeunit_type* begin = util::to_pointer(first._current);
+        size_t length;
+
+        if(util::encoder_kernel<encoder>::validate(
+                begin, begin + (last._current - first._current), length))
+        {
+            return static_cast<ptrdiff_t>(length);
+        }
+
+        return distance(first, last, boost::false_type());
+    }
+
+    static ptrdiff_t distance(const codepoint_iterator& first, const codepoint_iterator& last,
+            boost::false_type)
+    {
+        codeunit_iterator_type current = first._current;
+        ptrdiff_t length = 0;
+
+        while(current != last._current) {
+            decode(current, first._end);
+            ++length;
+        }
+
+        return length;
+    }
+
+    static const bool ascii_compatible = util::encoder_kernel<encoder>::ascii_compatible;
+
+    /*
+     * ASCII code units are decoded inline, which spares ASCII heavy
+     * text the branches of the full decoder.
+     */
+    static codepoint_type decode(codeunit_iterator_type& current, const codeunit_iterator_type& end) {
+        if(ascii_compatible && util::is_ascii_codeunit(*current)) {
+            return static_cast<codepoint_type>(*current++);
+        } else {
+            return encoder::decode(current, end, Policy());
+        }
+    }
+
+    static void decode_previous(const codeunit_iterator_type& begin, codeunit_iterator_type& current) {
+        codeunit_iterator_type previous(current);
+        --previous;
+
+        if(ascii_compatible && util::is_ascii_codeunit(*previous)) {
+            current = previous;
+        } else {
+            encoder::decode_previous(begin, current, Policy());
+        }
+    }
+
     mutable codeunit_iterator_type          _current;
     mutable codeunit_iterator_type          _next;
     codeunit_iterator_type                  _begin;
     codeunit_iterator_type                  _end;
 };
 
+/*
+ * Number of code points from first to last, counted as by
+ * codepoint_iterator::distance() instead of decoding every code point.
+ * Generic code finds it by argument dependent lookup when it calls
+ * distance() unqualified after a using std::distance declaration.
+ */
+template <typename CodeunitIterator, typename EncoderTraits, typename Policy, typename IteratorTag>
+inline ptrdiff_t distance(
+    const codepoint_iterator<CodeunitIterator, EncoderTraits, Policy, IteratorTag>& first,
+    const codepoint_iterator<CodeunitIterator, EncoderTraits, Policy, IteratorTag>& last)
+{
+    return codepoint_iterator<
+        CodeunitIterator, EncoderTraits, Policy, IteratorTag>::distance(first, last);
+}
+
 
 
 
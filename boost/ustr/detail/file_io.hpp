@@ -0,0 +1,241 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/transcoding_streambuf.hpp>
+
+namespace boost {
+namespace ustr {
+
+/*
+ * Encodings of text files, told apart by their byte order mark.
+ */
+enum file_encoding {
+    utf8_file,
+    utf16le_file,
+    utf16be_file,
+    utf32le_file,
+    utf32be_file
+};
+
+/*
+ * Finds the byte order mark at the start of the bytes from begin to end,
+ * setting encoding to the encoding it marks and returning its length, or
+ * returns 0 and leaves encoding alone if there is none.
+ */
+inline size_t detect_bom(const char* begin, const char* end, file_encoding& encoding) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(begin);
+    size_t size = end - begin;
+
+    // the UTF-32LE mark starts like the UTF-16LE one
+    if(size >= 4 && bytes[0] == 0xFF && bytes[1] == 0xFE && bytes[2] == 0 && bytes[3] == 0) {
+        encoding = utf32le_file;
+        return 4;
+    } else if(size >= 4 && bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 0xFE && bytes[3] == 0xFF) {
+        encoding = utf32be_file;
+        return 4;
+    } else if(size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        encoding = utf8_file;
+        return 3;
+    } else if(size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        encoding = utf16le_file;
+        return 2;
+    } else if(size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        encoding = utf16be_file;
+        return 2;
+    }
+    return 0;
+}
+
+namespace util {
+
+// code units read or written at a time
+static const size_t file_block_size = 64 * 1024;
+
+inline bool little_endian() {
+    const utf16_codeunit_type one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+inline bool big_endian_file(file_encoding encoding) {
+    return encoding == utf16be_file || encoding == utf32be_file;
+}
+
+inline std::string bom_of(file_encoding encoding) {
+    switch(encoding) {
+        case utf16le_file:
+            return std::string("\xFF\xFE", 2);
+        case utf16be_file:
+            return std::string("\xFE\xFF", 2);
+        case utf32le_file:
+            return std::string("\xFF\xFE\0\0", 4);
+        case utf32be_file:
+            return std::string("\0\0\xFE\xFF", 4);
+        default:
+            return std::string("\xEF\xBB\xBF", 3);
+    }
+}
+
+// most code units of target_size bytes taken by the code points of one
+// code unit of source_size bytes in well formed text
+inline size_t max_codeunits_per_codeunit(size_t source_size, size_t target_size) {
+    // code points of the basic multilingual plane take one UTF-16 code
+    // unit and up to three UTF-8 ones
+    if(source_size == 2 && target_size == 1) {
+        return 3;
+    }
+    return source_size > target_size ? source_size / target_size : 1;
+}
+
+// appends the rest of file, made of code units of type CodeunitT, to builder
+template <typename CodeunitT, typename Builder>
+void read_codeunits(std::streambuf& file, size_t size, file_encoding encoding, Builder& builder) {
+    typedef transcoding_source<CodeunitT,
+        typename encoding_engine<sizeof(CodeunitT)>::type,
+        typename Builder::policy, file_block_size>      source_type;
+
+    // the exact length for the same encoding, and enough for any well
+    // formed text otherwise
+    builder.reserve(size / sizeof(CodeunitT) * max_codeunits_per_codeunit(
+        sizeof(CodeunitT), sizeof(typename Builder::codeunit_type)));
+
+    source_type source(&file, sizeof(CodeunitT) > 1 && big_endian_file(encoding) == little_endian());
+    source.read(builder);
+}
+
+// writes str to file as code units of type CodeunitT
+template <typename CodeunitT, typename Adapter>
+bool write_codeunits(std::streambuf& file, file_encoding encoding, const Adapter& str) {
+    typedef transcoding_sink<CodeunitT,
+        typename encoding_engine<sizeof(CodeunitT)>::type,
+        typename Adapter::policy, file_block_size>      sink_type;
+
+    sink_type sink(&file, sizeof(CodeunitT) > 1 && big_endian_file(encoding) == little_endian());
+    return sink.write(str) && sink.finish();
+}
+
+} // namespace util
+
+/*
+ * Appends the text of the file at path to builder, and returns the
+ * encoding of the file. The encoding is told by the byte order mark of
+ * the file, which is left out, or is the given one if there is none. The
+ * file is read a large block at a time, each of which is validated and
+ * converted into the encoding of the builder in one pass, and the builder
+ * is sized up front for the whole file. Malformed code units are replaced
+ * or rejected by the policy of the builder. Throws std::runtime_error if
+ * the file cannot be read.
+ *
+ *   u16_string::mutable_adapter_type text;
+ *   read_file("notes.txt", text);
+ */
+template <typename StringT, typename StringTraits, typename EncoderTraits, typename Policy>
+file_encoding read_file(const std::string& path,
+    unicode_string_adapter_builder<StringT, StringTraits, EncoderTraits, Policy>& builder,
+    file_encoding encoding = utf8_file)
+{
+    std::filebuf file;
+
+    if(!file.open(path.c_str(), std::ios::in | std::ios::binary)) {
+        throw std::runtime_error("read_file: cannot open " + path);
+    }
+
+    std::streamoff end = file.pubseekoff(0, std::ios::end, std::ios::in);
+    file.pubseekpos(0, std::ios::in);
+
+    char head[4];
+    std::streamsize head_size = file.sgetn(head, sizeof(head));
+    size_t bom_size = detect_bom(head, head + head_size, encoding);
+
+    std::streamoff start = file.pubseekpos(bom_size, std::ios::in);
+
+    if(end < 0 || start != static_cast<std::streamoff>(bom_size)) {
+        throw std::runtime_error("read_file: cannot read " + path);
+    }
+
+    size_t size = static_cast<size_t>(end) - bom_size;
+
+    switch(encoding) {
+        case utf16le_file:
+        case utf16be_file:
+            util::read_codeunits<utf16_codeunit_type>(file, size, encoding, builder);
+            break;
+        case utf32le_file:
+        case utf32be_file:
+            util::read_codeunits<codepoint_type>(file, size, encoding, builder);
+            break;
+        default:
+            util::read_codeunits<char>(file, size, encoding, builder);
+            break;
+    }
+
+    return encoding;
+}
+
+/*
+ * Reads the file at path into a string adapter of type Adapter, as
+ * read_file() above does:
+ *
+ *   u8_string text = read_file<u8_string>("notes.txt");
+ */
+template <typename Adapter>
+Adapter read_file(const std::string& path, file_encoding encoding = utf8_file) {
+    typename Adapter::mutable_adapter_type builder;
+    read_file(path, builder, encoding);
+    return builder.freeze();
+}
+
+/*
+ * Writes str to the file at path in the given encoding, preceded by its
+ * byte order mark if bom is set. The string is converted a large block
+ * at a time, however long it is. Throws std::runtime_error if the file
+ * cannot be written.
+ */
+template <typename StringT, typename StringTraits, typename EncoderTraits, typename Policy>
+void write_file(const std::string& path,
+    const unicode_string_adapter<StringT, StringTraits, EncoderTraits, Policy>& str,
+    file_encoding encoding = utf8_file, bool bom = false)
+{
+    std::filebuf file;
+
+    if(!file.open(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary)) {
+        throw std::runtime_error("write_file: cannot open " + path);
+    }
+
+    bool written = true;
+
+    if(bom) {
+        std::string mark = util::bom_of(encoding);
+        written = file.sputn(mark.data(), mark.size()) == static_cast<std::streamsize>(mark.size());
+    }
+
+    switch(encoding) {
+        case utf16le_file:
+        case utf16be_file:
+            written = written && util::write_codeunits<utf16_codeunit_type>(file, encoding, str);
+            break;
+        case utf32le_file:
+        case utf32be_file:
+            written = written && util::write_codeunits<codepoint_type>(file, encoding, str);
+            break;
+        default:
+            written = written && util::write_codeunits<char>(file, encoding, str);
+            break;
+    }
+
+    if(!file.close() || !written) {
+        throw std::runtime_error("write_file: cannot write " + path);
+    }
+}
+
+} // namespace ustr
+} // namespace boost
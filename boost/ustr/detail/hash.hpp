@@ -0,0 +1,296 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/utf8.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Streaming hash over the UTF-8 encoding of a sequence of code points.
+ *
+ * The bytes are consumed as little endian 64 bit words, so feeding them
+ * one at a time or a block at a time gives the same value. The result is
+ * never zero, which leaves zero free to mean "not computed yet".
+ */
+class codepoint_hasher {
+  public:
+    codepoint_hasher() :
+        _state(0x9E3779B97F4A7C15ULL), _word(0), _filled(0), _length(0)
+    { }
+
+    void append(unsigned char byte) {
+        _word |= static_cast<boost::uint64_t>(byte) << (8 * _filled);
+        ++_length;
+
+        if(++_filled == 8) {
+            mix(_word);
+            _word = 0;
+            _filled = 0;
+        }
+    }
+
+    void append(const unsigned char* begin, const unsigned char* end) {
+        while(_filled != 0 && begin != end) {
+            append(*begin++);
+        }
+
+        _length += (end - begin) & ~static_cast<ptrdiff_t>(7);
+        for(; end - begin >= 8; begin += 8) {
+            mix(load_word(begin));
+        }
+
+        while(begin != end) {
+            append(*begin++);
+        }
+    }
+
+    size_t finish() const {
+        boost::uint64_t hash = _state;
+        if(_filled != 0) {
+            hash = mix(hash, _word);
+        }
+
+        hash ^= _length;
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 33;
+
+        if(sizeof(size_t) < sizeof(boost::uint64_t)) {
+            hash ^= hash >> 32;
+        }
+
+        size_t result = static_cast<size_t>(hash);
+        return result != 0 ? result : 1;
+    }
+
+    /*
+     * Output iterator appending the bytes written through it, so that
+     * code points can be encoded straight into the hasher.
+     */
+    class byte_inserter {
+      public:
+        typedef std::output_iterator_tag    iterator_category;
+        typedef void                        value_type;
+        typedef void                        difference_type;
+        typedef void                        pointer;
+        typedef void                        reference;
+
+        explicit byte_inserter(codepoint_hasher& hasher) :
+            _hasher(&hasher)
+        { }
+
+        byte_inserter& operator =(char byte) {
+            _hasher->append(static_cast<unsigned char>(byte));
+            return *this;
+        }
+
+        byte_inserter& operator *() { return *this; }
+        byte_inserter& operator ++() { return *this; }
+        byte_inserter& operator ++(int) { return *this; }
+
+      private:
+        codepoint_hasher* _hasher;
+    };
+
+  private:
+    static boost::uint64_t rotate(boost::uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static boost::uint64_t mix(boost::uint64_t hash, boost::uint64_t word) {
+        word *= 0x87C37B91114253D5ULL;
+        word = rotate(word, 31);
+        word *= 0x4CF5AD432745937FULL;
+
+        hash ^= word;
+        return rotate(hash, 27) * 5 + 0x52DCE729;
+    }
+
+    void mix(boost::uint64_t word) {
+        _state = mix(_state, word);
+    }
+
+    // assembled byte by byte to stay independent of the host byte order,
+    // which compilers turn into a single load where the order matches
+    static boost::uint64_t load_word(const unsigned char* bytes) {
+        return
+            static_cast<boost::uint64_t>(bytes[0]) |
+            static_cast<boost::uint64_t>(bytes[1]) << 8 |
+            static_cast<boost::uint64_t>(bytes[2]) << 16 |
+            static_cast<boost::uint64_t>(bytes[3]) << 24 |
+            static_cast<boost::uint64_t>(bytes[4]) << 32 |
+            static_cast<boost::uint64_t>(bytes[5]) << 40 |
+            static_cast<boost::uint64_t>(bytes[6]) << 48 |
+            static_cast<boost::uint64_t>(bytes[7]) << 56;
+    }
+
+    boost::uint64_t _state;
+    boost::uint64_t _word;
+    unsigned int _filled;
+    boost::uint64_t _length;
+};
+
+/*
+ * Hash of the code points in a code unit range in the encoding of
+ * EncodingTraits, a utf_encoding_traits. The value depends only on the
+ * code points, so strings comparing equal in different encodings hash
+ * the same.
+ *
+ * The strategy is chosen at compile time:
+ *
+ *  - well formed UTF-8 already is the hashed byte sequence, and is fed
+ *    to the hasher a block at a time for contiguous ranges,
+ *  - well formed contiguous ranges with a transcode kernel to UTF-8 are
+ *    converted a chunk at a time into a buffer on the stack,
+ *  - everything else is decoded and re-encoded code point by code point.
+ *
+ * The byte path hashes the code units as they are, so it is only taken
+ * for code units in the shortest form. UTF-8 with overlong sequences is
+ * decoded instead, so that it hashes like the code points it stands for.
+ */
+template <typename EncodingTraits>
+class codepoint_hash {
+  public:
+    typedef typename
+        EncodingTraits::codeunit_iterator_type          codeunit_iterator_type;
+    typedef typename EncodingTraits::codeunit_type      codeunit_type;
+    typedef typename EncodingTraits::encoder            encoder;
+
+    static size_t hash(codeunit_iterator_type begin, codeunit_iterator_type end) {
+        return hash(begin, end, EncodingTraits::shortest_form(begin, end));
+    }
+
+    /*
+     * Hash of code units already known to be in the shortest form or
+     * not, see utf_encoding_traits::shortest_form().
+     */
+    static size_t hash(codeunit_iterator_type begin, codeunit_iterator_type end, bool shortest_form) {
+        codepoint_hasher hasher;
+
+        if(shortest_form) {
+            append(begin, end, hasher, strategy());
+        } else {
+            append(begin, end, hasher, decode_codepoints());
+        }
+        return hasher.finish();
+    }
+
+  private:
+    class hash_codeunits { };
+    class transcode_chunks { };
+    class decode_codepoints { };
+
+    static const size_t chunk_size = 256;
+
+    static const bool is_utf8 =
+        boost::is_same<encoder, utf8_encoder>::value &&
+        sizeof(codeunit_type) == 1 &&
+        EncodingTraits::replace_malformed;
+
+    static const bool transcode =
+        EncodingTraits::has_kernel::value &&
+        EncodingTraits::replace_malformed &&
+        transcode_kernel<encoder, utf8_encoder>::available;
+
+    typedef typename boost::mpl::if_c<is_utf8, hash_codeunits,
+        typename boost::mpl::if_c<transcode, transcode_chunks,
+            decode_codepoints>::type>::type             strategy;
+
+    static void append(
+            codeunit_iterator_type begin, codeunit_iterator_type end,
+            codepoint_hasher& hasher, hash_codeunits)
+    {
+        append_codeunits(begin, end, hasher, typename EncodingTraits::has_kernel());
+    }
+
+    static void append_codeunits(
+            codeunit_iterator_type begin, codeunit_iterator_type end,
+            codepoint_hasher& hasher, boost::true_type)
+    {
+        if(begin == end) {
+            return;
+        }
+
+        const unsigned char* first = reinterpret_cast<const unsigned char*>(to_pointer(begin));
+        hasher.append(first, first + (end - begin));
+    }
+
+    static void append_codeunits(
+            codeunit_iterator_type begin, codeunit_iterator_type end,
+            codepoint_hasher& hasher, boost::false_type)
+    {
+        for(; begin != end; ++begin) {
+            hasher.append(static_cast<unsigned char>(*begin));
+        }
+    }
+
+    static void append(
+            codeunit_iterator_type begin, codeunit_iterator_type end,
+            codepoint_hasher& hasher, transcode_chunks)
+    {
+        if(begin == end) {
+            return;
+        }
+
+        typedef transcode_kernel<encoder, utf8_encoder> kernel;
+
+        // each code unit of UTF-16 or UTF-32 takes at most four bytes
+        char buffer[chunk_size * 4];
+
+        const codeunit_type* current = to_pointer(begin);
+        const codeunit_type* last = current + (end - begin);
+
+        while(current != last) {
+            const codeunit_type* chunk_end =
+                (last - current > static_cast<ptrdiff_t>(chunk_size)) ?
+                    current + chunk_size : last;
+
+            char* out = buffer;
+            const codeunit_type* stop = kernel::convert(current, chunk_end, out);
+            hasher.append(
+                reinterpret_cast<const unsigned char*>(buffer),
+                reinterpret_cast<const unsigned char*>(out));
+
+            // the kernel stops short of code points it leaves to the
+            // decoder, such as surrogate pairs split by the chunk end
+            if(stop == current) {
+                utf8_encoder::encode(
+                    encoder::decode(stop, last, typename EncodingTraits::policy()),
+                    codepoint_hasher::byte_inserter(hasher),
+                    typename EncodingTraits::policy());
+            }
+
+            current = stop;
+        }
+    }
+
+    static void append(
+            codeunit_iterator_type begin, codeunit_iterator_type end,
+            codepoint_hasher& hasher, decode_codepoints)
+    {
+        while(begin != end) {
+            utf8_encoder::encode(
+                encoder::decode(begin, end, typename EncodingTraits::policy()),
+                codepoint_hasher::byte_inserter(hasher),
+                typename EncodingTraits::policy());
+        }
+    }
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
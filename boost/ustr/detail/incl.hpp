@@ -13,6 +13,14 @@
 #define BOOST_USTR_CPP0X
 #endif
 
+#if defined(BOOST_USTR_CPP0X)
+#   define BOOST_USTR_THREAD_LOCAL thread_local
+#elif defined(BOOST_MSVC)
+#   define BOOST_USTR_THREAD_LOCAL __declspec(thread)
+#else
+#   define BOOST_USTR_THREAD_LOCAL __thread
+#endif
+
 #ifdef BOOST_NO_CHAR16_T
     typedef boost::uint16_t     utf16_codeunit_type;
 #else
@@ -0,0 +1,296 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * The weak pointer type observing a shared string pointer.
+ */
+template <typename StrPtr>
+class weak_strptr;
+
+template <typename T>
+class weak_strptr< boost::shared_ptr<T> > {
+  public:
+    typedef boost::weak_ptr<T>      type;
+};
+
+#ifdef BOOST_USTR_CPP0X
+template <typename T>
+class weak_strptr< std::shared_ptr<T> > {
+  public:
+    typedef std::weak_ptr<T>        type;
+};
+#elif BOOST_HAS_TR1_SHARED_PTR
+template <typename T>
+class weak_strptr< std::tr1::shared_ptr<T> > {
+  public:
+    typedef std::tr1::weak_ptr<T>   type;
+};
+#endif
+
+} // namespace util
+
+/*
+ * Pool of canonical string buffers. Interning a string gives an adapter
+ * sharing the one buffer held by every other interned string of the same
+ * content, so interned strings share their memory and metadata, and are
+ * equal exactly when their buffers are the same pointer.
+ *
+ * Strings are interned in the shortest form, so that overlong UTF-8 gets
+ * the same buffer as the code points it stands for.
+ *
+ * The pool only keeps weak references to the buffers, so that a buffer is
+ * freed as usual once no adapter refers to it; the entries left behind are
+ * evicted as they are found, a bucket at a time as strings are interned,
+ * and in bulk by purge(). This requires string traits sharing buffers
+ * through a shared_ptr, like the default string_traits.
+ *
+ * Entries are spread over ShardCount shards by hash, each behind its own
+ * mutex, so that threads interning different strings rarely contend. The
+ * pool may be used from any number of threads at once.
+ *
+ *   intern_pool<u8_string> pool;
+ *   u8_string name = pool.intern(str);
+ */
+template <typename UnicodeStringAdapter, size_t ShardCount = 16>
+class intern_pool {
+  public:
+    typedef UnicodeStringAdapter                            adapter_type;
+    typedef typename adapter_type::string_traits            string_traits;
+    typedef typename adapter_type::const_strptr_type        const_strptr_type;
+    typedef typename util::weak_strptr<
+        const_strptr_type>::type                            weak_strptr_type;
+    typedef typename
+        adapter_type::codeunit_iterator_type                codeunit_iterator_type;
+
+    static const size_t shard_count = ShardCount;
+
+    intern_pool() { }
+
+    /*
+     * The interned string of the same content as str. Slices are interned
+     * as a buffer of their own, so that they do not keep alive the whole
+     * string they were cut from.
+     */
+    adapter_type intern(const adapter_type& str) {
+        if(str.codeunit_begin() == str.codeunit_end()) {
+            return adapter_type();
+        }
+
+        // encoding the code points again spells them in the shortest form
+        if(!str.shortest_form()) {
+            return intern(adapter_type::from_codepoints(str.begin(), str.end()));
+        }
+
+        size_t hash = str.hash();
+        shard& pool_shard = shard_of(hash);
+
+        {
+            boost::mutex::scoped_lock lock(pool_shard.lock);
+            const_strptr_type found = pool_shard.find(hash, str);
+
+            if(found) {
+                return adapter_type::from_const_strptr(found);
+            }
+        }
+
+        // the canonical buffer is made outside of the lock, and dropped
+        // again if another thread interned the same string meanwhile
+        adapter_type canonical = str.is_slice() ?
+            adapter_type::from_codeunits(str.codeunit_begin(), str.codeunit_end()) :
+            str;
+
+        boost::mutex::scoped_lock lock(pool_shard.lock);
+        const_strptr_type found = pool_shard.find(hash, str);
+
+        if(found) {
+            return adapter_type::from_const_strptr(found);
+        }
+
+        pool_shard.insert(hash, canonical.get_buffer());
+        return canonical;
+    }
+
+    /*
+     * The number of entries, including those of strings freed since but
+     * not evicted yet.
+     */
+    size_t size() const {
+        size_t size = 0;
+
+        for(size_t i = 0; i < shard_count; ++i) {
+            boost::mutex::scoped_lock lock(_shards[i].lock);
+            size += _shards[i].entries.size();
+        }
+
+        return size;
+    }
+
+    /*
+     * Evicts the entries of every string freed since it was interned, and
+     * returns the number of entries evicted.
+     */
+    size_t purge() {
+        size_t evicted = 0;
+
+        // the lock is taken for one bucket at a time,
+        // so that interning goes on meanwhile
+        for(size_t i = 0; i < shard_count; ++i) {
+            for(size_t bucket = 0; ; ++bucket) {
+                boost::mutex::scoped_lock lock(_shards[i].lock);
+
+                if(bucket >= _shards[i].entries.bucket_count()) {
+                    break;
+                }
+                evicted += _shards[i].sweep(bucket);
+            }
+        }
+
+        return evicted;
+    }
+
+  private:
+    typedef boost::unordered_multimap<
+        size_t, weak_strptr_type>                           entry_map;
+
+    class shard {
+      public:
+        shard() :
+            next_bucket(0)
+        { }
+
+        /*
+         * The interned buffer equal to str, evicting the expired entries
+         * of the same hash found on the way.
+         */
+        const_strptr_type find(size_t hash, const adapter_type& str) {
+            std::pair<typename entry_map::iterator,
+                typename entry_map::iterator> range = entries.equal_range(hash);
+
+            while(range.first != range.second) {
+                const_strptr_type buffer = range.first->second.lock();
+
+                if(!buffer) {
+                    range.first = entries.erase(range.first);
+                } else if(equals(buffer, str)) {
+                    return buffer;
+                } else {
+                    ++range.first;
+                }
+            }
+
+            return const_strptr_type();
+        }
+
+        /*
+         * Inserts an entry, and sweeps the next bucket in turn, so that the
+         * entries of freed strings are evicted as the shard grows without
+         * holding the lock over the whole shard at once.
+         */
+        void insert(size_t hash, const const_strptr_type& buffer) {
+            entries.insert(std::make_pair(hash, weak_strptr_type(buffer)));
+            sweep(next_bucket++ % entries.bucket_count());
+        }
+
+        /*
+         * Evicts the expired entries of a bucket, and returns the number
+         * of entries evicted. The hashes of expired entries are gathered a
+         * few at a time, as entries can only be erased through the map.
+         */
+        size_t sweep(size_t bucket) {
+            size_t evicted = 0;
+            size_t count;
+
+            do {
+                size_t expired[sweep_size];
+                count = 0;
+
+                for(typename entry_map::local_iterator it = entries.begin(bucket);
+                    it != entries.end(bucket) && count != sweep_size; ++it)
+                {
+                    if(it->second.expired() && (count == 0 || expired[count - 1] != it->first)) {
+                        expired[count++] = it->first;
+                    }
+                }
+
+                for(size_t i = 0; i < count; ++i) {
+                    evicted += evict(expired[i]);
+                }
+            } while(count == sweep_size);
+
+            return evicted;
+        }
+
+        mutable boost::mutex lock;
+        entry_map entries;
+        size_t next_bucket;
+
+      private:
+        static const size_t sweep_size = 8;
+
+        size_t evict(size_t hash) {
+            std::pair<typename entry_map::iterator,
+                typename entry_map::iterator> range = entries.equal_range(hash);
+            size_t evicted = 0;
+
+            while(range.first != range.second) {
+                if(range.first->second.expired()) {
+                    range.first = entries.erase(range.first);
+                    ++evicted;
+                } else {
+                    ++range.first;
+                }
+            }
+
+            return evicted;
+        }
+
+        static bool equals(const const_strptr_type& buffer, const adapter_type& str) {
+            codeunit_iterator_type it1 = string_traits::const_strptr::codeunit_begin(buffer);
+            codeunit_iterator_type end1 = string_traits::const_strptr::codeunit_end(buffer);
+            codeunit_iterator_type it2 = str.codeunit_begin();
+            codeunit_iterator_type end2 = str.codeunit_end();
+
+            for(; it1 != end1 && it2 != end2; ++it1, ++it2) {
+                if(*it1 != *it2) {
+                    return false;
+                }
+            }
+
+            return it1 == end1 && it2 == end2;
+        }
+
+        // keeps the locks of neighbouring shards off the same cache line
+        char _padding[64];
+    };
+
+    shard& shard_of(size_t hash) {
+        // the low bits select the bucket within the shard
+        return _shards[(hash >> 16) % shard_count];
+    }
+
+    intern_pool(const intern_pool&);
+    intern_pool& operator =(const intern_pool&);
+
+    shard _shards[ShardCount];
+};
+
+} // namespace ustr
+} // namespace boost
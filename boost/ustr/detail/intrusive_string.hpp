@@ -0,0 +1,267 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <new>
+#include <string>
+#include <ostream>
+#include <iterator>
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Reference counted string held in a single allocation: a header with the
+ * reference count, the buffer metadata and the size, directly followed by
+ * the code units. Holding a string thus costs one allocation and touches
+ * one block of memory, where a shared_ptr to a std::string costs three.
+ *
+ * Strings are created by create() with room for a number of code units and
+ * a reference count of one, and destroyed when the last reference is given
+ * up through intrusive_ptr_release(). The code units are only written while
+ * a single intrusive_string_buffer owns the string.
+ */
+template <typename CharT>
+class intrusive_string {
+  public:
+    typedef CharT                       value_type;
+    typedef const CharT*                const_iterator;
+    typedef const CharT*                iterator;
+    typedef const CharT&                const_reference;
+    typedef size_t                      size_type;
+    typedef ptrdiff_t                   difference_type;
+
+    static intrusive_string* create(size_t capacity) {
+        void* memory = ::operator new(sizeof(intrusive_string) + capacity * sizeof(CharT));
+        return new (memory) intrusive_string(capacity);
+    }
+
+    static intrusive_string* create(const CharT* begin, const CharT* end) {
+        intrusive_string* str = create(end - begin);
+        std::copy(begin, end, str->data());
+        str->_size = end - begin;
+        return str;
+    }
+
+    const_iterator begin() const {
+        return data();
+    }
+
+    const_iterator end() const {
+        return data() + _size;
+    }
+
+    const CharT* data() const {
+        return reinterpret_cast<const CharT*>(this + 1);
+    }
+
+    CharT* data() {
+        return reinterpret_cast<CharT*>(this + 1);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    /*
+     * Sets the number of code units in use, which must not exceed the
+     * capacity. Only for the owner of a string being written.
+     */
+    void resize(size_t size) {
+        _size = size;
+    }
+
+    buffer_metadata& metadata() const {
+        return _metadata;
+    }
+
+    friend void intrusive_ptr_add_ref(const intrusive_string* str) {
+        str->_references.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    friend void intrusive_ptr_release(const intrusive_string* str) {
+        if(str->_references.fetch_sub(1, boost::memory_order_acq_rel) == 1) {
+            str->~intrusive_string();
+            ::operator delete(const_cast<intrusive_string*>(str));
+        }
+    }
+
+  private:
+    explicit intrusive_string(size_t capacity) :
+        _references(1), _metadata(), _size(0), _capacity(capacity)
+    { }
+
+    intrusive_string(const intrusive_string&);
+    intrusive_string& operator =(const intrusive_string&);
+
+    mutable boost::atomic<size_t> _references;
+    mutable buffer_metadata _metadata;
+    size_t _size;
+    size_t _capacity;
+};
+
+template <typename CharT>
+bool operator ==(const intrusive_string<CharT>& str1, const intrusive_string<CharT>& str2) {
+    return str1.size() == str2.size() && std::equal(str1.begin(), str1.end(), str2.begin());
+}
+
+template <typename CharT>
+bool operator !=(const intrusive_string<CharT>& str1, const intrusive_string<CharT>& str2) {
+    return !(str1 == str2);
+}
+
+template <typename CharT>
+std::ostream& operator <<(std::ostream& out, const intrusive_string<CharT>& str) {
+    return out << std::basic_string<CharT>(str.begin(), str.end());
+}
+
+/*
+ * Sole owner of an intrusive_string being written, growing it as code
+ * units are appended. Growing moves the code units into a new, larger
+ * string, so a string reserved to its final size up front is built in a
+ * single allocation. Behaves as a unique_ptr to the string, and as a
+ * container for std::back_insert_iterator.
+ */
+template <typename CharT>
+class intrusive_string_buffer {
+  public:
+    typedef intrusive_string<CharT>     string_type;
+    typedef CharT                       value_type;
+    typedef const CharT&                const_reference;
+
+    intrusive_string_buffer() :
+        _str(0)
+    { }
+
+    explicit intrusive_string_buffer(string_type* str) :
+        _str(str)
+    { }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    intrusive_string_buffer(intrusive_string_buffer&& other) :
+        _str(other.release())
+    { }
+#endif
+
+    ~intrusive_string_buffer() {
+        reset();
+    }
+
+    string_type* get() const {
+        return _str;
+    }
+
+    string_type* release() {
+        string_type* str = _str;
+        _str = 0;
+        return str;
+    }
+
+    void reset(string_type* str = 0) {
+        if(_str) {
+            intrusive_ptr_release(_str);
+        }
+        _str = str;
+    }
+
+    size_t size() const {
+        return _str ? _str->size() : 0;
+    }
+
+    /*
+     * Makes room for length more code units. The capacity grows at least
+     * geometrically, so that many small reservations stay cheap.
+     */
+    void reserve(size_t length) {
+        size_t size = this->size() + length;
+
+        if(!_str) {
+            _str = string_type::create(size);
+        } else if(_str->capacity() < size) {
+            grow((std::max)(size, 2 * _str->capacity()));
+        }
+    }
+
+    void push_back(const_reference codeunit) {
+        if(!_str || _str->size() == _str->capacity()) {
+            reserve((std::max)(size(), static_cast<size_t>(min_capacity)));
+        }
+
+        _str->data()[_str->size()] = codeunit;
+        _str->resize(_str->size() + 1);
+    }
+
+    /*
+     * Extends the string by length code units and returns a pointer to the
+     * first of them.
+     */
+    CharT* append_space(size_t length) {
+        reserve(length);
+
+        CharT* space = _str->data() + _str->size();
+        _str->resize(_str->size() + length);
+        return space;
+    }
+
+    void shrink_space(size_t length) {
+        _str->resize(_str->size() - length);
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end) {
+        append(begin, end, typename std::iterator_traits<Iterator>::iterator_category());
+    }
+
+  private:
+    static const size_t min_capacity = 16;
+
+    void grow(size_t capacity) {
+        string_type* str = string_type::create(capacity);
+        std::copy(_str->begin(), _str->end(), str->data());
+        str->resize(_str->size());
+
+        reset(str);
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end, std::input_iterator_tag) {
+        for(; begin != end; ++begin) {
+            push_back(*begin);
+        }
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end, std::forward_iterator_tag) {
+        size_t length = std::distance(begin, end);
+
+        if(length != 0) {
+            std::copy(begin, end, append_space(length));
+        }
+    }
+
+    intrusive_string_buffer(const intrusive_string_buffer&);
+    intrusive_string_buffer& operator =(const intrusive_string_buffer&);
+
+    string_type* _str;
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
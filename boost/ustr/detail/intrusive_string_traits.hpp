@@ -0,0 +1,204 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <iterator>
+#include <algorithm>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
+#include <boost/ustr/detail/intrusive_string.hpp>
+
+namespace boost {
+namespace ustr {
+
+/*
+ * String traits over util::intrusive_string, which keeps the reference
+ * count, the buffer metadata and the code units of a string in a single
+ * allocation. Adapters share strings through boost::intrusive_ptr, and
+ * builders write them through a util::intrusive_string_buffer.
+ *
+ *   typedef unicode_string_adapter<
+ *       util::intrusive_string<char>,
+ *       intrusive_string_traits<char> >     intrusive_u8_string;
+ */
+template <typename CharT>
+class intrusive_string_traits {
+  public:
+    typedef intrusive_string_traits<CharT>          this_traits;
+    typedef util::intrusive_string<CharT>           string_type;
+
+    typedef CharT                                   codeunit_type;
+
+    static const size_t codeunit_size = sizeof(codeunit_type);
+
+    typedef string_type*                            raw_strptr_type;
+    typedef const string_type*                      const_raw_strptr_type;
+
+    typedef boost::intrusive_ptr<const string_type> const_strptr_type;
+    typedef util::intrusive_string_buffer<CharT>    mutable_strptr_type;
+
+    typedef const codeunit_type*                    codeunit_iterator_type;
+    typedef std::back_insert_iterator<
+        mutable_strptr_type>                        codeunit_output_iterator_type;
+
+    typedef typename util::get_raw_char_type<
+        codeunit_type>::type                        raw_char_type;
+    typedef std::basic_string<raw_char_type>        raw_string_type;
+
+    static raw_strptr_type new_string(const string_type& str) {
+        return string_type::create(str.begin(), str.end());
+    }
+
+    static raw_strptr_type new_string() {
+        return string_type::create(0);
+    }
+
+    static raw_strptr_type clone_string(raw_strptr_type str) {
+        return str ? new_string(*str) : new_string();
+    }
+
+    struct string {
+      public:
+        static bool equals(const string_type& str1, const string_type& str2) {
+            return str1.size() == str2.size() &&
+                std::equal(str1.begin(), str1.end(), str2.begin());
+        }
+
+        /*
+         * Intrusive strings are not copyable, so the code units are given
+         * back as a std::basic_string, e.g. for printing.
+         */
+        template <typename Iterator>
+        static std::basic_string<CharT> from_iter(Iterator begin, Iterator end) {
+            return std::basic_string<CharT>(begin, end);
+        }
+    };
+
+    struct raw_strptr {
+      public:
+        static bool equals(raw_strptr_type str1, raw_strptr_type str2) {
+            if(str1 && str2) {
+                return string::equals(*str1, *str2);
+            }
+            return (str1 ? str1->size() : 0) == (str2 ? str2->size() : 0);
+        }
+
+        static bool equals(raw_strptr_type str1, const string_type& str2) {
+            return str1 ? string::equals(*str1, str2) : str2.empty();
+        }
+
+        static void delete_string(raw_strptr_type str) {
+            if(str) {
+                intrusive_ptr_release(str);
+            }
+        }
+    };
+
+    struct const_strptr {
+      public:
+        static const_raw_strptr_type get(const const_strptr_type& str) {
+            return str.get();
+        }
+
+        static codeunit_iterator_type
+        codeunit_begin(const const_strptr_type& str) {
+            return str ? str->begin() : 0;
+        }
+
+        static codeunit_iterator_type
+        codeunit_end(const const_strptr_type& str) {
+            return str ? str->end() : 0;
+        }
+
+        static bool equals(const const_strptr_type& str1, const const_strptr_type& str2) {
+            return raw_strptr::equals(
+                const_cast<raw_strptr_type>(str1.get()),
+                const_cast<raw_strptr_type>(str2.get()));
+        }
+
+        /*
+         * Takes over the reference held by new_str.
+         */
+        static void reset(const_strptr_type& str, raw_strptr_type new_str) {
+            str.reset(new_str, false);
+        }
+
+        /*
+         * The metadata lives in the header of the string itself.
+         */
+        static util::buffer_metadata* metadata(const const_strptr_type& str) {
+            return str ? &str->metadata() : 0;
+        }
+    };
+
+    /*
+     * Strings are only allocated once there is something to write, so that
+     * the first reservation or append allocates the string at its size.
+     * Releasing a buffer never written to gives an empty string.
+     */
+    struct mutable_strptr {
+        static raw_strptr_type release(mutable_strptr_type& str) {
+            return str.get() ? str.release() : new_string();
+        }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        static raw_strptr_type release(mutable_strptr_type&& str) {
+            return str.get() ? str.release() : new_string();
+        }
+#endif
+
+        static raw_strptr_type get(mutable_strptr_type& str) {
+            return str.get();
+        }
+
+        static void append(mutable_strptr_type& str, codeunit_type codeunit) {
+            str.push_back(codeunit);
+        }
+
+        template <typename CodeunitIterator>
+        static void append(mutable_strptr_type& str, CodeunitIterator begin, CodeunitIterator end) {
+            str.append(begin, end);
+        }
+
+        static void reserve_space(mutable_strptr_type& str, size_t length) {
+            str.reserve(length);
+        }
+
+        static codeunit_type* append_space(mutable_strptr_type& str, size_t length) {
+            return str.append_space(length);
+        }
+
+        static void shrink_space(mutable_strptr_type& str, size_t length) {
+            str.shrink_space(length);
+        }
+
+        static codeunit_output_iterator_type output_iterator(mutable_strptr_type& str) {
+            return std::back_inserter(str);
+        }
+
+        static size_t size(const mutable_strptr_type& str) {
+            return str.size();
+        }
+
+        static codeunit_iterator_type codeunit_begin(const mutable_strptr_type& str) {
+            return str.get() ? str.get()->begin() : 0;
+        }
+
+        static codeunit_iterator_type codeunit_end(const mutable_strptr_type& str) {
+            return str.get() ? str.get()->end() : 0;
+        }
+
+        static void check_and_initialize(mutable_strptr_type&) {
+
+        }
+    };
+};
+
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,266 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/ustr/detail/incl.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * String of code units read from a file or a region of a file through a
+ * read-only memory mapping, so that even a multi-GB file becomes a string
+ * without being copied or taking any heap memory. The file is unmapped
+ * when the string is destroyed. Requires POSIX mmap().
+ *
+ * The string behaves as a std::basic_string for the default string traits,
+ * which share it read-only:
+ *
+ *   typedef unicode_string_adapter<
+ *       util::mapped_string<char> >        mapped_u8_string;
+ *
+ *   mapped_u8_string log = mapped_u8_string::from_ptr(
+ *       new util::mapped_string<char>("app.log"));
+ *
+ * Strings can also be built by appending code units, in which case they
+ * live on the heap like any other string; so does a copy of a string, and
+ * a mapped string being written to is first copied to the heap.
+ */
+template <typename CharT>
+class mapped_string {
+  public:
+    typedef CharT                       value_type;
+    typedef const CharT*                const_iterator;
+    typedef const CharT*                iterator;
+    typedef CharT&                      reference;
+    typedef const CharT&                const_reference;
+    typedef size_t                      size_type;
+    typedef ptrdiff_t                   difference_type;
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    /*
+     * Expected access pattern of a mapped string, e.g. sequential_access
+     * for a single pass such as validation, letting the system read ahead.
+     */
+    enum access_advice {
+        normal_access = MADV_NORMAL,
+        sequential_access = MADV_SEQUENTIAL,
+        random_access = MADV_RANDOM
+    };
+
+    mapped_string() :
+        _mapping(0), _mapping_size(0), _data(0), _size(0)
+    { }
+
+    /*
+     * Maps length bytes of the file at path starting from offset, or up to
+     * the end of the file, rounded down to whole code units. Throws
+     * std::runtime_error if the file cannot be opened or mapped.
+     */
+    explicit mapped_string(const std::string& path, size_t offset = 0, size_t length = npos) :
+        _mapping(0), _mapping_size(0), _data(0), _size(0)
+    {
+        map(path, offset, length);
+    }
+
+    template <typename Iterator>
+    mapped_string(Iterator begin, Iterator end) :
+        _heap(begin, end), _mapping(0), _mapping_size(0), _data(0), _size(0)
+    { }
+
+    mapped_string(const mapped_string& other) :
+        _heap(other.begin(), other.end()), _mapping(0), _mapping_size(0), _data(0), _size(0)
+    { }
+
+    ~mapped_string() {
+        unmap();
+    }
+
+    mapped_string& operator =(mapped_string other) {
+        swap(other);
+        return *this;
+    }
+
+    void swap(mapped_string& other) {
+        _heap.swap(other._heap);
+        std::swap(_mapping, other._mapping);
+        std::swap(_mapping_size, other._mapping_size);
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+    }
+
+    const_iterator begin() const {
+        return data();
+    }
+
+    const_iterator end() const {
+        return data() + size();
+    }
+
+    const CharT* data() const {
+        return is_mapped() ? _data : _heap.data();
+    }
+
+    size_t size() const {
+        return is_mapped() ? _size : _heap.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const_reference operator [](size_t n) const {
+        return data()[n];
+    }
+
+    bool is_mapped() const {
+        return _mapping != 0;
+    }
+
+    /*
+     * Tells the system how the mapped code units are going to be read. Has
+     * no effect on strings on the heap.
+     */
+    void advise(access_advice advice) const {
+        if(is_mapped()) {
+            ::madvise(_mapping, _mapping_size, advice);
+        }
+    }
+
+    /*
+     * Write access, as for a std::basic_string, moving the code units to
+     * the heap first if they are mapped.
+     */
+    reference operator [](size_t n) {
+        unshare();
+        return _heap[n];
+    }
+
+    void push_back(const_reference codeunit) {
+        unshare();
+        _heap.push_back(codeunit);
+    }
+
+    template <typename Iterator>
+    void insert(const_iterator position, Iterator begin, Iterator end) {
+        size_t index = position - this->begin();
+
+        unshare();
+        _heap.insert(_heap.begin() + index, begin, end);
+    }
+
+    void resize(size_t size) {
+        unshare();
+        _heap.resize(size);
+    }
+
+    void reserve(size_t size) {
+        unshare();
+        _heap.reserve(size);
+    }
+
+    size_t capacity() const {
+        return is_mapped() ? _size : _heap.capacity();
+    }
+
+  private:
+    void map(const std::string& path, size_t offset, size_t length) {
+        int file = ::open(path.c_str(), O_RDONLY);
+
+        if(file < 0) {
+            throw std::runtime_error("mapped_string: cannot open " + path);
+        }
+
+        struct stat status;
+
+        if(::fstat(file, &status) != 0) {
+            ::close(file);
+            throw std::runtime_error("mapped_string: cannot stat " + path);
+        }
+
+        size_t file_size = static_cast<size_t>(status.st_size);
+        offset = (std::min)(offset, file_size);
+        length = (std::min)(length, file_size - offset);
+        length -= length % sizeof(CharT);
+
+        // an empty region is an empty string, as there is nothing to map
+        if(length != 0) {
+            size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            size_t page_offset = offset % page_size;
+
+            void* mapping = ::mmap(0, page_offset + length,
+                PROT_READ, MAP_PRIVATE, file, offset - page_offset);
+
+            if(mapping == MAP_FAILED) {
+                ::close(file);
+                throw std::runtime_error("mapped_string: cannot map " + path);
+            }
+
+            _mapping = mapping;
+            _mapping_size = page_offset + length;
+            _data = reinterpret_cast<const CharT*>(static_cast<const char*>(mapping) + page_offset);
+            _size = length / sizeof(CharT);
+        }
+
+        ::close(file);
+    }
+
+    void unmap() {
+        if(_mapping) {
+            ::munmap(_mapping, _mapping_size);
+
+            _mapping = 0;
+            _mapping_size = 0;
+            _data = 0;
+            _size = 0;
+        }
+    }
+
+    // moves the mapped code units to the heap, to be written to
+    void unshare() {
+        if(is_mapped()) {
+            _heap.assign(_data, _data + _size);
+            unmap();
+        }
+    }
+
+    std::basic_string<CharT> _heap;
+    void* _mapping;
+    size_t _mapping_size;
+    const CharT* _data;
+    size_t _size;
+};
+
+template <typename CharT>
+bool operator ==(const mapped_string<CharT>& str1, const mapped_string<CharT>& str2) {
+    return str1.size() == str2.size() && std::equal(str1.begin(), str1.end(), str2.begin());
+}
+
+template <typename CharT>
+bool operator !=(const mapped_string<CharT>& str1, const mapped_string<CharT>& str2) {
+    return !(str1 == str2);
+}
+
+template <typename CharT>
+std::ostream& operator <<(std::ostream& out, const mapped_string<CharT>& str) {
+    return out << std::basic_string<CharT>(str.begin(), str.end());
+}
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,255 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include <boost/type_traits.hpp>
+#include <boost/ustr/detail/incl.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Monotonic arena, handing out memory from large blocks by bumping a
+ * pointer. Memory is never given back one allocation at a time; reset()
+ * gives back everything allocated so far at once, keeping the last block
+ * for reuse, and the destructor frees all blocks.
+ *
+ * An arena is used by one thread at a time. The arena made current on a
+ * thread by a monotonic_arena::scope is the one arena_allocator objects
+ * made on that thread allocate from.
+ */
+class monotonic_arena {
+  public:
+    static const size_t default_block_size = 64 * 1024;
+
+    explicit monotonic_arena(size_t block_size = default_block_size) :
+        _blocks(0), _current(0), _end(0), _block_size(block_size), _allocated(0)
+    { }
+
+    ~monotonic_arena() {
+        free_blocks(0);
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        char* memory = align(_current, alignment);
+
+        if(!_blocks || memory > _end || static_cast<size_t>(_end - memory) < size) {
+            add_block(size + alignment);
+            memory = align(_current, alignment);
+        }
+
+        _current = memory + size;
+        _allocated += size;
+        return memory;
+    }
+
+    /*
+     * Gives back all memory allocated from the arena. Every object still
+     * living in it must be gone, or at least never be used again.
+     */
+    void reset() {
+        if(_blocks) {
+            free_blocks(_blocks);
+            _current = _blocks->memory();
+        }
+
+        _allocated = 0;
+    }
+
+    /*
+     * The number of bytes allocated since the last reset.
+     */
+    size_t allocated() const {
+        return _allocated;
+    }
+
+    /*
+     * The arena current on this thread, or NULL if there is none.
+     */
+    static monotonic_arena* current() {
+        return current_arena();
+    }
+
+    /*
+     * Makes an arena current on this thread for the lifetime of the scope,
+     * and the previously current one again afterwards.
+     */
+    class scope {
+      public:
+        explicit scope(monotonic_arena& arena) :
+            _previous(current_arena())
+        {
+            current_arena() = &arena;
+        }
+
+        ~scope() {
+            current_arena() = _previous;
+        }
+
+      private:
+        scope(const scope&);
+        scope& operator =(const scope&);
+
+        monotonic_arena* _previous;
+    };
+
+  private:
+    struct block {
+        block* next;
+        size_t size;
+
+        char* memory() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    static monotonic_arena*& current_arena() {
+        static BOOST_USTR_THREAD_LOCAL monotonic_arena* arena = 0;
+        return arena;
+    }
+
+    static char* align(char* memory, size_t alignment) {
+        size_t misalignment = reinterpret_cast<size_t>(memory) % alignment;
+        return misalignment ? memory + alignment - misalignment : memory;
+    }
+
+    void add_block(size_t size) {
+        size = (std::max)(size, _block_size);
+
+        block* new_block = static_cast<block*>(::operator new(sizeof(block) + size));
+        new_block->next = _blocks;
+        new_block->size = size;
+
+        _blocks = new_block;
+        _current = new_block->memory();
+        _end = _current + size;
+    }
+
+    // frees the blocks after last, or all blocks if last is NULL
+    void free_blocks(block* last) {
+        block* current = last ? last->next : _blocks;
+
+        while(current) {
+            block* next = current->next;
+            ::operator delete(current);
+            current = next;
+        }
+
+        if(last) {
+            last->next = 0;
+        } else {
+            _blocks = 0;
+        }
+    }
+
+    monotonic_arena(const monotonic_arena&);
+    monotonic_arena& operator =(const monotonic_arena&);
+
+    block* _blocks;
+    char* _current;
+    char* _end;
+    size_t _block_size;
+    size_t _allocated;
+};
+
+/*
+ * Standard allocator over the monotonic_arena current on the thread it is
+ * constructed on, and over the heap if there is none. Copies allocate from
+ * the same arena as the original, wherever they are made, and
+ * deallocation is a no-op for arena memory.
+ */
+template <typename T>
+class arena_allocator {
+  public:
+    typedef T                   value_type;
+    typedef T*                  pointer;
+    typedef const T*            const_pointer;
+    typedef T&                  reference;
+    typedef const T&            const_reference;
+    typedef size_t              size_type;
+    typedef ptrdiff_t           difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef arena_allocator<U>  other;
+    };
+
+    arena_allocator() :
+        _arena(monotonic_arena::current())
+    { }
+
+    explicit arena_allocator(monotonic_arena* arena) :
+        _arena(arena)
+    { }
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) :
+        _arena(other.arena())
+    { }
+
+    pointer allocate(size_type n, const void* = 0) {
+        if(_arena) {
+            return static_cast<pointer>(
+                _arena->allocate(n * sizeof(T), boost::alignment_of<T>::value));
+        } else {
+            return static_cast<pointer>(::operator new(n * sizeof(T)));
+        }
+    }
+
+    void deallocate(pointer p, size_type) {
+        if(!_arena) {
+            ::operator delete(p);
+        }
+    }
+
+    size_type max_size() const {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    pointer address(reference value) const {
+        return &value;
+    }
+
+    const_pointer address(const_reference value) const {
+        return &value;
+    }
+
+    void construct(pointer p, const T& value) {
+        new (p) T(value);
+    }
+
+    void destroy(pointer p) {
+        p->~T();
+    }
+
+    /*
+     * The arena allocated from, or NULL for the heap.
+     */
+    monotonic_arena* arena() const {
+        return _arena;
+    }
+
+  private:
+    monotonic_arena* _arena;
+};
+
+template <typename T, typename U>
+bool operator ==(const arena_allocator<T>& alloc1, const arena_allocator<U>& alloc2) {
+    return alloc1.arena() == alloc2.arena();
+}
+
+template <typename T, typename U>
+bool operator !=(const arena_allocator<T>& alloc1, const arena_allocator<U>& alloc2) {
+    return alloc1.arena() != alloc2.arena();
+}
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
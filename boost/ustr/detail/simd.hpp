@@ -0,0 +1,33 @@
+
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/ustr/detail/incl.hpp>
+
+/*
+ * Instruction set selection for the vectorized code unit kernels.
+ *
+ * The kernels are header only, so the instruction set is chosen at compile
+ * time from the target flags of the translation unit (e.g. -msse4.2 or
+ * -mavx2 on GCC and Clang, /arch:AVX2 on Visual C++). Every kernel has a
+ * portable scalar implementation that is used when no supported instruction
+ * set is available. Define BOOST_USTR_NO_SIMD to force the scalar kernels.
+ */
+#ifndef BOOST_USTR_NO_SIMD
+#   if defined(__AVX2__)
+#       define BOOST_USTR_SIMD_AVX2
+#   endif
+#   if defined(__SSE4_2__) || defined(__AVX__)
+#       define BOOST_USTR_SIMD_SSE42
+#   endif
+#endif
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+#   include <immintrin.h>
+#elif defined(BOOST_USTR_SIMD_SSE42)
+#   include <nmmintrin.h>
+#endif
@@ -0,0 +1,267 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <iterator>
+#include <algorithm>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
+#include <boost/ustr/detail/intrusive_string.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * String value keeping up to InlineLength code units inside the object
+ * itself, and longer content in a reference counted intrusive_string
+ * shared by its copies. Short strings thus never touch the heap, and
+ * copying a long string only increments a reference count.
+ *
+ * Strings may be appended to, reserved and shrunk, which the string traits
+ * only do to a string that has not been copied yet, as a builder buffer.
+ * Content moves to the heap once it no longer fits inline, or once more
+ * room is reserved, and back inline if it is shrunk to fit again. Which
+ * of the two holds the content is kept in the top bit of the size.
+ */
+template <typename CharT, size_t InlineLength = 24 / sizeof(CharT)>
+class small_string {
+  public:
+    typedef CharT                       value_type;
+    typedef const CharT*                const_iterator;
+    typedef const CharT*                iterator;
+    typedef const CharT&                const_reference;
+    typedef size_t                      size_type;
+    typedef ptrdiff_t                   difference_type;
+
+    static const size_t inline_length = InlineLength;
+
+    small_string() :
+        _size(0)
+    { }
+
+    template <typename Iterator>
+    small_string(Iterator begin, Iterator end) :
+        _size(0)
+    {
+        append(begin, end);
+    }
+
+    small_string(const small_string& other) :
+        _size(other._size)
+    {
+        if(other.is_inline()) {
+            std::copy(other._units, other._units + other.size(), _units);
+        } else {
+            _heap = other._heap;
+            intrusive_ptr_add_ref(_heap);
+        }
+    }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    small_string(small_string&& other) :
+        _size(0)
+    {
+        swap(other);
+    }
+#endif
+
+    ~small_string() {
+        if(!is_inline()) {
+            intrusive_ptr_release(_heap);
+        }
+    }
+
+    small_string& operator =(small_string other) {
+        swap(other);
+        return *this;
+    }
+
+    void swap(small_string& other) {
+        small_string temp;
+        temp.take(other);
+        other.take(*this);
+        take(temp);
+    }
+
+    const_iterator begin() const {
+        return data();
+    }
+
+    const_iterator end() const {
+        return data() + size();
+    }
+
+    const CharT* data() const {
+        return is_inline() ? _units : _heap->data();
+    }
+
+    size_t size() const {
+        return _size & ~heap_flag;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool is_inline() const {
+        return (_size & heap_flag) == 0;
+    }
+
+    /*
+     * The metadata of the shared heap string, or NULL for inline content,
+     * which is short enough to be counted and hashed on demand.
+     */
+    buffer_metadata* metadata() const {
+        return is_inline() ? 0 : &_heap->metadata();
+    }
+
+    void reserve(size_t length) {
+        size_t size = this->size() + length;
+
+        if(size > InlineLength) {
+            reserve_heap(size);
+        }
+    }
+
+    void push_back(const_reference codeunit) {
+        *append_space(1) = codeunit;
+    }
+
+    /*
+     * Extends the string by length code units and returns a pointer to the
+     * first of them.
+     */
+    CharT* append_space(size_t length) {
+        size_t size = this->size() + length;
+        reserve(length);
+        set_size(size);
+
+        return const_cast<CharT*>(data()) + size - length;
+    }
+
+    /*
+     * Removes the last length code units, moving the content back inline
+     * once it fits.
+     */
+    void shrink_space(size_t length) {
+        size_t size = this->size() - length;
+
+        if(!is_inline() && size <= InlineLength) {
+            intrusive_string<CharT>* heap = _heap;
+            std::copy(heap->data(), heap->data() + size, _units);
+            intrusive_ptr_release(heap);
+            _size = size;
+        } else {
+            set_size(size);
+        }
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end) {
+        append(begin, end, typename std::iterator_traits<Iterator>::iterator_category());
+    }
+
+  private:
+    static const size_t heap_flag = ~(static_cast<size_t>(-1) >> 1);
+
+    void set_size(size_t size) {
+        if(is_inline()) {
+            _size = size;
+        } else {
+            _heap->resize(size);
+            _size = size | heap_flag;
+        }
+    }
+
+    // moves the content to a heap string with room for capacity code units,
+    // growing an existing heap string at least geometrically
+    void reserve_heap(size_t capacity) {
+        size_t size = this->size();
+
+        if(is_inline()) {
+            intrusive_string<CharT>* heap = intrusive_string<CharT>::create(
+                (std::max)(capacity, 2 * InlineLength));
+            std::copy(_units, _units + size, heap->data());
+            heap->resize(size);
+
+            _heap = heap;
+            _size = size | heap_flag;
+        } else if(_heap->capacity() < capacity) {
+            intrusive_string<CharT>* heap = intrusive_string<CharT>::create(
+                (std::max)(capacity, 2 * _heap->capacity()));
+            std::copy(_heap->begin(), _heap->end(), heap->data());
+            heap->resize(size);
+
+            intrusive_ptr_release(_heap);
+            _heap = heap;
+        }
+    }
+
+    // moves the content of other, which is left empty, into this string,
+    // which must be empty
+    void take(small_string& other) {
+        if(other.is_inline()) {
+            std::copy(other._units, other._units + other.size(), _units);
+        } else {
+            _heap = other._heap;
+        }
+
+        _size = other._size;
+        other._size = 0;
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end, std::input_iterator_tag) {
+        for(; begin != end; ++begin) {
+            push_back(*begin);
+        }
+    }
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end, std::forward_iterator_tag) {
+        size_t length = std::distance(begin, end);
+
+        if(length != 0) {
+            std::copy(begin, end, append_space(length));
+        }
+    }
+
+    size_t _size;
+
+    union {
+        CharT _units[InlineLength];
+        intrusive_string<CharT>* _heap;
+    };
+};
+
+template <typename CharT, size_t InlineLength>
+bool operator ==(
+    const small_string<CharT, InlineLength>& str1,
+    const small_string<CharT, InlineLength>& str2)
+{
+    return str1.size() == str2.size() && std::equal(str1.begin(), str1.end(), str2.begin());
+}
+
+template <typename CharT, size_t InlineLength>
+bool operator !=(
+    const small_string<CharT, InlineLength>& str1,
+    const small_string<CharT, InlineLength>& str2)
+{
+    return !(str1 == str2);
+}
+
+template <typename CharT, size_t InlineLength>
+std::ostream& operator <<(std::ostream& out, const small_string<CharT, InlineLength>& str) {
+    return out << std::basic_string<CharT>(str.begin(), str.end());
+}
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
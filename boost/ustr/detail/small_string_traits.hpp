@@ -0,0 +1,181 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <iterator>
+#include <algorithm>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
+#include <boost/ustr/detail/small_string.hpp>
+
+namespace boost {
+namespace ustr {
+
+/*
+ * String traits over util::small_string, held by value like in
+ * alt_string_traits. Strings of up to InlineLength code units live inside
+ * the adapter itself, so creating, copying and building them never
+ * allocates; longer strings are shared on the heap like with the default
+ * string traits, and keep their metadata there.
+ *
+ *   typedef unicode_string_adapter<
+ *       util::small_string<char>,
+ *       small_string_traits<char> >         small_u8_string;
+ */
+template <typename CharT, size_t InlineLength = 24 / sizeof(CharT)>
+class small_string_traits {
+  public:
+    typedef small_string_traits<
+        CharT, InlineLength>                        this_traits;
+    typedef util::small_string<
+        CharT, InlineLength>                        string_type;
+
+    typedef CharT                                   codeunit_type;
+
+    static const size_t codeunit_size = sizeof(codeunit_type);
+
+    typedef string_type                             raw_strptr_type;
+    typedef const string_type*                      const_raw_strptr_type;
+
+    typedef string_type                             const_strptr_type;
+    typedef string_type                             mutable_strptr_type;
+
+    typedef const codeunit_type*                    codeunit_iterator_type;
+    typedef
+        std::back_insert_iterator<string_type>      codeunit_output_iterator_type;
+
+    typedef typename util::get_raw_char_type<
+        codeunit_type>::type                        raw_char_type;
+    typedef std::basic_string<raw_char_type>        raw_string_type;
+
+    /*
+     * Copies of a string share its heap content, so a new string copies
+     * the code units instead, leaving it free to be written to.
+     */
+    static raw_strptr_type new_string(const string_type& str) {
+        return string_type(str.begin(), str.end());
+    }
+
+    static raw_strptr_type new_string() {
+        return string_type();
+    }
+
+    static raw_strptr_type clone_string(const raw_strptr_type& str) {
+        return new_string(str);
+    }
+
+    struct string {
+      public:
+        static bool equals(const string_type& str1, const string_type& str2) {
+            return str1 == str2;
+        }
+
+        template <typename Iterator>
+        static string_type from_iter(Iterator begin, Iterator end) {
+            return string_type(begin, end);
+        }
+    };
+
+    struct raw_strptr {
+      public:
+        static bool equals(const raw_strptr_type& str1, const raw_strptr_type& str2) {
+            return str1 == str2;
+        }
+
+        static void delete_string(raw_strptr_type&) {
+
+        }
+    };
+
+    struct const_strptr {
+        static const_raw_strptr_type get(const const_strptr_type& str) {
+            return &str;
+        }
+
+        static codeunit_iterator_type
+        codeunit_begin(const const_strptr_type& str) {
+            return str.begin();
+        }
+
+        static codeunit_iterator_type
+        codeunit_end(const const_strptr_type& str) {
+            return str.end();
+        }
+
+        static bool equals(const const_strptr_type& str1, const const_strptr_type& str2) {
+            return str1 == str2;
+        }
+
+        static void reset(const_strptr_type& str, raw_strptr_type new_str) {
+            str.swap(new_str);
+        }
+
+        /*
+         * Only strings on the heap have metadata to share.
+         */
+        static util::buffer_metadata* metadata(const const_strptr_type& str) {
+            return str.metadata();
+        }
+    };
+
+    struct mutable_strptr {
+        static raw_strptr_type release(mutable_strptr_type& str) {
+            string_type released;
+            released.swap(str);
+            return released;
+        }
+
+        static const raw_strptr_type& get(mutable_strptr_type& str) {
+            return str;
+        }
+
+        static void append(mutable_strptr_type& str, codeunit_type codeunit) {
+            str.push_back(codeunit);
+        }
+
+        template <typename CodeunitIterator>
+        static void append(mutable_strptr_type& str, CodeunitIterator begin, CodeunitIterator end) {
+            str.append(begin, end);
+        }
+
+        static void check_and_initialize(mutable_strptr_type&) {
+
+        }
+
+        static void reserve_space(mutable_strptr_type& str, size_t length) {
+            str.reserve(length);
+        }
+
+        static codeunit_type* append_space(mutable_strptr_type& str, size_t length) {
+            return str.append_space(length);
+        }
+
+        static void shrink_space(mutable_strptr_type& str, size_t length) {
+            str.shrink_space(length);
+        }
+
+        static codeunit_output_iterator_type output_iterator(mutable_strptr_type& str) {
+            return std::back_inserter(str);
+        }
+
+        static size_t size(const mutable_strptr_type& str) {
+            return str.size();
+        }
+
+        static codeunit_iterator_type codeunit_begin(const mutable_strptr_type& str) {
+            return str.begin();
+        }
+
+        static codeunit_iterator_type codeunit_end(const mutable_strptr_type& str) {
+            return str.end();
+        }
+    };
+};
+
+} // namespace ustr
+} // namespace boost
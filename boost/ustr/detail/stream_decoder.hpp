@@ -0,0 +1,221 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <iterator>
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/ustr/policy.hpp>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
+#include <boost/ustr/detail/encoding_traits.hpp>
+
+namespace boost {
+namespace ustr {
+
+/*
+ * Decoder of code units arriving in chunks, such as reads from a socket or
+ * a file, that may cut a code point anywhere. The code units of a code
+ * point cut short by the end of a chunk are kept until the next chunk
+ * completes them, so that decoding a stream chunk by chunk gives the same
+ * code points as decoding it whole, in constant memory.
+ *
+ *   stream_decoder<char> decoder;
+ *   u16_string::mutable_adapter_type builder;
+ *
+ *   while(size_t size = read(socket, chunk, sizeof(chunk))) {
+ *       decoder.decode(chunk, chunk + size, builder);
+ *   }
+ *   decoder.finish(builder);
+ *
+ * Malformed code units are replaced or rejected by Policy as they would be
+ * by the adapters. A code point still incomplete at the end of the stream
+ * is malformed, and is only reported by finish().
+ */
+template <
+    typename CodeunitT,
+    typename EncoderTraits = typename util::encoding_engine<
+        sizeof(CodeunitT)>::type,
+    typename Policy = replace_policy<0xFFFD> >
+class stream_decoder {
+  public:
+    typedef CodeunitT                                   codeunit_type;
+    typedef EncoderTraits                               encoder;
+    typedef Policy                                      policy;
+
+    // encoding of the chunks, which are read through plain pointers
+    typedef utf_encoding_traits<
+        util::pointer_range_traits<codeunit_type>,
+        encoder, policy>                                encoding_traits;
+
+    stream_decoder() :
+        _partial_length(0)
+    { }
+
+    /*
+     * Decodes the code points of a chunk to out, and returns out past them.
+     */
+    template <typename OutputIterator>
+    OutputIterator decode(const codeunit_type* begin, const codeunit_type* end, OutputIterator out) {
+        out = resume(begin, end, out);
+        return decode_codepoints(begin, end, out, static_cast<size_t>(-1));
+    }
+
+    /*
+     * Appends the code points of a chunk to builder. Chunks that are well
+     * formed up to the code point they may cut short are validated and
+     * converted in bulk, the others are decoded code point by code point.
+     */
+    template <typename StringT, typename StringTraits, typename EncoderTraits_, typename Policy_>
+    void decode(const codeunit_type* begin, const codeunit_type* end,
+        unicode_string_adapter_builder<
+            StringT, StringTraits, EncoderTraits_, Policy_>& builder)
+    {
+        resume(begin, end, std::back_inserter(builder));
+
+        if(begin == end) {
+            return;
+        }
+
+        const codeunit_type* cut = begin;
+        size_t length = 0;
+
+        if(encoding_traits::validate_prefix(cut, end, length)) {
+            builder.template append_transcoded<encoding_traits>(begin, cut, length);
+            keep(cut, end);
+            return;
+        }
+
+        codepoint_type codepoints[block_size];
+
+        while(begin != end) {
+            codepoint_type* last = decode_codepoints(begin, end, codepoints, block_size);
+            builder.append_codepoints(codepoints, last);
+        }
+    }
+
+    /*
+     * Ends the stream, decoding to out the code point cut short at its end
+     * if there is one. The decoder can then decode another stream.
+     */
+    template <typename OutputIterator>
+    OutputIterator finish(OutputIterator out) {
+        if(_partial_length != 0) {
+            size_t length = _partial_length;
+
+            _partial_length = 0;
+            *out++ = resolve_decode_result(
+                decode_result(decode_incomplete, 0, length), Policy());
+        }
+        return out;
+    }
+
+    template <typename StringT, typename StringTraits, typename EncoderTraits_, typename Policy_>
+    void finish(unicode_string_adapter_builder<
+        StringT, StringTraits, EncoderTraits_, Policy_>& builder)
+    {
+        finish(std::back_inserter(builder));
+    }
+
+    /*
+     * Number of code units kept from the previous chunks, which begin
+     * a code point that is not complete yet.
+     */
+    size_t pending() const {
+        return _partial_length;
+    }
+
+    /*
+     * Drops the kept code units, to decode another stream.
+     */
+    void reset() {
+        _partial_length = 0;
+    }
+
+  private:
+    static const size_t max_codeunit_length = util::encoder_kernel<encoder>::max_codeunit_length;
+    static const size_t block_size = 256;
+
+    // whether a code point can be cut short at all, which it cannot
+    // in encodings of one code unit per code point such as UTF-32
+    typedef boost::integral_constant<bool,
+        (max_codeunit_length > 1)>                      may_cut_codepoints;
+
+    template <typename OutputIterator>
+    OutputIterator resume(const codeunit_type*& begin, const codeunit_type* end, OutputIterator out) {
+        return resume(begin, end, out, may_cut_codepoints());
+    }
+
+    // nothing is ever kept, see keep()
+    template <typename OutputIterator>
+    OutputIterator resume(const codeunit_type*&, const codeunit_type*, OutputIterator out,
+            boost::false_type)
+    {
+        return out;
+    }
+
+    // completes the kept code point with the first code units of the chunk,
+    // moving begin past them. try_decode() reads the code units of a code
+    // point until it can tell whether it is complete, so the kept code
+    // units are all used up as soon as it stops asking for more.
+    template <typename OutputIterator>
+    OutputIterator resume(const codeunit_type*& begin, const codeunit_type* end, OutputIterator out,
+            boost::true_type)
+    {
+        while(_partial_length != 0 && begin != end) {
+            _partial[_partial_length++] = *begin++;
+
+            const codeunit_type* current = _partial;
+            const codeunit_type* partial_end = _partial + _partial_length;
+            decode_result result = encoder::try_decode(current, partial_end);
+
+            if(result.status != decode_incomplete) {
+                BOOST_ASSERT(current == partial_end);
+
+                _partial_length = 0;
+                *out++ = resolve_decode_result(result, Policy());
+            }
+        }
+        return out;
+    }
+
+    // decodes at most limit code points to out, keeping the code units of
+    // a code point cut short by the end of the chunk
+    template <typename OutputIterator>
+    OutputIterator decode_codepoints(const codeunit_type*& begin, const codeunit_type* end,
+            OutputIterator out, size_t limit)
+    {
+        for(; begin != end && limit != 0; --limit) {
+            const codeunit_type* current = begin;
+            decode_result result = encoder::try_decode(current, end);
+
+            if(result.status == decode_incomplete) {
+                keep(begin, end);
+                begin = end;
+                break;
+            }
+
+            *out++ = resolve_decode_result(result, Policy());
+            begin = current;
+        }
+        return out;
+    }
+
+    void keep(const codeunit_type* begin, const codeunit_type* end) {
+        BOOST_ASSERT(static_cast<size_t>(end - begin) < max_codeunit_length);
+
+        _partial_length = std::copy(begin, end, _partial) - _partial;
+    }
+
+    codeunit_type _partial[max_codeunit_length];
+    size_t _partial_length;
+};
+
+} // namespace ustr
+} // namespace boost
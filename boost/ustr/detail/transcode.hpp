@@ -0,0 +1,186 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/ascii.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
+#include <boost/ustr/detail/encoding_traits.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Conversion of well formed code units from the encoding of SourceTraits
+ * to the encoding of TargetTraits, both being utf_encoding_traits.
+ *
+ * The strategy is chosen at compile time:
+ *
+ *  - strings of the same encoder and code unit size are copied code unit
+ *    by code unit without decoding,
+ *  - contiguous strings of encoder pairs with a transcode_kernel are sized
+ *    up front and converted by the kernel,
+ *  - contiguous sources of ASCII compatible encodings copy ASCII runs
+ *    verbatim and only decode the remaining code points,
+ *  - everything else is decoded and re-encoded code point by code point.
+ */
+template <typename SourceTraits, typename TargetTraits>
+class transcoder {
+  public:
+    typedef typename
+        SourceTraits::codeunit_type                     source_codeunit_type;
+    typedef typename
+        TargetTraits::codeunit_type                     target_codeunit_type;
+    typedef typename
+        TargetTraits::mutable_strptr_type               mutable_strptr_type;
+
+    typedef typename SourceTraits::encoder              source_encoder;
+    typedef typename TargetTraits::encoder              target_encoder;
+
+    typedef typename
+        TargetTraits::string_traits::mutable_strptr     target_strptr;
+
+    /*
+     * The source iterator is usually the code unit iterator of SourceTraits,
+     * but may also be a raw pointer into code units of the source encoding.
+     */
+    template <typename SourceIterator>
+    static void append(SourceIterator begin, SourceIterator end, mutable_strptr_type& str) {
+        target_strptr::check_and_initialize(str);
+        append(begin, end, str, typename strategy<SourceIterator>::type());
+    }
+
+  private:
+    class copy_codeunits { };
+    class convert_codeunits { };
+    class copy_ascii_runs { };
+    class decode_codepoints { };
+
+    template <typename SourceIterator>
+    class strategy {
+      private:
+        static const bool source_kernel =
+            is_contiguous_range<typename SourceTraits::string_type, SourceIterator>::value &&
+            encoder_kernel<source_encoder>::available;
+
+        static const bool same_encoding =
+            boost::is_same<source_encoder, target_encoder>::value &&
+            sizeof(source_codeunit_type) == sizeof(target_codeunit_type);
+
+        static const bool kernel_conversion =
+            source_kernel &&
+            TargetTraits::has_kernel::value &&
+            transcode_kernel<source_encoder, target_encoder>::available;
+
+        static const bool ascii_runs =
+            source_kernel &&
+            encoder_kernel<source_encoder>::ascii_compatible &&
+            encoder_kernel<target_encoder>::ascii_compatible;
+
+      public:
+        typedef typename boost::mpl::if_c<same_encoding, copy_codeunits,
+            typename boost::mpl::if_c<kernel_conversion, convert_codeunits,
+            typename boost::mpl::if_c<ascii_runs, copy_ascii_runs,
+                decode_codepoints>::type>::type>::type  type;
+    };
+
+  public:
+    /*
+     * Whether append() allocates the exact space for the result by itself,
+     * by copying the source range in one go or by measuring the result
+     * with the transcode kernel before converting.
+     */
+    template <typename SourceIterator>
+    class exact_length {
+      private:
+        typedef typename strategy<SourceIterator>::type     type;
+
+      public:
+        static const bool value =
+            boost::is_same<type, copy_codeunits>::value ||
+            boost::is_same<type, convert_codeunits>::value;
+    };
+
+  private:
+    template <typename SourceIterator>
+    static void append(SourceIterator begin, SourceIterator end,
+            mutable_strptr_type& str, copy_codeunits)
+    {
+        target_strptr::append(str, begin, end);
+    }
+
+    template <typename SourceIterator>
+    static void append(SourceIterator begin, SourceIterator end,
+            mutable_strptr_type& str, convert_codeunits)
+    {
+        typedef transcode_kernel<source_encoder, target_encoder> kernel;
+
+        if(begin == end) {
+            return;
+        }
+
+        const source_codeunit_type* current = to_pointer(begin);
+        const source_codeunit_type* last = current + (end - begin);
+
+        size_t length = kernel::length(current, last);
+        target_codeunit_type* out = target_strptr::append_space(str, length);
+        target_codeunit_type* out_end = out + length;
+
+        current = kernel::convert(current, last, out);
+        target_strptr::shrink_space(str, out_end - out);
+
+        // whatever the kernel left over goes through the policies
+        while(current != last) {
+            target_encoder::encode(
+                source_encoder::decode(current, last, typename SourceTraits::policy()),
+                target_strptr::output_iterator(str), typename TargetTraits::policy());
+        }
+    }
+
+    template <typename SourceIterator>
+    static void append(SourceIterator begin, SourceIterator end,
+            mutable_strptr_type& str, copy_ascii_runs)
+    {
+        if(begin == end) {
+            return;
+        }
+
+        const source_codeunit_type* current = to_pointer(begin);
+        const source_codeunit_type* last = current + (end - begin);
+
+        while(current != last) {
+            if(is_ascii_codeunit(*current)) {
+                const source_codeunit_type* run_end =
+                    encoder_kernel<source_encoder>::skip_ascii(current, last);
+                target_strptr::append(str, current, run_end);
+                current = run_end;
+            } else {
+                target_encoder::encode(
+                    source_encoder::decode(current, last, typename SourceTraits::policy()),
+                    target_strptr::output_iterator(str), typename TargetTraits::policy());
+            }
+        }
+    }
+
+    template <typename SourceIterator>
+    static void append(SourceIterator begin, SourceIterator end,
+            mutable_strptr_type& str, decode_codepoints)
+    {
+        while(begin != end) {
+            target_encoder::encode(
+                source_encoder::decode(begin, end, typename SourceTraits::policy()),
+                target_strptr::output_iterator(str), typename TargetTraits::policy());
+        }
+    }
+};
+
+} // namespace util
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,480 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <streambuf>
+#include <algorithm>
+#include <boost/static_assert.hpp>
+#include <boost/ustr/policy.hpp>
+#include <boost/ustr/string_traits.hpp>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/util.hpp>
+#include <boost/ustr/detail/transcode.hpp>
+#include <boost/ustr/detail/encoder_kernel.hpp>
+#include <boost/ustr/detail/encoding_traits.hpp>
+#include <boost/ustr/detail/stream_decoder.hpp>
+
+namespace boost {
+namespace ustr {
+namespace util {
+
+/*
+ * Converts the code units from begin to end into str, up to a code point
+ * cut short by end, and moves begin past the converted code units. Code
+ * units well formed up to the cut are converted in bulk, the others code
+ * point by code point through the policy of SourceTraits.
+ */
+template <typename SourceTraits, typename TargetTraits>
+void transcode_prefix(
+    typename SourceTraits::codeunit_iterator_type& begin,
+    typename SourceTraits::codeunit_iterator_type end,
+    typename TargetTraits::mutable_strptr_type& str)
+{
+    typedef typename SourceTraits::codeunit_iterator_type   iterator;
+
+    iterator cut = begin;
+    size_t length = 0;
+
+    if(SourceTraits::validate_prefix(cut, end, length)) {
+        transcoder<SourceTraits, TargetTraits>::append(begin, cut, str);
+        begin = cut;
+        return;
+    }
+
+    while(begin != end) {
+        iterator current = begin;
+        decode_result result = SourceTraits::encoder::try_decode(current, end);
+
+        if(result.status == decode_incomplete) {
+            break;
+        }
+
+        TargetTraits::append_codepoint(str,
+            resolve_decode_result(result, typename SourceTraits::policy()));
+        begin = current;
+    }
+}
+
+/*
+ * Code units in the other byte order.
+ */
+inline char swap_bytes(char codeunit) {
+    return codeunit;
+}
+
+inline utf16_codeunit_type swap_bytes(utf16_codeunit_type codeunit) {
+    return static_cast<utf16_codeunit_type>((codeunit >> 8) | (codeunit << 8));
+}
+
+inline codepoint_type swap_bytes(codepoint_type codeunit) {
+    return (codeunit >> 24) | ((codeunit >> 8) & 0xFF00) |
+        ((codeunit << 8) & 0xFF0000) | (codeunit << 24);
+}
+
+template <typename CodeunitT>
+void swap_bytes(CodeunitT* begin, CodeunitT* end) {
+    for(; begin != end; ++begin) {
+        *begin = swap_bytes(*begin);
+    }
+}
+
+} // namespace util
+
+/*
+ * Stream buffer writing text to another stream buffer, the target, as code
+ * units of type CodeunitT encoded by Encoder, in the byte order of the
+ * machine or, if swap_bytes is set, in the other one. Characters written
+ * to it are UTF-8, and unicode string adapters of any encoding are
+ * converted by write() without an intermediate string:
+ *
+ *   std::ofstream file("app.log", std::ios::binary);
+ *   transcoding_sink<char> sink(file.rdbuf());
+ *   std::ostream log(&sink);
+ *
+ *   sink.write(u16_message);
+ *   log << " at " << line << std::endl;
+ *
+ * The code units are converted into a buffer of BufferSize code units,
+ * which is written to the target each time it fills up, with the bulk
+ * kernels where available; so memory stays bounded however much is
+ * written. A code point left incomplete by the characters written is kept
+ * until the next characters complete it, and is malformed if finish() or
+ * write() comes first. Malformed characters are replaced or rejected by
+ * Policy.
+ */
+template <
+    typename CodeunitT = char,
+    typename EncoderTraits = typename util::encoding_engine<
+        sizeof(CodeunitT)>::type,
+    typename Policy = replace_policy<0xFFFD>,
+    size_t BufferSize = 4096 >
+class transcoding_sink : public std::streambuf {
+  public:
+    typedef CodeunitT                                   codeunit_type;
+    typedef EncoderTraits                               encoder;
+    typedef Policy                                      policy;
+
+    typedef utf_encoding_traits<
+        string_traits< std::basic_string<codeunit_type> >,
+        encoder, policy>                                encoding_traits;
+
+    // encoding of the characters written to the stream buffer
+    typedef utf_encoding_traits<
+        util::pointer_range_traits<char>,
+        util::utf8_encoder, policy>                     char_encoding_traits;
+
+    explicit transcoding_sink(std::streambuf* target, bool swap_bytes = false) :
+        _target(target), _swap_bytes(swap_bytes),
+        _converted(new std::basic_string<codeunit_type>()), _chars(BufferSize)
+    {
+        _converted->reserve(BufferSize);
+        setp(&_chars[0], &_chars[0] + BufferSize);
+    }
+
+    /*
+     * Writes out the characters left, without throwing.
+     */
+    ~transcoding_sink() {
+        try {
+            finish();
+        } catch(...) {
+        }
+    }
+
+    /*
+     * Converts str to the target a block of code units at a time, after
+     * the characters written before. Returns false if the target could
+     * not take all of the code units.
+     */
+    template <typename StringT, typename StringTraits, typename EncoderTraits_, typename Policy_>
+    bool write(const unicode_string_adapter<
+        StringT, StringTraits, EncoderTraits_, Policy_>& str)
+    {
+        typedef typename unicode_string_adapter<StringT, StringTraits,
+            EncoderTraits_, Policy_>::encoding_traits           source_traits;
+        typedef typename source_traits::codeunit_iterator_type  iterator;
+
+        if(!convert_chars(true)) {
+            return false;
+        }
+
+        typedef util::encoder_kernel<typename source_traits::encoder>  source_kernel;
+
+        // each code unit of the source holds at most one code point, but
+        // a block must hold a whole code point of the source not to be cut
+        // down to nothing at a code point boundary
+        ptrdiff_t block_size = BufferSize /
+            util::encoder_kernel<encoder>::max_codeunit_length;
+
+        if(block_size < static_cast<ptrdiff_t>(source_kernel::max_codeunit_length)) {
+            block_size = source_kernel::max_codeunit_length;
+        }
+
+        iterator begin = str.codeunit_begin();
+        iterator end = str.codeunit_end();
+
+        while(begin != end) {
+            iterator cut = begin;
+            std::advance(cut, (std::min)(block_size, std::distance(begin, end)));
+
+            if(cut != end) {
+                cut = source_traits::incomplete_suffix(begin, cut);
+            }
+
+            util::transcoder<source_traits, encoding_traits>::append(begin, cut, _converted);
+
+            if(!flush()) {
+                return false;
+            }
+            begin = cut;
+        }
+
+        return true;
+    }
+
+    /*
+     * Writes out the characters written so far, a code point they leave
+     * incomplete included, and flushes the target.
+     */
+    bool finish() {
+        return convert_chars(true) && _target->pubsync() == 0;
+    }
+
+  protected:
+    virtual int_type overflow(int_type c) {
+        if(!convert_chars(false)) {
+            return traits_type::eof();
+        }
+
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    /*
+     * Writes out the characters written so far, except for a code point
+     * they leave incomplete, and flushes the target.
+     */
+    virtual int sync() {
+        return convert_chars(false) && _target->pubsync() == 0 ? 0 : -1;
+    }
+
+  private:
+    // the put area takes a character past the code point it may keep
+    BOOST_STATIC_ASSERT(BufferSize >=
+        2 * util::encoder_kernel<util::utf8_encoder>::max_codeunit_length);
+
+    // converts the characters in the put area to the target, keeping
+    // those of an incomplete code point at the start of the put area
+    // unless complete is set
+    bool convert_chars(bool complete) {
+        const char* begin = pbase();
+        const char* end = pptr();
+
+        util::transcode_prefix<char_encoding_traits, encoding_traits>(begin, end, _converted);
+
+        if(complete && begin != end) {
+            encoding_traits::append_codepoint(_converted, resolve_decode_result(
+                decode_result(decode_incomplete, 0, end - begin), Policy()));
+            begin = end;
+        }
+
+        size_t kept = end - begin;
+
+        std::memmove(&_chars[0], begin, kept);
+        setp(&_chars[0], &_chars[0] + BufferSize);
+        pbump(static_cast<int>(kept));
+
+        return flush();
+    }
+
+    // writes the converted code units to the target
+    bool flush() {
+        if(_swap_bytes && !_converted->empty()) {
+            util::swap_bytes(&(*_converted)[0], &(*_converted)[0] + _converted->size());
+        }
+
+        std::streamsize size = static_cast<std::streamsize>(
+            _converted->size() * sizeof(codeunit_type));
+        bool written = size == 0 ||
+            _target->sputn(reinterpret_cast<const char*>(_converted->data()), size) == size;
+
+        _converted->clear();
+        return written;
+    }
+
+    transcoding_sink(const transcoding_sink&);
+    transcoding_sink& operator =(const transcoding_sink&);
+
+    std::streambuf* _target;
+    bool _swap_bytes;
+    typename encoding_traits::mutable_strptr_type _converted;
+    std::vector<char> _chars;
+};
+
+/*
+ * Stream buffer reading text from another stream buffer, the source, as
+ * code units of type CodeunitT encoded by Encoder, in the byte order of
+ * the machine or, if swap_bytes is set, in the other one. Characters read
+ * from it are UTF-8, and the rest of the source can be appended by read()
+ * to a builder of any encoding:
+ *
+ *   std::ifstream file("utf16.txt", std::ios::binary);
+ *   transcoding_source<utf16_codeunit_type> source(file.rdbuf());
+ *   std::istream text(&source);
+ *
+ *   std::getline(text, header);
+ *
+ *   u8_string::mutable_adapter_type body;
+ *   source.read(body);
+ *
+ * The source is read BufferSize code units at a time, which are converted
+ * with the bulk kernels where available, so memory stays bounded however
+ * much is read. Malformed code units, and a code point cut short by the
+ * end of the source, are replaced or rejected by Policy.
+ */
+template <
+    typename CodeunitT = char,
+    typename EncoderTraits = typename util::encoding_engine<
+        sizeof(CodeunitT)>::type,
+    typename Policy = replace_policy<0xFFFD>,
+    size_t BufferSize = 4096 >
+class transcoding_source : public std::streambuf {
+  public:
+    typedef CodeunitT                                   codeunit_type;
+    typedef EncoderTraits                               encoder;
+    typedef Policy                                      policy;
+
+    // encoding of the code units read, through plain pointers
+    typedef utf_encoding_traits<
+        util::pointer_range_traits<codeunit_type>,
+        encoder, policy>                                encoding_traits;
+
+    typedef utf_encoding_traits<
+        string_traits<std::string>,
+        util::utf8_encoder, policy>                     char_encoding_traits;
+
+    explicit transcoding_source(std::streambuf* source, bool swap_bytes = false) :
+        _source(source), _swap_bytes(swap_bytes),
+        _codeunits(BufferSize), _bytes(0), _chars(new std::string())
+    {
+        _chars->reserve(BufferSize * util::encoder_kernel<util::utf8_encoder>::max_codeunit_length);
+        setg(0, 0, 0);
+    }
+
+    /*
+     * Appends the characters left and the rest of the source to builder,
+     * converted in bulk into the encoding of the builder.
+     */
+    template <typename StringT, typename StringTraits, typename EncoderTraits_, typename Policy_>
+    void read(unicode_string_adapter_builder<
+        StringT, StringTraits, EncoderTraits_, Policy_>& builder)
+    {
+        typedef utf_encoding_traits<util::pointer_range_traits<char>,
+            util::utf8_encoder, policy>                 chars_traits;
+
+        // the characters are well formed, being converted by the stream buffer
+        const char* begin = gptr();
+        const char* end = egptr();
+
+        if(begin != end) {
+            builder.template append_transcoded<chars_traits>(begin, end,
+                chars_traits::codepoint_length(begin, end));
+            setg(0, 0, 0);
+        }
+
+        stream_decoder<codeunit_type, encoder, policy> decoder;
+
+        for(bool more = true; more; ) {
+            more = fill();
+            decoder.decode(codeunits(), codeunits() + _bytes / sizeof(codeunit_type), builder);
+            keep(codeunits() + _bytes / sizeof(codeunit_type));
+        }
+
+        decoder.finish(builder);
+        finish_bytes(std::back_inserter(builder));
+    }
+
+  protected:
+    virtual int_type underflow() {
+        while(gptr() == egptr()) {
+            _chars->clear();
+
+            bool more = fill();
+            const codeunit_type* begin = codeunits();
+            const codeunit_type* end = codeunits() + _bytes / sizeof(codeunit_type);
+
+            util::transcode_prefix<encoding_traits, char_encoding_traits>(begin, end, _chars);
+
+            if(!more) {
+                if(begin != end) {
+                    char_encoding_traits::append_codepoint(_chars, resolve_decode_result(
+                        decode_result(decode_incomplete, 0, end - begin), Policy()));
+                    begin = end;
+                }
+                keep(begin);
+                finish_bytes(codepoint_appender(_chars));
+            } else {
+                keep(begin);
+            }
+
+            char* chars = &(*_chars)[0];
+            setg(chars, chars, chars + _chars->size());
+
+            if(!more && _chars->empty()) {
+                return traits_type::eof();
+            }
+        }
+
+        return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    // the buffer takes a code unit past the code point it may keep
+    BOOST_STATIC_ASSERT(BufferSize >=
+        2 * util::encoder_kernel<encoder>::max_codeunit_length);
+
+    // appends the code points written to it to a string of characters
+    class codepoint_appender {
+      public:
+        explicit codepoint_appender(
+            typename char_encoding_traits::mutable_strptr_type& str) :
+            _str(&str)
+        { }
+
+        codepoint_appender& operator *() { return *this; }
+        codepoint_appender& operator ++() { return *this; }
+        codepoint_appender& operator ++(int) { return *this; }
+
+        codepoint_appender& operator =(codepoint_type codepoint) {
+            char_encoding_traits::append_codepoint(*_str, codepoint);
+            return *this;
+        }
+
+      private:
+        typename char_encoding_traits::mutable_strptr_type* _str;
+    };
+
+    codeunit_type* codeunits() {
+        return &_codeunits[0];
+    }
+
+    // reads from the source after the bytes kept, returning false once
+    // the source has run out
+    bool fill() {
+        char* bytes = reinterpret_cast<char*>(codeunits());
+        size_t complete = _bytes / sizeof(codeunit_type);
+        std::streamsize read = _source->sgetn(bytes + _bytes,
+            static_cast<std::streamsize>(BufferSize * sizeof(codeunit_type) - _bytes));
+
+        _bytes += static_cast<size_t>(read);
+
+        // the code units kept are in the right order already
+        if(_swap_bytes) {
+            util::swap_bytes(codeunits() + complete,
+                codeunits() + _bytes / sizeof(codeunit_type));
+        }
+        return read > 0;
+    }
+
+    // moves the bytes from the code unit at begin to the start of the buffer
+    void keep(const codeunit_type* begin) {
+        const char* first = reinterpret_cast<const char*>(begin);
+        size_t kept = reinterpret_cast<const char*>(codeunits()) + _bytes - first;
+
+        std::memmove(codeunits(), first, kept);
+        _bytes = kept;
+    }
+
+    // a code unit cut short by the end of the source is malformed
+    template <typename OutputIterator>
+    void finish_bytes(OutputIterator out) {
+        if(_bytes != 0) {
+            _bytes = 0;
+            *out++ = resolve_decode_result(
+                decode_result(decode_incomplete, 0, 0), Policy());
+        }
+    }
+
+    transcoding_source(const transcoding_source&);
+    transcoding_source& operator =(const transcoding_source&);
+
+    std::streambuf* _source;
+    bool _swap_bytes;
+    std::vector<codeunit_type> _codeunits;
+    size_t _bytes;
+    typename char_encoding_traits::mutable_strptr_type _chars;
+};
+
+} // namespace ustr
+} // namespace boost
@@ -97,22 +97,27 @@ class utf16_encoder {
 
     template <typename CodeunitInputIterator, typename Policy>
     static inline codepoint_type decode(CodeunitInputIterator& begin, const CodeunitInputIterator& end, Policy policy) {
+        return resolve_decode_result(try_decode(begin, end), policy);
+    }
+
+    template <typename CodeunitInputIterator>
+    static inline decode_result try_decode(CodeunitInputIterator& begin, const CodeunitInputIterator& end) {
         utf16_codeunit_type hi = *begin++;
         if(is_high_surrogate(hi)) {
             if(begin == end) {
-                return Policy::replace_invalid_codepoint();
+                return decode_result(decode_incomplete, 0, 1);
             }
 
             utf16_codeunit_type lo = *begin++;
             if(!is_low_surrogate(lo)) {
-                return Policy::replace_invalid_codepoint();
+                return decode_result(decode_malformed, 0, 2);
             } else {
-                return check_and_return(decode_two_codeunits(hi, lo), policy);
+                return check_range(decode_two_codeunits(hi, lo), 2);
             }
         } else if(is_low_surrogate(hi)) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_malformed, 0, 1);
         } else {
-            return static_cast<codepoint_type>(hi);
+            return decode_result(decode_success, static_cast<codepoint_type>(hi), 1);
         }
     }
 
@@ -147,6 +152,14 @@ class utf16_encoder {
             return Policy::replace_invalid_codepoint(codepoint);
         }
     }
+
+    static inline decode_result check_range(const codepoint_type& codepoint, size_t consumed) {
+        if(is_valid_codepoint(codepoint)) {
+            return decode_result(decode_success, codepoint, consumed);
+        } else {
+            return decode_result(decode_out_of_range, codepoint, consumed);
+        }
+    }
 };
 
 } // namespace utf16
@@ -0,0 +1,224 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf8.hpp>
+#include <boost/ustr/detail/utf16.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf16 {
+
+/*
+ * UTF-16 to UTF-8 and UTF-32 conversion over contiguous code units.
+ *
+ * utf8_length() gives the exact number of UTF-8 code units needed for well
+ * formed UTF-16, counting 2 bytes for each half of a surrogate pair, and
+ * utf32_length() the number of code points, which is every code unit but
+ * the low surrogates. convert_to_utf8() and convert_to_utf32() write into
+ * the pre-sized output and stop at the first unpaired surrogate, which
+ * needs the policy of the caller. They return the position they stopped at,
+ * or end.
+ */
+
+inline size_t utf8_length(const boost::uint16_t* current, const boost::uint16_t* end) {
+    // 1 byte per code unit, one more from 0x80 and another from 0x800,
+    // except for surrogates which take 2 bytes each
+    size_t length = end - current;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i two_bytes = _mm256_set1_epi16(0x80);
+    const __m256i three_bytes = _mm256_set1_epi16(0x800);
+    const __m256i surrogate_mask = _mm256_set1_epi16(static_cast<short>(0xF800));
+    const __m256i surrogate = _mm256_set1_epi16(static_cast<short>(0xD800));
+
+    while(end - current >= 16) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i at_least_two = _mm256_cmpeq_epi16(_mm256_max_epu16(units, two_bytes), units);
+        __m256i at_least_three = _mm256_cmpeq_epi16(_mm256_max_epu16(units, three_bytes), units);
+        __m256i surrogates = _mm256_cmpeq_epi16(_mm256_and_si256(units, surrogate_mask), surrogate);
+
+        // each 16 bit lane sets two bits of the byte mask
+        length += (_mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_two))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_three))) -
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(surrogates)))) / 2;
+        current += 16;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i two_bytes = _mm_set1_epi16(0x80);
+    const __m128i three_bytes = _mm_set1_epi16(0x800);
+    const __m128i surrogate_mask = _mm_set1_epi16(static_cast<short>(0xF800));
+    const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+
+    while(end - current >= 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i at_least_two = _mm_cmpeq_epi16(_mm_max_epu16(units, two_bytes), units);
+        __m128i at_least_three = _mm_cmpeq_epi16(_mm_max_epu16(units, three_bytes), units);
+        __m128i surrogates = _mm_cmpeq_epi16(_mm_and_si128(units, surrogate_mask), surrogate);
+
+        length += (_mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_two))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_three))) -
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(surrogates)))) / 2;
+        current += 8;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        boost::uint16_t unit = *current;
+        length += (unit >= 0x80) + (unit >= 0x800) - ((unit & 0xF800) == 0xD800);
+    }
+
+    return length;
+}
+
+inline const boost::uint16_t*
+convert_to_utf8(const boost::uint16_t* current, const boost::uint16_t* end, unsigned char*& target) {
+    // a local copy keeps the output pointer in a register, as
+    // the byte stores could otherwise alias it
+    unsigned char* out = target;
+
+    while(current != end) {
+        boost::uint16_t unit = *current;
+
+        if(unit < 0x80) {
+#if defined(BOOST_USTR_SIMD_SSE42)
+            const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+
+            while(end - current >= 16) {
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + 8));
+
+                if(!_mm_testz_si128(_mm_or_si128(low, high), non_ascii)) {
+                    break;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(low, high));
+                current += 16;
+                out += 16;
+            }
+#endif
+            while(current != end && *current < 0x80) {
+                *out++ = static_cast<unsigned char>(*current++);
+            }
+        } else if(unit < 0x800) {
+            *out++ = static_cast<unsigned char>(utf8::DOUBLE_BYTE_PREFIX | (unit >> 6));
+            *out++ = utf8::build_last_byte(unit);
+            ++current;
+        } else if(is_single_codeunit(unit)) {
+            *out++ = static_cast<unsigned char>(utf8::TRIPLE_BYTE_PREFIX | (unit >> 12));
+            *out++ = utf8::build_second_last_byte(unit);
+            *out++ = utf8::build_last_byte(unit);
+            ++current;
+        } else {
+            if(!is_high_surrogate(unit) || end - current < 2 || !is_low_surrogate(current[1])) {
+                target = out;
+                return current;
+            }
+
+            codepoint_type codepoint = decode_two_codeunits(unit, current[1]);
+            *out++ = static_cast<unsigned char>(utf8::QUAD_BYTE_PREFIX | (codepoint >> 18));
+            *out++ = utf8::build_third_last_byte(codepoint);
+            *out++ = utf8::build_second_last_byte(codepoint);
+            *out++ = utf8::build_last_byte(codepoint);
+            current += 2;
+        }
+    }
+
+    target = out;
+    return end;
+}
+
+inline size_t utf32_length(const boost::uint16_t* current, const boost::uint16_t* end) {
+    size_t length = end - current;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i low_surrogate_mask = _mm256_set1_epi16(static_cast<short>(0xFC00));
+    const __m256i low_surrogate = _mm256_set1_epi16(static_cast<short>(0xDC00));
+
+    while(end - current >= 16) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i lows = _mm256_cmpeq_epi16(_mm256_and_si256(units, low_surrogate_mask), low_surrogate);
+
+        length -= _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(lows))) / 2;
+        current += 16;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i low_surrogate_mask = _mm_set1_epi16(static_cast<short>(0xFC00));
+    const __m128i low_surrogate = _mm_set1_epi16(static_cast<short>(0xDC00));
+
+    while(end - current >= 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i lows = _mm_cmpeq_epi16(_mm_and_si128(units, low_surrogate_mask), low_surrogate);
+
+        length -= _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(lows))) / 2;
+        current += 8;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        length -= is_low_surrogate(*current);
+    }
+
+    return length;
+}
+
+inline const boost::uint16_t*
+convert_to_utf32(const boost::uint16_t* current, const boost::uint16_t* end, boost::uint32_t*& target) {
+    boost::uint32_t* out = target;
+
+    while(current != end) {
+        boost::uint16_t unit = *current;
+
+        if(is_single_codeunit(unit)) {
+#if defined(BOOST_USTR_SIMD_SSE42)
+            const __m128i surrogate_mask = _mm_set1_epi16(static_cast<short>(0xF800));
+            const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+
+            // widen blocks of 8 code units that hold no surrogate
+            while(end - current >= 8) {
+                __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+                __m128i surrogates = _mm_cmpeq_epi16(_mm_and_si128(units, surrogate_mask), surrogate);
+
+                if(_mm_movemask_epi8(surrogates)) {
+                    break;
+                }
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu16_epi32(units));
+#else
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtepu16_epi32(units));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_cvtepu16_epi32(_mm_srli_si128(units, 8)));
+#endif
+                current += 8;
+                out += 8;
+            }
+#endif
+            while(current != end && is_single_codeunit(*current)) {
+                *out++ = *current++;
+            }
+        } else {
+            if(!is_high_surrogate(unit) || end - current < 2 || !is_low_surrogate(current[1])) {
+                target = out;
+                return current;
+            }
+
+            *out++ = decode_two_codeunits(unit, current[1]);
+            current += 2;
+        }
+    }
+
+    target = out;
+    return end;
+}
+
+} // namespace utf16
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
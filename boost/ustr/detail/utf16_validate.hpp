@@ -0,0 +1,103 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf16.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf16 {
+
+/*
+ * UTF-16 validation over contiguous code units.
+ *
+ * The only malformed UTF-16 sequences are unpaired surrogates, so the
+ * validator skips surrogate free blocks and only looks closely at the
+ * surrogates it finds. Returns the position of the first unpaired
+ * surrogate, or end if the whole range is well formed.
+ */
+
+inline const boost::uint16_t*
+find_surrogate(const boost::uint16_t* current, const boost::uint16_t* end) {
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i mask = _mm256_set1_epi16(static_cast<short>(0xF800));
+    const __m256i surrogate = _mm256_set1_epi16(static_cast<short>(0xD800));
+
+    while(end - current >= 16) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i found = _mm256_cmpeq_epi16(_mm256_and_si256(units, mask), surrogate);
+
+        if(!_mm256_testz_si256(found, found)) {
+            break;
+        }
+        current += 16;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(0xF800));
+    const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+
+    while(end - current >= 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i found = _mm_cmpeq_epi16(_mm_and_si128(units, mask), surrogate);
+
+        if(!_mm_testz_si128(found, found)) {
+            break;
+        }
+        current += 8;
+    }
+#endif
+
+    while(current != end && (*current & 0xF800) != 0xD800) {
+        ++current;
+    }
+
+    return current;
+}
+
+/*
+ * The code point length of the range, i.e. the number of code units less
+ * one for every surrogate pair, is stored in length when the whole range
+ * is well formed.
+ */
+inline const boost::uint16_t*
+find_malformed(const boost::uint16_t* current, const boost::uint16_t* end, size_t& length) {
+    size_t pairs = 0;
+    size_t units = end - current;
+
+    while(true) {
+        current = find_surrogate(current, end);
+
+        if(current == end) {
+            length = units - pairs;
+            return end;
+        }
+
+        if(!is_high_surrogate(current[0]) ||
+            end - current < 2 ||
+            !is_low_surrogate(current[1]))
+        {
+            return current;
+        }
+
+        current += 2;
+        ++pairs;
+    }
+}
+
+inline const boost::uint16_t*
+find_malformed(const boost::uint16_t* current, const boost::uint16_t* end) {
+    size_t length;
+    return find_malformed(current, end, length);
+}
+
+} // namespace utf16
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
@@ -35,6 +35,17 @@ class utf32_encoder {
         return check_and_return(*begin++, policy);
     }
 
+    template <typename CodeunitInputIterator>
+    static inline decode_result try_decode(CodeunitInputIterator& begin, const CodeunitInputIterator& end) {
+        codepoint_type codepoint = *begin++;
+
+        if(is_valid_codepoint(codepoint)) {
+            return decode_result(decode_success, codepoint, 1);
+        } else {
+            return decode_result(decode_out_of_range, codepoint, 1);
+        }
+    }
+
     template <typename CodeunitIterator, typename Policy>
     static inline codepoint_type decode_previous(const CodeunitIterator& begin, CodeunitIterator& end, Policy policy) {
         if(end == begin) {
@@ -0,0 +1,227 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf8.hpp>
+#include <boost/ustr/detail/utf16.hpp>
+#include <boost/ustr/detail/utf32.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf32 {
+
+/*
+ * UTF-32 to UTF-8 and UTF-16 conversion over contiguous code units.
+ *
+ * utf8_length() and utf16_length() give the number of code units needed for
+ * the converted string, which is exact for code points up to U+10FFFF and an
+ * upper bound otherwise. convert_to_utf8() and convert_to_utf16() write into
+ * the pre-sized output and stop at the first code point beyond U+10FFFF, and
+ * for UTF-16 at the first surrogate code point, as those need the policy of
+ * the caller. They return the position they stopped at, or end.
+ */
+
+inline size_t utf8_length(const boost::uint32_t* current, const boost::uint32_t* end) {
+    // 1 byte per code point, and one more from each of 0x80, 0x800 and 0x10000
+    size_t length = end - current;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i two_bytes = _mm256_set1_epi32(0x80);
+    const __m256i three_bytes = _mm256_set1_epi32(0x800);
+    const __m256i four_bytes = _mm256_set1_epi32(0x10000);
+
+    while(end - current >= 8) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i at_least_two = _mm256_cmpeq_epi32(_mm256_max_epu32(units, two_bytes), units);
+        __m256i at_least_three = _mm256_cmpeq_epi32(_mm256_max_epu32(units, three_bytes), units);
+        __m256i at_least_four = _mm256_cmpeq_epi32(_mm256_max_epu32(units, four_bytes), units);
+
+        // each 32 bit lane sets four bits of the byte mask
+        length += (_mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_two))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_three))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_four)))) / 4;
+        current += 8;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i two_bytes = _mm_set1_epi32(0x80);
+    const __m128i three_bytes = _mm_set1_epi32(0x800);
+    const __m128i four_bytes = _mm_set1_epi32(0x10000);
+
+    while(end - current >= 4) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i at_least_two = _mm_cmpeq_epi32(_mm_max_epu32(units, two_bytes), units);
+        __m128i at_least_three = _mm_cmpeq_epi32(_mm_max_epu32(units, three_bytes), units);
+        __m128i at_least_four = _mm_cmpeq_epi32(_mm_max_epu32(units, four_bytes), units);
+
+        length += (_mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_two))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_three))) +
+                   _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_four)))) / 4;
+        current += 4;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        boost::uint32_t unit = *current;
+        length += (unit >= 0x80) + (unit >= 0x800) + (unit >= 0x10000);
+    }
+
+    return length;
+}
+
+inline size_t utf16_length(const boost::uint32_t* current, const boost::uint32_t* end) {
+    // one code unit per code point, and a second one from 0x10000
+    size_t length = end - current;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i two_units = _mm256_set1_epi32(0x10000);
+
+    while(end - current >= 8) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i at_least_two = _mm256_cmpeq_epi32(_mm256_max_epu32(units, two_units), units);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(at_least_two))) / 4;
+        current += 8;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i two_units = _mm_set1_epi32(0x10000);
+
+    while(end - current >= 4) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i at_least_two = _mm_cmpeq_epi32(_mm_max_epu32(units, two_units), units);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(at_least_two))) / 4;
+        current += 4;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        length += (*current >= 0x10000);
+    }
+
+    return length;
+}
+
+inline const boost::uint32_t*
+convert_to_utf8(const boost::uint32_t* current, const boost::uint32_t* end, unsigned char*& target) {
+    unsigned char* out = target;
+
+    while(current != end) {
+        boost::uint32_t codepoint = *current;
+
+        if(codepoint < 0x80) {
+#if defined(BOOST_USTR_SIMD_SSE42)
+            const __m128i non_ascii = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+
+            // narrow blocks of 16 ASCII code points
+            while(end - current >= 16) {
+                const __m128i* block = reinterpret_cast<const __m128i*>(current);
+                __m128i first = _mm_loadu_si128(block);
+                __m128i second = _mm_loadu_si128(block + 1);
+                __m128i third = _mm_loadu_si128(block + 2);
+                __m128i fourth = _mm_loadu_si128(block + 3);
+
+                __m128i all = _mm_or_si128(_mm_or_si128(first, second), _mm_or_si128(third, fourth));
+                if(!_mm_testz_si128(all, non_ascii)) {
+                    break;
+                }
+
+                __m128i bytes = _mm_packus_epi16(
+                    _mm_packus_epi32(first, second), _mm_packus_epi32(third, fourth));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+                current += 16;
+                out += 16;
+            }
+#endif
+            while(current != end && *current < 0x80) {
+                *out++ = static_cast<unsigned char>(*current++);
+            }
+            continue;
+        } else if(codepoint < 0x800) {
+            *out++ = static_cast<unsigned char>(utf8::DOUBLE_BYTE_PREFIX | (codepoint >> 6));
+            *out++ = utf8::build_last_byte(codepoint);
+        } else if(codepoint < 0x10000) {
+            // surrogate code points are encoded as they are, like utf8_encoder does
+            *out++ = static_cast<unsigned char>(utf8::TRIPLE_BYTE_PREFIX | (codepoint >> 12));
+            *out++ = utf8::build_second_last_byte(codepoint);
+            *out++ = utf8::build_last_byte(codepoint);
+        } else if(codepoint <= 0x10FFFF) {
+            *out++ = static_cast<unsigned char>(utf8::QUAD_BYTE_PREFIX | (codepoint >> 18));
+            *out++ = utf8::build_third_last_byte(codepoint);
+            *out++ = utf8::build_second_last_byte(codepoint);
+            *out++ = utf8::build_last_byte(codepoint);
+        } else {
+            break;
+        }
+        ++current;
+    }
+
+    target = out;
+    return current;
+}
+
+inline const boost::uint32_t*
+convert_to_utf16(const boost::uint32_t* current, const boost::uint32_t* end, boost::uint16_t*& target) {
+    boost::uint16_t* out = target;
+
+    while(current != end) {
+        boost::uint32_t codepoint = *current;
+
+        if(codepoint < 0xD800) {
+#if defined(BOOST_USTR_SIMD_SSE42)
+            const __m128i beyond_bmp = _mm_set1_epi32(static_cast<int>(0xFFFF0000));
+            const __m128i surrogate_mask = _mm_set1_epi32(0xF800);
+            const __m128i surrogate = _mm_set1_epi32(0xD800);
+
+            // narrow blocks of 8 code points in the BMP without surrogates
+            while(end - current >= 8) {
+                const __m128i* block = reinterpret_cast<const __m128i*>(current);
+                __m128i first = _mm_loadu_si128(block);
+                __m128i second = _mm_loadu_si128(block + 1);
+
+                __m128i surrogates = _mm_or_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(first, surrogate_mask), surrogate),
+                    _mm_cmpeq_epi32(_mm_and_si128(second, surrogate_mask), surrogate));
+
+                if(!_mm_testz_si128(_mm_or_si128(first, second), beyond_bmp) ||
+                   !_mm_testz_si128(surrogates, surrogates))
+                {
+                    break;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi32(first, second));
+                current += 8;
+                out += 8;
+            }
+#endif
+            while(current != end && *current < 0xD800) {
+                *out++ = static_cast<boost::uint16_t>(*current++);
+            }
+            continue;
+        } else if(codepoint < 0xE000) {
+            break;
+        } else if(codepoint < 0x10000) {
+            *out++ = static_cast<boost::uint16_t>(codepoint);
+        } else if(codepoint <= 0x10FFFF) {
+            *out++ = utf16::get_high_surrogate(codepoint);
+            *out++ = utf16::get_low_surrogate(codepoint);
+        } else {
+            break;
+        }
+        ++current;
+    }
+
+    target = out;
+    return current;
+}
+
+} // namespace utf32
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,68 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf32.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf32 {
+
+/*
+ * UTF-32 validation over contiguous code units.
+ *
+ * Every code unit is a code point of its own, so validation is a range
+ * check of each code unit against U+10FFFF. Returns the position of the
+ * first code unit out of range, or end if the whole range is valid.
+ */
+
+inline const boost::uint32_t*
+find_out_of_range(const boost::uint32_t* current, const boost::uint32_t* end) {
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i out_of_range = _mm256_set1_epi32(0x110000);
+
+    while(end - current >= 16) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + 8));
+        __m256i largest = _mm256_max_epu32(first, second);
+        __m256i found = _mm256_cmpeq_epi32(_mm256_max_epu32(largest, out_of_range), largest);
+
+        if(!_mm256_testz_si256(found, found)) {
+            break;
+        }
+        current += 16;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i out_of_range = _mm_set1_epi32(0x110000);
+
+    while(end - current >= 8) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + 4));
+        __m128i largest = _mm_max_epu32(first, second);
+        __m128i found = _mm_cmpeq_epi32(_mm_max_epu32(largest, out_of_range), largest);
+
+        if(!_mm_testz_si128(found, found)) {
+            break;
+        }
+        current += 8;
+    }
+#endif
+
+    while(current != end && is_valid_codepoint(*current)) {
+        ++current;
+    }
+
+    return current;
+}
+
+} // namespace utf32
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
@@ -153,64 +153,75 @@ class utf8_encoder {
 
     template <typename CodeunitInputIterator, typename Policy>
     static inline codepoint_type decode(CodeunitInputIterator& begin, const CodeunitInputIterator& end, Policy policy) {
+        return resolve_decode_result(try_decode(begin, end), policy);
+    }
+
+    /*
+     * try_decode decodes the code point at begin the same way as decode(), but
+     * reports malformed code units through the returned status instead of the
+     * policy. It never throws, which makes it the cheap way to check whether a
+     * string is well formed.
+     */
+    template <typename CodeunitInputIterator>
+    static inline decode_result try_decode(CodeunitInputIterator& begin, const CodeunitInputIterator& end) {
         unsigned char first_byte = *begin++;
         
         if(!is_valid_first_byte(first_byte)) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_malformed, 0, 1);
         }
 
         if(is_single_codeunit(first_byte)) {
-            return static_cast<codepoint_type>(first_byte);
+            return decode_result(decode_success, static_cast<codepoint_type>(first_byte), 1);
         } 
 
         // 2nd byte
         if(begin == end) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_incomplete, 0, 1);
         }
 
         unsigned char second_byte = *begin++;
         if(!is_continuation_byte(second_byte)) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_malformed, 0, 2);
         }
 
         if(is_double_codeunit(first_byte)) {
-            return check_and_return(decode_two_bytes(first_byte, second_byte), policy);
+            return check_range(decode_two_bytes(first_byte, second_byte), 2);
         }
 
         // 3rd byte
         if(begin == end) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_incomplete, 0, 2);
         }
 
         unsigned char third_byte = *begin++;
 
         if(!is_continuation_byte(third_byte)) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_malformed, 0, 3);
         }
             
         if(is_triple_codeunit(first_byte)) {
-            return check_and_return(decode_three_bytes(first_byte, 
-                        second_byte, third_byte), policy);
+            return check_range(decode_three_bytes(first_byte, 
+                        second_byte, third_byte), 3);
         }
 
         // 4th byte
         if(begin == end) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_incomplete, 0, 3);
         }
 
         unsigned char fourth_byte = *begin++;
 
         if(!is_continuation_byte(fourth_byte)) {
-            return Policy::replace_invalid_codepoint();
+            return decode_result(decode_malformed, 0, 4);
         }
 
         if(is_quad_codeunit(first_byte)) {
-            return check_and_return(decode_four_bytes(first_byte, 
-                        second_byte, third_byte, fourth_byte), policy);
+            return check_range(decode_four_bytes(first_byte, 
+                        second_byte, third_byte, fourth_byte), 4);
         }
 
         // should not reach here
-        return Policy::replace_invalid_codepoint();
+        return decode_result(decode_malformed, 0, 4);
     }
 
     /*
@@ -307,6 +318,14 @@ class utf8_encoder {
             return Policy::replace_invalid_codepoint(codepoint);
         }
     }
+
+    static inline decode_result check_range(const codepoint_type& codepoint, size_t consumed) {
+        if(is_valid_codepoint(codepoint)) {
+            return decode_result(decode_success, codepoint, consumed);
+        } else {
+            return decode_result(decode_out_of_range, codepoint, consumed);
+        }
+    }
 };
 
 } // namespace utf8
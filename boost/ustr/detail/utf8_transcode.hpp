@@ -0,0 +1,254 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf8.hpp>
+#include <boost/ustr/detail/utf16.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf8 {
+
+/*
+ * UTF-8 to UTF-16 and UTF-32 conversion over contiguous code units.
+ *
+ * utf16_length() and utf32_length() give the number of code units needed for
+ * the converted string, which is exact for well formed UTF-8 and an upper
+ * bound otherwise. convert_to_utf16() and convert_to_utf32() then write into
+ * the pre-sized output and stop at the first sequence they cannot convert on
+ * their own: malformed sequences, code points beyond U+10FFFF, and for UTF-16
+ * encoded surrogates and overlong 4 byte forms, all of which need the policy
+ * of the caller. They return the position they stopped at, or end.
+ */
+
+inline size_t utf16_length(const unsigned char* current, const unsigned char* end) {
+    // one code unit for every code point, which starts at every byte that
+    // is not a continuation byte, plus one for each 4 byte sequence
+    size_t length = 0;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i last_continuation = _mm256_set1_epi8(static_cast<char>(0xBF));
+    const __m256i quad_prefix = _mm256_set1_epi8(static_cast<char>(QUAD_BYTE_PREFIX));
+
+    while(end - current >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i leads = _mm256_cmpgt_epi8(bytes, last_continuation);
+        __m256i quads = _mm256_cmpeq_epi8(_mm256_max_epu8(bytes, quad_prefix), bytes);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(leads)));
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(quads)));
+        current += 32;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i last_continuation = _mm_set1_epi8(static_cast<char>(0xBF));
+    const __m128i quad_prefix = _mm_set1_epi8(static_cast<char>(QUAD_BYTE_PREFIX));
+
+    while(end - current >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i leads = _mm_cmpgt_epi8(bytes, last_continuation);
+        __m128i quads = _mm_cmpeq_epi8(_mm_max_epu8(bytes, quad_prefix), bytes);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(leads)));
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(quads)));
+        current += 16;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        length += !is_continuation_byte(*current);
+        length += (*current >= QUAD_BYTE_PREFIX);
+    }
+
+    return length;
+}
+
+inline size_t utf32_length(const unsigned char* current, const unsigned char* end) {
+    // one code unit for every byte that is not a continuation byte
+    size_t length = 0;
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+    const __m256i last_continuation = _mm256_set1_epi8(static_cast<char>(0xBF));
+
+    while(end - current >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+        __m256i leads = _mm256_cmpgt_epi8(bytes, last_continuation);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(leads)));
+        current += 32;
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    const __m128i last_continuation = _mm_set1_epi8(static_cast<char>(0xBF));
+
+    while(end - current >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+        __m128i leads = _mm_cmpgt_epi8(bytes, last_continuation);
+
+        length += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(leads)));
+        current += 16;
+    }
+#endif
+
+    for(; current != end; ++current) {
+        length += !is_continuation_byte(*current);
+    }
+
+    return length;
+}
+
+namespace transcode {
+
+/*
+ * Output of a single code point, returning false if the code point
+ * has to be left to the policy of the caller.
+ */
+inline bool put_codepoint(const codepoint_type& codepoint, boost::uint16_t*& out) {
+    if(codepoint < 0x10000) {
+        if(!utf16::is_single_codeunit(static_cast<boost::uint16_t>(codepoint))) {
+            return false;
+        }
+        *out++ = static_cast<boost::uint16_t>(codepoint);
+    } else if(codepoint <= 0x10FFFF) {
+        *out++ = utf16::get_high_surrogate(codepoint);
+        *out++ = utf16::get_low_surrogate(codepoint);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline bool put_codepoint(const codepoint_type& codepoint, boost::uint32_t*& out) {
+    if(codepoint > 0x10FFFF) {
+        return false;
+    }
+    *out++ = codepoint;
+    return true;
+}
+
+/*
+ * Widens 16 ASCII bytes into the output.
+ */
+#if defined(BOOST_USTR_SIMD_SSE42)
+inline void put_ascii(__m128i bytes, boost::uint16_t*& out) {
+#if defined(BOOST_USTR_SIMD_AVX2)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(bytes));
+#else
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtepu8_epi16(bytes));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8)));
+#endif
+    out += 16;
+}
+
+inline void put_ascii(__m128i bytes, boost::uint32_t*& out) {
+#if defined(BOOST_USTR_SIMD_AVX2)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi32(bytes));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+#else
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtepu8_epi32(bytes));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12)));
+#endif
+    out += 16;
+}
+#endif
+
+template <typename CodeUnit>
+inline const unsigned char*
+convert(const unsigned char* current, const unsigned char* end, CodeUnit*& target) {
+    // a local copy keeps the output pointer in a register, as
+    // the byte loads could otherwise alias it
+    CodeUnit* out = target;
+
+    while(current != end) {
+        unsigned char first_byte = *current;
+        codepoint_type codepoint;
+        ptrdiff_t length;
+
+        if(is_single_codeunit(first_byte)) {
+#if defined(BOOST_USTR_SIMD_SSE42)
+            while(end - current >= 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+                if(_mm_movemask_epi8(bytes)) {
+                    break;
+                }
+
+                put_ascii(bytes, out);
+                current += 16;
+            }
+#endif
+            while(current != end && is_single_codeunit(*current)) {
+                *out++ = *current++;
+            }
+            continue;
+        } else if(first_byte < 0xC2) {
+            break;
+        } else if(first_byte < TRIPLE_BYTE_PREFIX) {
+            if(end - current < 2 || !is_continuation_byte(current[1])) {
+                break;
+            }
+
+            codepoint = decode_two_bytes(first_byte, current[1]);
+            length = 2;
+        } else if(first_byte < QUAD_BYTE_PREFIX) {
+            if(end - current < 3 ||
+               !is_continuation_byte(current[1]) ||
+               !is_continuation_byte(current[2]))
+            {
+                break;
+            }
+
+            codepoint = decode_three_bytes(first_byte, current[1], current[2]);
+            length = 3;
+        } else if(first_byte < 0xF5) {
+            if(end - current < 4 ||
+               !is_continuation_byte(current[1]) ||
+               !is_continuation_byte(current[2]) ||
+               !is_continuation_byte(current[3]))
+            {
+                break;
+            }
+
+            codepoint = decode_four_bytes(first_byte, current[1], current[2], current[3]);
+
+            // overlong forms that the UTF-16 encoder leaves to the policy
+            if(sizeof(CodeUnit) == 2 && codepoint < 0x10000) {
+                break;
+            }
+            length = 4;
+        } else {
+            break;
+        }
+
+        if(!put_codepoint(codepoint, out)) {
+            break;
+        }
+        current += length;
+    }
+
+    target = out;
+    return current;
+}
+
+} // namespace transcode
+
+inline const unsigned char*
+convert_to_utf16(const unsigned char* current, const unsigned char* end, boost::uint16_t*& out) {
+    return transcode::convert(current, end, out);
+}
+
+inline const unsigned char*
+convert_to_utf32(const unsigned char* current, const unsigned char* end, boost::uint32_t*& out) {
+    return transcode::convert(current, end, out);
+}
+
+} // namespace utf8
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,497 @@
+
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/simd.hpp>
+#include <boost/ustr/detail/utf8.hpp>
+
+namespace boost {
+namespace ustr {
+namespace encoding {
+namespace utf8 {
+
+/*
+ * UTF-8 validation over contiguous code units.
+ *
+ * The validator accepts exactly the code unit sequences that utf8_encoder::decode()
+ * accepts without invoking the policy: a lead byte in 0xC2-0xF4 followed by the
+ * number of continuation bytes it announces, with 4-byte sequences limited to
+ * U+10FFFF. Like the decoder, it does not reject overlong 3 and 4 byte forms or
+ * encoded surrogates.
+ *
+ * The validators return the position of the first code unit of the first malformed
+ * sequence, or end if the whole range is well formed.
+ */
+
+inline bool is_ascii_word(const unsigned char* codeunits) {
+    boost::uint64_t word;
+    std::memcpy(&word, codeunits, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
+}
+
+inline size_t count_leads(const unsigned char* current, const unsigned char* end) {
+    size_t leads = 0;
+    for(; current != end; ++current) {
+        leads += !is_continuation_byte(*current);
+    }
+    return leads;
+}
+
+/*
+ * When the range is well formed, the scalar validator also adds
+ * its number of code points to length.
+ */
+inline const unsigned char*
+scalar_find_malformed(const unsigned char* current, const unsigned char* end, size_t& length) {
+    size_t codepoints = length;
+
+    while(current != end) {
+        unsigned char first_byte = *current;
+        ++codepoints;
+
+        if(is_single_codeunit(first_byte)) {
+            ++current;
+
+            // ASCII tends to come in runs
+            while(end - current >= 8 && is_ascii_word(current)) {
+                current += 8;
+                codepoints += 8;
+            }
+            continue;
+        }
+
+        if(first_byte < 0xC2) {
+            return current;
+        } else if(first_byte < TRIPLE_BYTE_PREFIX) {
+            if(end - current < 2 || !is_continuation_byte(current[1])) {
+                return current;
+            }
+            current += 2;
+        } else if(first_byte < QUAD_BYTE_PREFIX) {
+            if(end - current < 3 || 
+               !is_continuation_byte(current[1]) || 
+               !is_continuation_byte(current[2])) 
+            {
+                return current;
+            }
+            current += 3;
+        } else if(first_byte < 0xF5) {
+            // anything above F4 8F BF BF is beyond U+10FFFF
+            if(end - current < 4 ||
+               !is_continuation_byte(current[1]) ||
+               (first_byte == 0xF4 && current[1] > 0x8F) ||
+               !is_continuation_byte(current[2]) ||
+               !is_continuation_byte(current[3]))
+            {
+                return current;
+            }
+            current += 4;
+        } else {
+            return current;
+        }
+    }
+
+    length = codepoints;
+    return end;
+}
+
+inline const unsigned char*
+scalar_find_malformed(const unsigned char* current, const unsigned char* end) {
+    size_t length = 0;
+    return scalar_find_malformed(current, end, length);
+}
+
+/*
+ * Finds the first code unit of the last code point that starts before current,
+ * given that everything before current has been checked to be well formed up to
+ * a possibly truncated last sequence. Used to resume scalar validation from a
+ * code point boundary.
+ */
+inline const unsigned char*
+last_sequence_start(const unsigned char* begin, const unsigned char* current) {
+    const unsigned char* start = current - begin > 3 ? current - 3 : begin;
+
+    // Continuation bytes at the front belong to a sequence that
+    // started and ended before current.
+    while(start != current && is_continuation_byte(*start)) {
+        ++start;
+    }
+
+    return start;
+}
+
+#if defined(BOOST_USTR_SIMD_SSE42) || defined(BOOST_USTR_SIMD_AVX2)
+
+/*
+ * Lookup table validation, after "Validating UTF-8 In Less Than One Instruction
+ * Per Byte" by John Keiser and Daniel Lemire.
+ *
+ * Each byte is classified by the high and low nibble of the preceding byte and
+ * the high nibble of itself. The three table lookups are ANDed together so that
+ * a bit survives only when all three nibbles agree on an error. The tables here
+ * drop the overlong 3/4 byte and surrogate classes of the original algorithm to
+ * match the acceptance rules of utf8_encoder::decode().
+ */
+namespace lookup {
+
+static const unsigned char TOO_SHORT        = 1 << 0;   // 11______ followed by 0_______ or 11______
+static const unsigned char TOO_LONG         = 1 << 1;   // 0_______ followed by 10______
+static const unsigned char TOO_LARGE        = 1 << 3;   // 11110100 followed by 1001____ or 101_____
+static const unsigned char OVERLONG_2       = 1 << 5;   // 1100000_ followed by 10______
+static const unsigned char TOO_LARGE_1000   = 1 << 6;   // 11110101+ followed by 1000____
+static const unsigned char TWO_CONTS        = 1 << 7;   // 10______ followed by 10______
+static const unsigned char CARRY            = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+template <typename Simd>
+class validator {
+  public:
+    typedef typename Simd::register_type    register_type;
+
+    /*
+     * Also counts the code points of the range into length, as the number
+     * of bytes that are not continuation bytes, which is exact when the
+     * range is well formed.
+     */
+    static const unsigned char*
+    find_malformed(const unsigned char* begin, const unsigned char* end, size_t& length) {
+        const size_t width = Simd::width;
+        size_t leads = 0;
+
+        register_type prev_input = Simd::zero();
+        register_type prev_incomplete = Simd::zero();
+        const unsigned char* current = begin;
+
+        while(static_cast<size_t>(end - current) >= width) {
+            register_type input = Simd::load(current);
+            register_type error;
+
+            if(Simd::is_ascii(input)) {
+                // An ASCII block can only be wrong if the previous block
+                // ended in the middle of a multi byte sequence.
+                error = prev_incomplete;
+                prev_incomplete = Simd::zero();
+            } else {
+                error = check_block(input, prev_input);
+                prev_incomplete = Simd::subs(input, Simd::incomplete_max());
+            }
+
+            if(!Simd::is_zero(error)) {
+                return resume_scalar(begin, current, end, leads, length);
+            }
+
+            leads += Simd::count_leads(input);
+            prev_input = input;
+            current += width;
+        }
+
+        if(current != end) {
+            // Zero padding is ASCII, which flags any sequence
+            // truncated by the end of the range.
+            unsigned char tail[Simd::width];
+            std::memset(tail, 0, sizeof(tail));
+            std::memcpy(tail, current, end - current);
+
+            if(!Simd::is_zero(check_block(Simd::load(tail), prev_input))) {
+                return resume_scalar(begin, current, end, leads, length);
+            }
+
+            leads += count_leads(current, end);
+        } else if(!Simd::is_zero(prev_incomplete)) {
+            return resume_scalar(begin, current, end, leads, length);
+        }
+
+        length = leads;
+        return end;
+    }
+
+  private:
+    static const unsigned char*
+    resume_scalar(const unsigned char* begin, const unsigned char* current,
+            const unsigned char* end, size_t leads, size_t& length)
+    {
+        const unsigned char* start = last_sequence_start(begin, current);
+
+        length = leads - count_leads(start, current);
+        return scalar_find_malformed(start, end, length);
+    }
+
+    static register_type check_block(register_type input, register_type prev_input) {
+        register_type prev1 = Simd::template prev<1>(input, prev_input);
+
+        register_type byte_1_high = Simd::lookup(Simd::table(
+            // 0_______ ________
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            // 10______ ________
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            // 1100____ ________
+            TOO_SHORT | OVERLONG_2,
+            // 1101____ ________
+            TOO_SHORT,
+            // 1110____ ________
+            TOO_SHORT,
+            // 1111____ ________
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000
+        ), Simd::high_nibble(prev1));
+
+        register_type byte_1_low = Simd::lookup(Simd::table(
+            // ____000_ ________
+            CARRY | OVERLONG_2,
+            CARRY | OVERLONG_2,
+            // ____001_ ________
+            CARRY,
+            CARRY,
+            // ____0100 ________
+            CARRY | TOO_LARGE,
+            // ____0101 ________ and above
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000
+        ), Simd::low_nibble(prev1));
+
+        register_type byte_2_high = Simd::lookup(Simd::table(
+            // ________ 0_______
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            // ________ 1000____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE_1000,
+            // ________ 1001____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+            // ________ 101_____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+            // ________ 11______
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+        ), Simd::high_nibble(input));
+
+        register_type special_cases = Simd::and_(Simd::and_(byte_1_high, byte_1_low), byte_2_high);
+
+        // The third and fourth bytes of a sequence are continuation bytes
+        // following continuation bytes, which special_cases reports as TWO_CONTS.
+        register_type prev2 = Simd::template prev<2>(input, prev_input);
+        register_type prev3 = Simd::template prev<3>(input, prev_input);
+
+        register_type is_third_byte = Simd::subs(prev2, Simd::splat(TRIPLE_BYTE_PREFIX - 0x80));
+        register_type is_fourth_byte = Simd::subs(prev3, Simd::splat(QUAD_BYTE_PREFIX - 0x80));
+        register_type must_be_continuation = Simd::and_(
+                Simd::or_(is_third_byte, is_fourth_byte), Simd::splat(0x80));
+
+        return Simd::xor_(must_be_continuation, special_cases);
+    }
+};
+
+#if defined(BOOST_USTR_SIMD_SSE42)
+class sse42_registers {
+  public:
+    typedef __m128i     register_type;
+
+    static const size_t width = 16;
+
+    static register_type load(const unsigned char* codeunits) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(codeunits));
+    }
+
+    static register_type zero() {
+        return _mm_setzero_si128();
+    }
+
+    static register_type splat(unsigned char value) {
+        return _mm_set1_epi8(static_cast<char>(value));
+    }
+
+    static register_type table(
+        unsigned char c0, unsigned char c1, unsigned char c2, unsigned char c3,
+        unsigned char c4, unsigned char c5, unsigned char c6, unsigned char c7,
+        unsigned char c8, unsigned char c9, unsigned char c10, unsigned char c11,
+        unsigned char c12, unsigned char c13, unsigned char c14, unsigned char c15)
+    {
+        return _mm_setr_epi8(
+            static_cast<char>(c0), static_cast<char>(c1), static_cast<char>(c2), static_cast<char>(c3),
+            static_cast<char>(c4), static_cast<char>(c5), static_cast<char>(c6), static_cast<char>(c7),
+            static_cast<char>(c8), static_cast<char>(c9), static_cast<char>(c10), static_cast<char>(c11),
+            static_cast<char>(c12), static_cast<char>(c13), static_cast<char>(c14), static_cast<char>(c15));
+    }
+
+    static register_type incomplete_max() {
+        // Sequences starting in the last 3 bytes that need more bytes
+        // than there are left in the block
+        return _mm_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(QUAD_BYTE_PREFIX - 1),
+            static_cast<char>(TRIPLE_BYTE_PREFIX - 1),
+            static_cast<char>(DOUBLE_BYTE_PREFIX - 1));
+    }
+
+    static bool is_ascii(register_type value) {
+        return _mm_movemask_epi8(value) == 0;
+    }
+
+    static size_t count_leads(register_type value) {
+        // bytes above 0xBF as signed, i.e. everything but 10______
+        return _mm_popcnt_u32(static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpgt_epi8(value, splat(0xBF)))));
+    }
+
+    static bool is_zero(register_type value) {
+        return _mm_testz_si128(value, value) != 0;
+    }
+
+    template <int N>
+    static register_type prev(register_type input, register_type prev_input) {
+        return _mm_alignr_epi8(input, prev_input, 16 - N);
+    }
+
+    static register_type lookup(register_type table, register_type index) {
+        return _mm_shuffle_epi8(table, index);
+    }
+
+    static register_type high_nibble(register_type value) {
+        return _mm_and_si128(_mm_srli_epi16(value, 4), splat(0x0F));
+    }
+
+    static register_type low_nibble(register_type value) {
+        return _mm_and_si128(value, splat(0x0F));
+    }
+
+    static register_type and_(register_type a, register_type b) { return _mm_and_si128(a, b); }
+    static register_type or_(register_type a, register_type b) { return _mm_or_si128(a, b); }
+    static register_type xor_(register_type a, register_type b) { return _mm_xor_si128(a, b); }
+    static register_type subs(register_type a, register_type b) { return _mm_subs_epu8(a, b); }
+};
+#endif
+
+#if defined(BOOST_USTR_SIMD_AVX2)
+class avx2_registers {
+  public:
+    typedef __m256i     register_type;
+
+    static const size_t width = 32;
+
+    static register_type load(const unsigned char* codeunits) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(codeunits));
+    }
+
+    static register_type zero() {
+        return _mm256_setzero_si256();
+    }
+
+    static register_type splat(unsigned char value) {
+        return _mm256_set1_epi8(static_cast<char>(value));
+    }
+
+    static register_type table(
+        unsigned char c0, unsigned char c1, unsigned char c2, unsigned char c3,
+        unsigned char c4, unsigned char c5, unsigned char c6, unsigned char c7,
+        unsigned char c8, unsigned char c9, unsigned char c10, unsigned char c11,
+        unsigned char c12, unsigned char c13, unsigned char c14, unsigned char c15)
+    {
+        // vpshufb looks up within each 128-bit lane, so the
+        // table is repeated in both lanes
+        return _mm256_setr_epi8(
+            static_cast<char>(c0), static_cast<char>(c1), static_cast<char>(c2), static_cast<char>(c3),
+            static_cast<char>(c4), static_cast<char>(c5), static_cast<char>(c6), static_cast<char>(c7),
+            static_cast<char>(c8), static_cast<char>(c9), static_cast<char>(c10), static_cast<char>(c11),
+            static_cast<char>(c12), static_cast<char>(c13), static_cast<char>(c14), static_cast<char>(c15),
+            static_cast<char>(c0), static_cast<char>(c1), static_cast<char>(c2), static_cast<char>(c3),
+            static_cast<char>(c4), static_cast<char>(c5), static_cast<char>(c6), static_cast<char>(c7),
+            static_cast<char>(c8), static_cast<char>(c9), static_cast<char>(c10), static_cast<char>(c11),
+            static_cast<char>(c12), static_cast<char>(c13), static_cast<char>(c14), static_cast<char>(c15));
+    }
+
+    static register_type incomplete_max() {
+        return _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(QUAD_BYTE_PREFIX - 1),
+            static_cast<char>(TRIPLE_BYTE_PREFIX - 1),
+            static_cast<char>(DOUBLE_BYTE_PREFIX - 1));
+    }
+
+    static bool is_ascii(register_type value) {
+        return _mm256_movemask_epi8(value) == 0;
+    }
+
+    static size_t count_leads(register_type value) {
+        return _mm_popcnt_u32(static_cast<unsigned>(
+            _mm256_movemask_epi8(_mm256_cmpgt_epi8(value, splat(0xBF)))));
+    }
+
+    static bool is_zero(register_type value) {
+        return _mm256_testz_si256(value, value) != 0;
+    }
+
+    template <int N>
+    static register_type prev(register_type input, register_type prev_input) {
+        // Bring the high lane of prev_input next to the low lane of input
+        // so that the in-lane alignr can shift across the lane boundary.
+        return _mm256_alignr_epi8(input,
+                _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+    }
+
+    static register_type lookup(register_type table, register_type index) {
+        return _mm256_shuffle_epi8(table, index);
+    }
+
+    static register_type high_nibble(register_type value) {
+        return _mm256_and_si256(_mm256_srli_epi16(value, 4), splat(0x0F));
+    }
+
+    static register_type low_nibble(register_type value) {
+        return _mm256_and_si256(value, splat(0x0F));
+    }
+
+    static register_type and_(register_type a, register_type b) { return _mm256_and_si256(a, b); }
+    static register_type or_(register_type a, register_type b) { return _mm256_or_si256(a, b); }
+    static register_type xor_(register_type a, register_type b) { return _mm256_xor_si256(a, b); }
+    static register_type subs(register_type a, register_type b) { return _mm256_subs_epu8(a, b); }
+};
+#endif
+
+} // namespace lookup
+
+#endif
+
+/*
+ * The code point length of the range is stored in length
+ * when the whole range is well formed.
+ */
+inline const unsigned char*
+find_malformed(const unsigned char* begin, const unsigned char* end, size_t& length) {
+#if defined(BOOST_USTR_SIMD_AVX2)
+    if(end - begin >= 32) {
+        return lookup::validator<lookup::avx2_registers>::find_malformed(begin, end, length);
+    }
+#elif defined(BOOST_USTR_SIMD_SSE42)
+    if(end - begin >= 16) {
+        return lookup::validator<lookup::sse42_registers>::find_malformed(begin, end, length);
+    }
+#endif
+    length = 0;
+    return scalar_find_malformed(begin, end, length);
+}
+
+inline const unsigned char*
+find_malformed(const unsigned char* begin, const unsigned char* end) {
+    size_t length;
+    return find_malformed(begin, end, length);
+}
+
+} // namespace utf8
+} // namespace encoding
+} // namespace ustr
+} // namespace boost
@@ -6,8 +6,15 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+#include <list>
 #include <iterator>
+#include <algorithm>
 #include <iostream>
+#include <boost/type_traits/is_pointer.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_same.hpp>
 #include <boost/ustr/detail/incl.hpp>
 #include <boost/ustr/detail/utf8.hpp>
 #include <boost/ustr/detail/utf16.hpp>
@@ -73,6 +80,131 @@ class get_raw_char_type {
         char_type_by_size< sizeof(CharT) >::type    type;
 };
 
+/*
+ * Tells whether the code unit iterator of a string type walks over contiguous
+ * memory, in which case the vectorized kernels can operate on raw pointers
+ * obtained from it.
+ */
+template <typename StringT, typename Iterator>
+class is_contiguous_range {
+  public:
+    static const bool value = boost::is_pointer<Iterator>::value;
+};
+
+template <typename CharT, typename CharTraits, typename Alloc, typename Iterator>
+class is_contiguous_range< std::basic_string<CharT, CharTraits, Alloc>, Iterator > {
+  private:
+    typedef std::basic_string<CharT, CharTraits, Alloc>     string_type;
+
+  public:
+    static const bool value = 
+        boost::is_pointer<Iterator>::value ||
+        boost::is_same<Iterator, typename string_type::const_iterator>::value ||
+        boost::is_same<Iterator, typename string_type::iterator>::value;
+};
+
+template <typename CharT, typename Alloc, typename Iterator>
+class is_contiguous_range< std::vector<CharT, Alloc>, Iterator > {
+  private:
+    typedef std::vector<CharT, Alloc>                       string_type;
+
+  public:
+    static const bool value = 
+        boost::is_pointer<Iterator>::value ||
+        boost::is_same<Iterator, typename string_type::const_iterator>::value ||
+        boost::is_same<Iterator, typename string_type::iterator>::value;
+};
+
+/*
+ * Tells whether an iterator walks over contiguous memory without knowing the
+ * string type, i.e. it is a pointer, or an iterator of a std::vector or
+ * std::basic_string of code units or code points.
+ */
+template <
+    typename Iterator,
+    typename ValueType = typename std::iterator_traits<Iterator>::value_type,
+    bool Integral = boost::is_integral<ValueType>::value>
+class is_contiguous_iterator {
+  public:
+    static const bool value = boost::is_pointer<Iterator>::value;
+};
+
+template <typename Iterator, typename ValueType>
+class is_contiguous_iterator<Iterator, ValueType, true> {
+  public:
+    static const bool value =
+        is_contiguous_range<std::vector<ValueType>, Iterator>::value ||
+        is_contiguous_range<std::basic_string<ValueType>, Iterator>::value;
+};
+
+/*
+ * Raw pointer to the code unit at a position of a contiguous range.
+ * The iterator must be dereferenceable, i.e. not the end of the range.
+ */
+template <typename Iterator>
+inline const typename std::iterator_traits<Iterator>::value_type*
+to_pointer(const Iterator& it) {
+    return &*it;
+}
+
+/*
+ * String traits of code units read through plain pointers, such as the
+ * chunks of a stream, for utf_encoding_traits to validate, decode and
+ * transcode them from. Nothing is ever built into them, so the string
+ * types are only named, never used.
+ */
+template <typename CodeunitT>
+class pointer_range_traits {
+  public:
+    typedef CodeunitT                               codeunit_type;
+    static const size_t codeunit_size = sizeof(codeunit_type);
+
+    typedef const codeunit_type*                    codeunit_iterator_type;
+
+    typedef std::basic_string<codeunit_type>        string_type;
+    typedef const string_type*                      raw_strptr_type;
+    typedef const string_type*                      const_strptr_type;
+    typedef string_type                             mutable_strptr_type;
+};
+
+/*
+ * Length of a range if it can be measured without consuming it, that is
+ * for forward iterators, or 0 for single pass input iterators.
+ */
+template <typename Iterator>
+inline size_t known_distance(Iterator begin, Iterator end, std::input_iterator_tag) {
+    return 0;
+}
+
+template <typename Iterator>
+inline size_t known_distance(Iterator begin, Iterator end, std::forward_iterator_tag) {
+    return std::distance(begin, end);
+}
+
+template <typename Iterator>
+inline size_t known_distance(Iterator begin, Iterator end) {
+    return known_distance(begin, end,
+        typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+/*
+ * Makes room in str for length more code units. The capacity grows at
+ * least geometrically, so that reserving before each of many small appends
+ * does not reallocate each time. Containers without reserve() are left
+ * alone.
+ */
+template <typename StringT>
+inline void reserve_codeunits(StringT& str, size_t length) {
+    size_t size = str.size() + length;
+
+    if(str.capacity() < size) {
+        str.reserve((std::max)(size, 2 * str.capacity()));
+    }
+}
+
+template <typename CharT, typename Alloc>
+inline void reserve_codeunits(std::list<CharT, Alloc>&, size_t) { }
+
 } // namspace util
 } // namespace ustr 
 } // namespace boost
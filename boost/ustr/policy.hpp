@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <exception>
 #include <boost/ustr/detail/incl.hpp>
 
 namespace boost {
@@ -40,5 +42,46 @@ class error_policy {
     }
 };
 
+/*
+ * Outcome of decoding a single code point without consulting a policy.
+ */
+enum decode_status {
+    decode_success,         // well formed code point
+    decode_malformed,       // ill-formed code unit sequence
+    decode_incomplete,      // sequence cut short by the end of the input
+    decode_out_of_range     // well formed sequence of an invalid code point value
+};
+
+class decode_result {
+  public:
+    decode_result(decode_status status_, codepoint_type codepoint_, size_t consumed_) :
+        status(status_), codepoint(codepoint_), consumed(consumed_)
+    { }
+
+    bool valid() const {
+        return status == decode_success;
+    }
+
+    decode_status   status;
+    codepoint_type  codepoint;  // only meaningful for decode_success and decode_out_of_range
+    size_t          consumed;   // number of code units consumed
+};
+
+/*
+ * Turns a decode result into a code point, asking the policy for
+ * a replacement when the code units were invalid.
+ */
+template <typename Policy>
+inline codepoint_type resolve_decode_result(const decode_result& result, Policy) {
+    switch(result.status) {
+        case decode_success:
+            return result.codepoint;
+        case decode_out_of_range:
+            return Policy::replace_invalid_codepoint(result.codepoint);
+        default:
+            return Policy::replace_invalid_codepoint();
+    }
+}
+
 } // namespace ustr
 } // namespace boost
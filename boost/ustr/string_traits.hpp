@@ -14,6 +14,7 @@
 #include <algorithm>
 #include <boost/ustr/detail/util.hpp>
 #include <boost/ustr/detail/incl.hpp>
+#include <boost/ustr/detail/buffer_metadata.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/type_traits.hpp>
@@ -153,6 +154,10 @@ class string_traits {
     };
 
     struct const_strptr {
+      private:
+        typedef util::metadata_deleter<string_type>     deleter_type;
+
+      public:
         static const_raw_strptr_type get(const const_strptr_type& str) {
             return str.get();
         }
@@ -167,7 +172,22 @@ class string_traits {
         }
 
         static void reset(const_strptr_type& str, raw_strptr_type new_str) {
-            str.reset(new_str);
+            str.reset(new_str, deleter_type());
+        }
+
+        /*
+         * The metadata shared by all copies of str, or NULL for empty
+         * buffers and buffers not created through reset().
+         */
+        static util::buffer_metadata* metadata(const const_strptr_type& str) {
+#ifdef BOOST_USTR_CPP0X
+            deleter_type* deleter = std::get_deleter<deleter_type>(str);
+#elif BOOST_HAS_TR1_SHARED_PTR
+            deleter_type* deleter = std::tr1::get_deleter<deleter_type>(str);
+#else
+            deleter_type* deleter = boost::get_deleter<deleter_type>(str);
+#endif
+            return deleter ? &deleter->metadata : 0;
         }
 
         static codeunit_iterator_type 
@@ -213,10 +233,63 @@ class string_traits {
             str->push_back(codeunit);
         }
 
+        template <typename CodeunitIterator>
+        static void append(mutable_strptr_type& str, CodeunitIterator begin, CodeunitIterator end) {
+            check_and_initialize(str);
+            str->insert(str->end(), begin, end);
+        }
+
+        /*
+         * Makes room for length more code units, so that appending
+         * them does not reallocate the string.
+         */
+        static void reserve_space(mutable_strptr_type& str, size_t length) {
+            check_and_initialize(str);
+            util::reserve_codeunits(*str, length);
+        }
+
+        /*
+         * Extends the string by length code units, which must be positive, and
+         * returns a pointer to the first of them. Only used for string types
+         * with contiguous storage.
+         */
+        static codeunit_type* append_space(mutable_strptr_type& str, size_t length) {
+            check_and_initialize(str);
+            size_t size = str->size();
+            str->resize(size + length);
+            return &(*str)[0] + size;
+        }
+
+        /*
+         * Removes the last length code units, giving back unused space
+         * obtained from append_space().
+         */
+        static void shrink_space(mutable_strptr_type& str, size_t length) {
+            str->resize(str->size() - length);
+        }
+
         static codeunit_output_iterator_type output_iterator(mutable_strptr_type& str) {
             return std::back_inserter(*str);
         } 
 
+        /*
+         * Read access to the code units appended so far, for the builder to
+         * check them as they come in.
+         */
+        static size_t size(const mutable_strptr_type& str) {
+            return str.get() ? str->size() : 0;
+        }
+
+        static codeunit_iterator_type codeunit_begin(const mutable_strptr_type& str) {
+            const string_type& buffer = str.get() ? *str : empty_string;
+            return buffer.begin();
+        }
+
+        static codeunit_iterator_type codeunit_end(const mutable_strptr_type& str) {
+            const string_type& buffer = str.get() ? *str : empty_string;
+            return buffer.end();
+        }
+
         static void check_and_initialize(mutable_strptr_type& str) {
             if(!str.get()) {
                 str.reset(new_string());
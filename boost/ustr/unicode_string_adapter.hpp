@@ -4,21 +4,32 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
+#pragma once
+
 #include <string>
 #include <algorithm>
 #include <iterator>
+#include <stdexcept>
 #include <boost/static_assert.hpp>
 #include <boost/concept_check.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/remove_const.hpp>
 #include <boost/ustr/policy.hpp>
 #include <boost/ustr/string_traits.hpp>
 #include <boost/ustr/detail/encoding_traits.hpp>
+#include <boost/ustr/detail/transcode.hpp>
+#include <boost/ustr/detail/compare.hpp>
+#include <boost/ustr/detail/hash.hpp>
 #include <boost/ustr/detail/incl.hpp>
 #include <boost/ustr/detail/util.hpp>
 #include <boost/ustr/policy.hpp>
 #include <boost/ustr/detail/unicode_string_adapter_concepts.hpp>
 
+#ifdef BOOST_USTR_CPP0X
+#include <functional>
+#endif
+
 #define USTR(str) \
     ::boost::ustr::unicode_string_adapter< USTR_STRING_TYPE >(USTR_RAW(str))
 
@@ -64,9 +75,28 @@ std::ostream&
 operator <<(std::ostream& out, 
     const unicode_string_adapter<StringT, StringTraits, EncoderTraits, Policy>& str)
 {
+    if(str.is_slice()) {
+        return out << StringTraits::string::from_iter(str.codeunit_begin(), str.codeunit_end());
+    }
+
     return out << *str;
 }
 
+/*
+ * Found by boost::hash through argument dependent lookup.
+ */
+template <
+    typename StringT,
+    typename StringTraits,
+    typename EncoderTraits,
+    typename Policy
+>
+size_t hash_value(
+    const unicode_string_adapter<StringT, StringTraits, EncoderTraits, Policy>& str)
+{
+    return str.hash();
+}
+
 /*!
  * Unicode String Adapter class
  *
@@ -134,6 +164,7 @@ class unicode_string_adapter
     typedef const codepoint_type*                                   const_pointer;
 
     static const size_t codeunit_size = string_traits::codeunit_size;
+    static const size_t npos = static_cast<size_t>(-1);
 
     BOOST_CONCEPT_ASSERT((unicode_string_adapter_concepts<StringT, StringTraits, encoding_traits>));
 
@@ -151,7 +182,7 @@ class unicode_string_adapter
                  == codeunit_size));
 
         mutable_adapter_type buffer;
-        std::copy(begin, end, buffer.codeunit_begin());
+        buffer.append_codeunits(begin, end);
 
         return buffer.freeze();
     }
@@ -163,7 +194,7 @@ class unicode_string_adapter
                  == sizeof(codepoint_type)));
 
         mutable_adapter_type buffer;
-        std::copy(begin, end, buffer.begin());
+        buffer.append_codepoints(begin, end);
 
         return buffer.freeze();
     }
@@ -175,6 +206,10 @@ class unicode_string_adapter
                encoder_traits, policy>(current, begin, end);
     }
 
+    /*
+     * Adapter sharing a buffer. Buffers validated before, which keep their
+     * code point length in their metadata, are shared without a rescan.
+     */
     static this_type from_const_strptr(const const_strptr_type& other) {
         this_type str;
         str._buffer = other;
@@ -191,18 +226,19 @@ class unicode_string_adapter
         return str;
     }
 
-    unicode_string_adapter() : _buffer() { }
+    unicode_string_adapter() :
+        _buffer(), _offset(0), _length(whole_buffer)
+    { }
 
     /*
      * Implicit lightweight copy construction from other const adapter.
      * The two const adapter will share the same underlying buffer since 
-     * they are immutable.
+     * they are immutable. The buffer of other has been validated already,
+     * so copying costs a reference count increment whatever its length.
      */
     unicode_string_adapter(const this_type& other) :
-        _buffer(other.get_buffer())
-    {
-        validate();
-    }
+        _buffer(other.get_buffer()), _offset(other._offset), _length(other._length)
+    { }
 
     /*
      * Implicit lightweight move construction from other const adapter.
@@ -211,32 +247,51 @@ class unicode_string_adapter
      */
 #ifndef BOOST_NO_RVALUE_REFERENCES
     unicode_string_adapter(this_type&& other) :
-        _buffer(std::move(other._buffer))
-    {
-        validate();
+        _buffer(std::move(other._buffer)), _offset(other._offset), _length(other._length)
+    { }
+#endif
+
+    /*
+     * Assignment rebinds the adapter to the buffer of the other adapter
+     * without touching the content of either buffer, which lets adapters
+     * be sorted and held in containers that move their elements around.
+     * It is available for string traits with an assignable const_strptr_type.
+     */
+    this_type& operator =(const this_type& other) {
+        _buffer = other._buffer;
+        _offset = other._offset;
+        _length = other._length;
+        return *this;
+    }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    this_type& operator =(this_type&& other) {
+        _buffer = std::move(other._buffer);
+        _offset = other._offset;
+        _length = other._length;
+        return *this;
     }
 #endif
 
     /*
      * Implicit conversion from any const adapter of different encodings.
+     * The converted buffer is frozen with its code point length, so that
+     * length() stays constant time.
      */
     template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
     unicode_string_adapter(const unicode_string_adapter<
-                StringT_, StringTraits_, EncodingTraits_>& other)
-    {
-        mutable_adapter_type buffer;
-        buffer.append(other);
-
-        string_traits::const_strptr::reset(_buffer, buffer.release());
-    }
+                StringT_, StringTraits_, EncodingTraits_>& other) :
+        _buffer(convert(other).get_buffer()), _offset(0), _length(whole_buffer)
+    { }
 
     /*
      * Explicit construction from a raw string reference.
      * A new copy of string content is allocated.
      */
     explicit unicode_string_adapter(const string_type& other) :
-        _buffer(string_traits::new_string(other))
+        _buffer(), _offset(0), _length(whole_buffer)
     {
+        string_traits::const_strptr::reset(_buffer, string_traits::new_string(other));
         validate();
     }
 
@@ -245,7 +300,7 @@ class unicode_string_adapter
      */
 #ifndef BOOST_NO_RVALUE_REFERENCES
     explicit unicode_string_adapter(const_strptr_type&& other) :
-        _buffer(std::forward<const_strptr_type>(other))
+        _buffer(std::forward<const_strptr_type>(other)), _offset(0), _length(whole_buffer)
     {
         validate();
     }
@@ -256,8 +311,9 @@ class unicode_string_adapter
      * Explicit copy construction from existing mutable adapter.
      */
     explicit unicode_string_adapter(const mutable_adapter_type& other) :
-        _buffer(other.clone_buffer())
+        _buffer(), _offset(0), _length(whole_buffer)
     {
+        string_traits::const_strptr::reset(_buffer, other.clone_buffer());
         validate();
     }
 
@@ -267,50 +323,211 @@ class unicode_string_adapter
      */
 #ifndef BOOST_NO_RVALUE_REFERENCES
     unicode_string_adapter(mutable_adapter_type&& other) :
-        _buffer(other.release())
+        _buffer(), _offset(0), _length(whole_buffer)
     {
+        string_traits::const_strptr::reset(_buffer, other.release());
         validate();
     }
 #endif
 
+    /*
+     * Appends a copy of the code units of this string to builder, which
+     * can then be edited without touching this string.
+     */
+    void edit(mutable_adapter_type& builder) const {
+        builder.append(*this);
+    }
+
+    /*
+     * Builder holding a copy of the code units of this string. Builders
+     * cannot be copied, so returning one takes move construction.
+     */
+#ifndef BOOST_NO_RVALUE_REFERENCES
     mutable_adapter_type edit() const {
-        const raw_strptr_type original_buffer = string_traits::const_strptr::get(_buffer);
-        raw_strptr_type new_buffer = string_traits::clone_string(original_buffer);
-        return mutable_adapter_type(new_buffer);
+        mutable_adapter_type buffer;
+        edit(buffer);
+
+        return buffer;
     }
+#endif
 
     codepoint_iterator_type begin() {
-        return codepoint_iterator_type(
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_end(_buffer));
+        return codepoint_iterator_type(codeunit_begin(), codeunit_begin(), codeunit_end());
     }
 
     const codepoint_iterator_type begin() const {
-        return codepoint_iterator_type(
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_end(_buffer));
+        return codepoint_iterator_type(codeunit_begin(), codeunit_begin(), codeunit_end());
     }
 
     codepoint_iterator_type end() {
-        return codepoint_iterator_type(
-                string_traits::const_strptr::codeunit_end(_buffer),
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_end(_buffer));
+        return codepoint_iterator_type(codeunit_end(), codeunit_begin(), codeunit_end());
     }
 
     const codepoint_iterator_type end() const {
-        return codepoint_iterator_type(
-                string_traits::const_strptr::codeunit_end(_buffer),
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_end(_buffer));
+        return codepoint_iterator_type(codeunit_end(), codeunit_begin(), codeunit_end());
     }
 
     const_strptr_type get_buffer() const {
         return _buffer;
     }
 
+    codeunit_iterator_type codeunit_begin() const {
+        codeunit_iterator_type begin = string_traits::const_strptr::codeunit_begin(_buffer);
+
+        if(is_slice()) {
+            std::advance(begin, _offset);
+        }
+        return begin;
+    }
+
+    codeunit_iterator_type codeunit_end() const {
+        if(is_slice()) {
+            codeunit_iterator_type end = string_traits::const_strptr::codeunit_begin(_buffer);
+            std::advance(end, _offset + _length);
+            return end;
+        }
+
+        return string_traits::const_strptr::codeunit_end(_buffer);
+    }
+
+    /*
+     * Zero copy substring of the code points from first to last, two
+     * iterators of this string. The slice shares the buffer of this string
+     * and keeps it alive, and refers to the code units between the two
+     * iterators. As iterators always sit on code point boundaries, the slice
+     * is as well formed as this string and is not validated again.
+     */
+    this_type slice(const codepoint_iterator_type& first, const codepoint_iterator_type& last) const {
+        codeunit_iterator_type buffer_begin = string_traits::const_strptr::codeunit_begin(_buffer);
+
+        return this_type(_buffer,
+            std::distance(buffer_begin, first.get_codeunit_iterator()),
+            std::distance(first.get_codeunit_iterator(), last.get_codeunit_iterator()));
+    }
+
+    /*
+     * Slice of count code points starting from the code point at position
+     * pos, or of as many as there are. Finding the positions walks the code
+     * points before them.
+     */
+    this_type substr(size_t pos, size_t count = npos) const {
+        const codepoint_iterator_type last = end();
+        codepoint_iterator_type first = begin();
+
+        for(; pos != 0 && first != last; --pos) {
+            ++first;
+        }
+
+        codepoint_iterator_type current = first;
+        for(; count != 0 && current != last; --count) {
+            ++current;
+        }
+
+        return slice(first, current);
+    }
+
+    /*
+     * The code point at position n, throwing std::out_of_range if there is
+     * none. Contiguous well formed strings look it up in a code point index
+     * that is built on the first random access and shared with the buffer,
+     * slices included, so that it takes a walk of at most a fixed number of
+     * code points. Other strings walk the code points before it.
+     */
+    codepoint_type at(size_t n) const {
+        const util::codepoint_index* index = random_access_index(true);
+
+        if(index) {
+            size_t first = is_slice() ? index_position(*index, codeunit_begin()) : 0;
+            size_t last = is_slice() ? index_position(*index, codeunit_end()) : index->length();
+
+            if(n >= last - first) {
+                throw std::out_of_range("unicode_string_adapter::at");
+            }
+
+            codeunit_iterator_type current = index_iterator(*index, first + n);
+            return encoder_traits::decode(current, codeunit_end(), policy());
+        }
+
+        const codepoint_iterator_type last = end();
+        codepoint_iterator_type current = begin();
+
+        for(; n != 0 && current != last; --n) {
+            ++current;
+        }
+
+        if(current == last) {
+            throw std::out_of_range("unicode_string_adapter::at");
+        }
+        return *current;
+    }
+
+    /*
+     * Moves the iterator it of this string by n code points, which must stay
+     * within the string. Moves of more than a few code points go through the
+     * code point index like at().
+     */
+    void advance(codepoint_iterator_type& it, ptrdiff_t n) const {
+        const ptrdiff_t interval = util::codepoint_index::interval;
+        const util::codepoint_index* index =
+            (n >= interval || n <= -interval) ? random_access_index(true) : 0;
+
+        if(index) {
+            size_t position = index_position(*index, it.get_codeunit_iterator()) + n;
+            it = codepoint_iterator_type(
+                index_iterator(*index, position), codeunit_begin(), codeunit_end());
+        } else {
+            std::advance(it, n);
+        }
+    }
+
+    /*
+     * Number of code points from first to last, two iterators of this string
+     * with first not after last, like std::distance(). It is looked up in the
+     * code point index if one has already been built, and otherwise counted
+     * by ustr::distance(), which costs no more than building the index would.
+     */
+    ptrdiff_t distance(const codepoint_iterator_type& first, const codepoint_iterator_type& last) const {
+        const util::codepoint_index* index = random_access_index(false);
+
+        if(index) {
+            return static_cast<ptrdiff_t>(index_position(*index, last.get_codeunit_iterator())) -
+                static_cast<ptrdiff_t>(index_position(*index, first.get_codeunit_iterator()));
+        }
+
+        return codepoint_iterator_type::distance(first, last);
+    }
+
+    /*
+     * Whether the adapter refers to only part of its buffer.
+     */
+    bool is_slice() const {
+        return _length != whole_buffer;
+    }
+
+    /*
+     * Whether the code units spell every code point in as few code units as
+     * it takes, so that they match those of any equal string in the same
+     * encoding. It is worked out once for each shared buffer, and a slice
+     * of a buffer in the shortest form is in the shortest form as well.
+     */
+    bool shortest_form() const {
+        util::buffer_metadata* metadata = string_traits::const_strptr::metadata(_buffer);
+
+        if(metadata && metadata->has_shortest_form() &&
+            (metadata->shortest_form() || !is_slice()))
+        {
+            return metadata->shortest_form();
+        }
+
+        bool shortest = encoding_traits::shortest_form(codeunit_begin(), codeunit_end());
+
+        if(metadata && !is_slice()) {
+            metadata->set_shortest_form(shortest);
+        }
+
+        return shortest;
+    }
+
     reverse_iterator rbegin() {
         return reverse_iterator(end());
     }
@@ -320,11 +537,15 @@ class unicode_string_adapter
     }
 
     /*
-     * Create a string object on stack from the underlying string object on heap.
-     * It is not possible to return a reference as the new string object is created
-     * on the fly.
+     * The underlying string object. Slices share the string of the adapter they are
+     * cut from, so a slice is first given a buffer of its own holding only its code
+     * units, which it refers to from then on. The slice object is rebound by that
+     * first call, so it must not race with other uses of the same slice object.
      */
     const string_type& to_string() const {
+        if(is_slice()) {
+            materialize();
+        }
         return *string_traits::const_strptr::get(_buffer);
     }
 
@@ -341,24 +562,79 @@ class unicode_string_adapter
         typedef unicode_string_adapter<
             StringT_, StringTraits_, EncodingTraits_>       other_type;
         typedef typename
-            other_type::codepoint_iterator_type             other_codepoint_iterator_type;
+            other_type::encoding_traits                     other_encoding_traits;
 
-        if(other.codepoint_length() != codepoint_length()) {
-            return false;
-        }
+        const util::buffer_metadata* metadata = buffer_metadata();
+        const util::buffer_metadata* other_metadata = other.buffer_metadata();
 
-        codepoint_iterator_type it = begin();
-        other_codepoint_iterator_type other_it = other.begin();
+        if(metadata && other_metadata) {
+            // adapters sharing one buffer through the same encoding
+            if(metadata == other_metadata &&
+                boost::is_same<encoding_traits, other_encoding_traits>::value)
+            {
+                return true;
+            }
 
-        while(it != end()) {
-            if(*it != *other_it) {
+            if(metadata->has_codepoint_length() && other_metadata->has_codepoint_length() &&
+                metadata->codepoint_length() != other_metadata->codepoint_length())
+            {
                 return false;
             }
-            ++it;
-            ++other_it;
         }
 
-        return true;
+        return util::codepoint_compare<encoding_traits, other_encoding_traits>::equals(
+                codeunit_begin(), codeunit_end(),
+                other.codeunit_begin(), other.codeunit_end(),
+                shortest_form() && other.shortest_form());
+    }
+
+    /*
+     * Three-way comparison of the code points of two string adapters of any
+     * encodings, returning a negative value, zero or a positive value as this
+     * string orders before, the same as or after the other. Like operator ==,
+     * it compares code points without normalization.
+     */
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    int compare(const unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>& other) const
+    {
+        typedef unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>       other_type;
+        typedef typename
+            other_type::encoding_traits                     other_encoding_traits;
+
+        return util::codepoint_compare<encoding_traits, other_encoding_traits>::compare(
+                codeunit_begin(), codeunit_end(),
+                other.codeunit_begin(), other.codeunit_end(),
+                shortest_form() && other.shortest_form());
+    }
+
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    bool operator <(const unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>& other) const
+    {
+        return compare(other) < 0;
+    }
+
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    bool operator >(const unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>& other) const
+    {
+        return compare(other) > 0;
+    }
+
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    bool operator <=(const unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>& other) const
+    {
+        return compare(other) <= 0;
+    }
+
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    bool operator >=(const unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>& other) const
+    {
+        return compare(other) >= 0;
     }
 
     template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
@@ -386,28 +662,223 @@ class unicode_string_adapter
         return codepoint_length();
     }
 
+    /*
+     * The code point length is counted once by validate() and kept with
+     * the shared buffer, so that it is constant time for every copy.
+     */
     size_t codepoint_length() const {
-        size_t length = 0;
-        for(codepoint_iterator_type it = begin(); it != end(); ++it) {
-            ++length;
+        const util::buffer_metadata* metadata = buffer_metadata();
+
+        if(metadata && metadata->has_codepoint_length()) {
+            return metadata->codepoint_length();
+        }
+
+        // validate() leaves malformed code units in place
+        // only if the policy does not replace them
+        if(!encoding_traits::replace_malformed) {
+            return codepoint_iterator_type::distance(begin(), end());
         }
-        return length;
+
+        return encoding_traits::codepoint_length(codeunit_begin(), codeunit_end());
+    }
+
+    /*
+     * Hash of the code points, which is the same for equal strings in any
+     * encoding. Strings validated as well formed keep the hash with their
+     * shared buffer once computed, so it is constant time for every copy.
+     */
+    size_t hash() const {
+        util::buffer_metadata* metadata = encoding_traits::replace_malformed ?
+            buffer_metadata() : 0;
+
+        if(metadata && metadata->has_hash()) {
+            return metadata->hash();
+        }
+
+        size_t hash = util::codepoint_hash<encoding_traits>::hash(
+            codeunit_begin(), codeunit_end(), shortest_form());
+
+        if(metadata) {
+            metadata->set_hash(hash);
+        }
+
+        return hash;
     }
 
     void validate() {
-        bool valid = encoding_traits::validate(
-                string_traits::const_strptr::codeunit_begin(_buffer), 
-                string_traits::const_strptr::codeunit_end(_buffer));
+        // slices are cut on code point boundaries of a validated buffer
+        if(is_slice()) {
+            return;
+        }
+
+        util::buffer_metadata* metadata = buffer_metadata();
+        bool valid;
+
+        if(metadata && metadata->has_codepoint_length()) {
+            // only buffers found well formed have their length recorded,
+            // so buffers shared by other adapters are not scanned again
+            return;
+        } else if(metadata) {
+            size_t length;
+            valid = encoding_traits::validate(codeunit_begin(), codeunit_end(), length);
+
+            if(valid) {
+                metadata->set_codepoint_length(length);
+            }
+        } else {
+            valid = encoding_traits::validate(codeunit_begin(), codeunit_end());
+        }
 
         if(!valid && encoding_traits::replace_malformed) {
-            mutable_adapter_type sanitized;
-            sanitized.append(*this);
-            string_traits::const_strptr::reset(_buffer, sanitized.release());
+            mutable_strptr_type sanitized;
+            encoding_traits::sanitize(codeunit_begin(), codeunit_end(), sanitized);
+            string_traits::const_strptr::reset(_buffer, 
+                string_traits::mutable_strptr::release(sanitized));
+
+            metadata = buffer_metadata();
+            if(metadata) {
+                metadata->set_codepoint_length(
+                    encoding_traits::codepoint_length(codeunit_begin(), codeunit_end()));
+            }
         }
     }
 
   private:
-    const_strptr_type _buffer;
+    template <typename StringT_, typename StringTraits_, typename EncoderTraits_, typename Policy_>
+    friend class unicode_string_adapter;
+
+    template <typename StringT_, typename StringTraits_, typename EncoderTraits_, typename Policy_>
+    friend class unicode_string_adapter_builder;
+
+    template <typename StringT_, typename StringTraits_, typename EncodingTraits_>
+    static this_type convert(const unicode_string_adapter<
+        StringT_, StringTraits_, EncodingTraits_>& other)
+    {
+        mutable_adapter_type buffer;
+        buffer.append(other);
+        return buffer.freeze();
+    }
+
+    /*
+     * Takes over a buffer the builder has already checked to be well formed,
+     * together with its code point length, without validating it again.
+     */
+    static this_type from_validated_ptr(raw_strptr_type other, size_t length) {
+        this_type str;
+        string_traits::const_strptr::reset(str._buffer, other);
+
+        util::buffer_metadata* metadata = str.buffer_metadata();
+        if(metadata) {
+            metadata->set_codepoint_length(length);
+        }
+
+        return str;
+    }
+
+    static const size_t whole_buffer = npos;
+
+    /*
+     * The code point index is kept only for random access code units, and
+     * only for well formed buffers, whose code points are the same through
+     * any adapter sharing the buffer.
+     */
+    static const bool indexable =
+        encoding_traits::replace_malformed &&
+        boost::is_same<typename std::iterator_traits<codeunit_iterator_type>::iterator_category,
+            std::random_access_iterator_tag>::value;
+
+    const util::codepoint_index* random_access_index(bool build) const {
+        util::buffer_metadata* metadata =
+            indexable ? string_traits::const_strptr::metadata(_buffer) : 0;
+
+        if(!metadata) {
+            return 0;
+        }
+
+        const util::codepoint_index* index = metadata->index();
+        if(!index && build) {
+            index = metadata->set_index(util::codepoint_index::build<encoding_traits>(
+                string_traits::const_strptr::codeunit_begin(_buffer),
+                string_traits::const_strptr::codeunit_end(_buffer)));
+        }
+
+        return index;
+    }
+
+    /*
+     * Position in the whole buffer of the code point at the code unit iterator.
+     */
+    size_t index_position(const util::codepoint_index& index, codeunit_iterator_type it) const {
+        codeunit_iterator_type current = string_traits::const_strptr::codeunit_begin(_buffer);
+        const codeunit_iterator_type buffer_end = string_traits::const_strptr::codeunit_end(_buffer);
+
+        size_t position = index.position_before(std::distance(current, it));
+        std::advance(current, index.offset_before(position));
+
+        for(; current != it; ++position) {
+            encoder_traits::decode(current, buffer_end, policy());
+        }
+
+        return position;
+    }
+
+    /*
+     * Code unit iterator at the code point at position in the whole buffer.
+     */
+    codeunit_iterator_type index_iterator(const util::codepoint_index& index, size_t position) const {
+        codeunit_iterator_type current = string_traits::const_strptr::codeunit_begin(_buffer);
+        const codeunit_iterator_type buffer_end = string_traits::const_strptr::codeunit_end(_buffer);
+
+        if(position >= index.length()) {
+            return buffer_end;
+        }
+
+        std::advance(current, index.offset_before(position));
+
+        for(size_t i = position % util::codepoint_index::interval; i != 0; --i) {
+            encoder_traits::decode(current, buffer_end, policy());
+        }
+
+        return current;
+    }
+
+    unicode_string_adapter(const const_strptr_type& buffer, size_t offset, size_t length) :
+        _buffer(buffer), _offset(offset), _length(length)
+    { }
+
+    /*
+     * Rebinds a slice to a copy of its code units, which are well formed
+     * and keep their code point length.
+     */
+    void materialize() const {
+        size_t length = codepoint_length();
+
+        mutable_adapter_type buffer;
+        edit(buffer);
+
+        string_traits::const_strptr::reset(_buffer, buffer.release());
+        _offset = 0;
+        _length = whole_buffer;
+
+        util::buffer_metadata* metadata = buffer_metadata();
+        if(metadata) {
+            metadata->set_codepoint_length(length);
+        }
+    }
+
+    /*
+     * The metadata describes the whole buffer, so slices have none.
+     */
+    util::buffer_metadata* buffer_metadata() const {
+        return is_slice() ? 0 : string_traits::const_strptr::metadata(_buffer);
+    }
+
+    // rebound by to_string() when a slice is materialized
+    mutable typename boost::remove_const<const_strptr_type>::type _buffer;
+
+    // code unit window of slices into the buffer
+    mutable size_t _offset;
+    mutable size_t _length;
 };
 
 template <
@@ -470,13 +941,17 @@ class unicode_string_adapter_builder
     BOOST_CONCEPT_ASSERT((unicode_string_adapter_concepts<StringT, StringTraits, encoding_traits>));
 
     unicode_string_adapter_builder() :
-        _buffer()
+        _buffer(), _checked(0), _checked_length(0), _pending(false), _malformed(false)
     { }
 
 #ifndef BOOST_NO_RVALUE_REFERENCES
     unicode_string_adapter_builder(this_type&& other) :
-        _buffer(string_traits::mutable_strptr::release(other._buffer))
-    { }
+        _buffer(string_traits::mutable_strptr::release(other._buffer)),
+        _checked(other._checked), _checked_length(other._checked_length),
+        _pending(other._pending), _malformed(other._malformed)
+    {
+        other.reset_validation();
+    }
 #endif
 
     raw_strptr_type clone_buffer() {
@@ -486,6 +961,7 @@ class unicode_string_adapter_builder
     }
 
     raw_strptr_type release() {
+        reset_validation();
         return string_traits::mutable_strptr::release(_buffer);
     }
 
@@ -498,13 +974,26 @@ class unicode_string_adapter_builder
      *      unicode_string_adapter(const unicode_string_adapter_builder&)
      *
      * is that the above is a copy construction where a new copy of string is created.
+     *
+     * Only the code units not checked while they were appended are validated,
+     * unless some of them turned out malformed, in which case the whole buffer
+     * goes through validation as in from_ptr().
      */
     const_adapter_type freeze() {
-        return const_adapter_type::from_ptr(string_traits::mutable_strptr::release(_buffer));
+        bool valid = check_pending(true);
+        size_t length = _checked_length;
+
+        raw_strptr_type buffer = release();
+
+        return valid ?
+            const_adapter_type::from_validated_ptr(buffer, length) :
+            const_adapter_type::from_ptr(buffer);
     }
 
     const_adapter_type freeze_copy() {
-        return const_adapter_type::from_ptr(clone_buffer());
+        return check_pending(true) ?
+            const_adapter_type::from_validated_ptr(clone_buffer(), _checked_length) :
+            const_adapter_type::from_ptr(clone_buffer());
     }
 
     codepoint_output_iterator_type begin() {
@@ -529,13 +1018,40 @@ class unicode_string_adapter_builder
      * The append operation is not thread safe
      */
     void append_codepoint(const codepoint_type& codepoint) {
-        encoding_traits::append_codepoint(_buffer, codepoint);
+        // the encoder writes well formed code units for any code point
+        // except surrogates, which UTF-8 and UTF-32 encode as they are
+        if(0xD800 <= codepoint && codepoint <= 0xDFFF) {
+            begin_unchecked();
+            encoding_traits::append_codepoint(_buffer, codepoint);
+            end_unchecked();
+        } else {
+            encoding_traits::append_codepoint(_buffer, codepoint);
+            append_checked(1);
+        }
     }
 
     void push_back(const codepoint_type& codepoint) {
         append_codepoint(codepoint);
     }
 
+    /*
+     * Appends a range of code points. Code points held in contiguous memory
+     * are encoded in bulk into space allocated once for the whole range.
+     */
+    template <typename CodepointIterator>
+    void append_codepoints(CodepointIterator begin, CodepointIterator end) {
+        append_codepoints(begin, end, boost::integral_constant<bool,
+                util::is_contiguous_iterator<CodepointIterator>::value>());
+    }
+
+    /*
+     * Makes room for codeunit_length more code units, so that appending
+     * them does not reallocate the buffer.
+     */
+    void reserve(size_t codeunit_length) {
+        string_traits::mutable_strptr::reserve_space(_buffer, codeunit_length);
+    }
+
     template <typename CodeUnit>
     void append_codeunit(const CodeUnit& codeunit) {
         // make sure that the code unit is that same size as the string
@@ -544,10 +1060,38 @@ class unicode_string_adapter_builder
         // make coercion towards arguments of different size.
         BOOST_STATIC_ASSERT(sizeof(CodeUnit) == codeunit_size);
         
-        // For simplicity at this moment, we'll leave the encoding validation 
-        // during freeze().
+        // The code units are validated a block at a time as they pile up,
+        // and whatever is left by freeze().
+        begin_unchecked();
         string_traits::mutable_strptr::append(_buffer, 
                 static_cast<codeunit_type>(codeunit));
+        end_unchecked();
+    }
+
+    /*
+     * Appends length encoded code units in one go. As with append_codeunit(),
+     * the code units are validated later on, by freeze() at the latest.
+     */
+    void append_codeunits(const codeunit_type* codeunits, size_t length) {
+        begin_unchecked();
+        string_traits::mutable_strptr::append(_buffer, codeunits, codeunits + length);
+        end_unchecked();
+    }
+
+    /*
+     * Appends a range of encoded code units with a single insertion into the
+     * buffer, which copies contiguous ranges in bulk and allocates once for
+     * ranges of known length.
+     */
+    template <typename CodeunitIterator>
+    void append_codeunits(CodeunitIterator begin, CodeunitIterator end) {
+        BOOST_STATIC_ASSERT((
+                 sizeof(typename std::iterator_traits<CodeunitIterator>::value_type)
+                 == codeunit_size));
+
+        begin_unchecked();
+        string_traits::mutable_strptr::append(_buffer, begin, end);
+        end_unchecked();
     }
 
     template <
@@ -555,10 +1099,58 @@ class unicode_string_adapter_builder
     void append(const unicode_string_adapter<
         StringT_, StringTraits_, EncodingTraits_>& str) {
 
-        // size_t codeunit_length = encoding_traits::estimate_codeunit_length(str.codepoint_length());
-        // string_traits::mutable_strptr::reserve_space(_buffer, codeunit_length);
+        typedef typename unicode_string_adapter<
+            StringT_, StringTraits_, EncodingTraits_>::encoding_traits  source_encoding_traits;
+
+        typedef util::transcoder<
+            source_encoding_traits, encoding_traits>                    transcoder;
+
+        // the remaining strategies grow the buffer code point by code point,
+        // which only contiguous buffers can make room for beforehand
+        if(!transcoder::template exact_length<
+                typename source_encoding_traits::codeunit_iterator_type>::value &&
+            encoding_traits::has_kernel::value)
+        {
+            reserve(encoding_traits::estimate_codeunit_length(str.codepoint_length()));
+        }
+
+        // strings that replace malformed code units are well formed, and
+        // so is their conversion; the others are checked like raw code units
+        if(source_encoding_traits::replace_malformed) {
+            transcoder::append(str.codeunit_begin(), str.codeunit_end(), _buffer);
 
-        std::copy(str.begin(), str.end(), begin());
+            if(checking()) {
+                append_checked(str.codepoint_length());
+            }
+        } else {
+            begin_unchecked();
+            transcoder::append(str.codeunit_begin(), str.codeunit_end(), _buffer);
+            end_unchecked();
+        }
+    }
+
+    /*
+     * Appends well formed code units of the encoding of SourceEncodingTraits
+     * holding codepoint_length code points, converted in bulk as by append().
+     * For code units known to be well formed without being held by an
+     * adapter, such as those checked by a streaming decoder.
+     */
+    template <typename SourceEncodingTraits, typename CodeunitIterator>
+    void append_transcoded(CodeunitIterator begin, CodeunitIterator end, size_t codepoint_length) {
+        typedef util::transcoder<
+            SourceEncodingTraits, encoding_traits>                      transcoder;
+
+        if(!transcoder::template exact_length<CodeunitIterator>::value &&
+            encoding_traits::has_kernel::value)
+        {
+            reserve(encoding_traits::estimate_codeunit_length(codepoint_length));
+        }
+
+        transcoder::append(begin, end, _buffer);
+
+        if(checking()) {
+            append_checked(codepoint_length);
+        }
     }
 
     /*
@@ -609,13 +1201,160 @@ class unicode_string_adapter_builder
     };
 
   private:
+    /*
+     * The builder keeps track of how much of the buffer is known to be well
+     * formed, so that freeze() need not validate it all over again.
+     *
+     * While nothing is pending, the whole buffer is well formed and only
+     * its code point length is counted. Code units that did not come from
+     * the encoder open a pending region starting at _checked, which is
+     * validated once it grows past pending_limit code units, and by freeze()
+     * at the latest. A code point cut short at the end of the region stays
+     * pending, as the next code units appended may complete it. Malformed
+     * code units stop the tracking altogether, leaving freeze() to validate
+     * and sanitize the whole buffer.
+     *
+     * Checking the buffer in place needs the code units to be contiguous,
+     * so other buffers are always validated by freeze().
+     */
+    static const bool tracks_validation = encoding_traits::has_kernel::value;
+    static const size_t pending_limit = 64 * 1024;
+
+    bool checking() const {
+        return tracks_validation && !_pending && !_malformed;
+    }
+
+    void append_checked(size_t codepoint_length) {
+        if(checking()) {
+            _checked_length += codepoint_length;
+        }
+    }
+
+    void begin_unchecked() {
+        if(checking()) {
+            _checked = string_traits::mutable_strptr::size(_buffer);
+            _pending = true;
+        }
+    }
+
+    void end_unchecked() {
+        if(_pending && string_traits::mutable_strptr::size(_buffer) - _checked >= pending_limit) {
+            check_pending(false);
+        }
+    }
+
+    /*
+     * Validates the pending code units and tells whether the buffer is still
+     * known to be well formed. With complete set, a code point cut short at
+     * the end is malformed too, as nothing else is going to be appended.
+     */
+    bool check_pending(bool complete) {
+        if(!tracks_validation || _malformed) {
+            return false;
+        }
+
+        if(_pending) {
+            codeunit_iterator_type current = string_traits::mutable_strptr::codeunit_begin(_buffer);
+            codeunit_iterator_type end = string_traits::mutable_strptr::codeunit_end(_buffer);
+            std::advance(current, _checked);
+
+            if(!encoding_traits::validate_prefix(current, end, _checked_length)) {
+                _malformed = true;
+                return false;
+            }
+
+            _checked = std::distance(
+                string_traits::mutable_strptr::codeunit_begin(_buffer), current);
+            _pending = current != end;
+
+            if(_pending && complete) {
+                _malformed = true;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void reset_validation() {
+        _checked = 0;
+        _checked_length = 0;
+        _pending = false;
+        _malformed = false;
+    }
+
+    template <typename CodepointIterator>
+    void append_codepoints(CodepointIterator begin, CodepointIterator end, boost::true_type) {
+        typedef utf_encoding_traits<
+            ustr::string_traits< std::vector<codepoint_type> >,
+            util::utf32_encoder, policy>                            source_encoding_traits;
+
+        BOOST_STATIC_ASSERT((
+                 sizeof(typename std::iterator_traits<CodepointIterator>::value_type)
+                 == sizeof(codepoint_type)));
+
+        if(begin == end) {
+            return;
+        }
+
+        const codepoint_type* first =
+            reinterpret_cast<const codepoint_type*>(util::to_pointer(begin));
+        const codepoint_type* last = first + (end - begin);
+
+        // code points that are all scalar values encode to well formed code units
+        if(!checking() || util::encoder_kernel<util::utf32_encoder>::validate(first, last)) {
+            util::transcoder<source_encoding_traits, encoding_traits>::append(first, last, _buffer);
+            append_checked(last - first);
+        } else {
+            begin_unchecked();
+            util::transcoder<source_encoding_traits, encoding_traits>::append(first, last, _buffer);
+            end_unchecked();
+        }
+    }
+
+    template <typename CodepointIterator>
+    void append_codepoints(CodepointIterator begin, CodepointIterator end, boost::false_type) {
+        if(encoding_traits::has_kernel::value) {
+            reserve(encoding_traits::estimate_codeunit_length(util::known_distance(begin, end)));
+        }
+
+        std::copy(begin, end, this->begin());
+    }
+
     unicode_string_adapter_builder(const this_type&);
     bool operator ==(const this_type&) const;
     this_type& operator =(const this_type&);
 
     mutable_strptr_type _buffer;
+
+    size_t _checked;
+    size_t _checked_length;
+    bool _pending;
+    bool _malformed;
 };
 
 
 } // namespace ustr
 } // namespace boost
+
+#ifdef BOOST_USTR_CPP0X
+namespace std {
+
+template <
+    typename StringT,
+    typename StringTraits,
+    typename EncoderTraits,
+    typename Policy
+>
+struct hash< boost::ustr::unicode_string_adapter<
+    StringT, StringTraits, EncoderTraits, Policy> >
+{
+    size_t operator()(const boost::ustr::unicode_string_adapter<
+        StringT, StringTraits, EncoderTraits, Policy>& str) const
+    {
+        return str.hash();
+    }
+};
+
+} // namespace std
+#endif
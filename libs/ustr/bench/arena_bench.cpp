@@ -0,0 +1,94 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/arena_string_traits.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Request scoped text: each request builds a few thousand strings from
+ * its input, joins some of them and throws all of them away. The default
+ * string traits go through the heap for every string, arena_string_traits
+ * through a monotonic arena reset after each request.
+ */
+
+typedef unicode_string_adapter<
+    arena_string_traits<char>::string_type, arena_string_traits<char> >   arena_u8_string;
+
+template <typename String>
+void handle_request(const std::vector<std::string>& input) {
+    std::vector<String> strings;
+    strings.reserve(input.size());
+
+    for(size_t i = 0; i < input.size(); ++i) {
+        strings.push_back(String::from_codeunits(input[i].begin(), input[i].end()));
+    }
+
+    typename String::mutable_adapter_type joined;
+    for(size_t i = 0; i < strings.size(); i += 8) {
+        joined.append(strings[i]);
+    }
+
+    do_not_optimize(joined.freeze());
+}
+
+struct heap_requests {
+    const std::vector<std::string>* input;
+    void operator()() const {
+        for(int i = 0; i < 10; ++i) {
+            handle_request<u8_string>(*input);
+        }
+    }
+};
+
+struct arena_requests {
+    const std::vector<std::string>* input;
+    util::monotonic_arena* arena;
+    void operator()() const {
+        for(int i = 0; i < 10; ++i) {
+            {
+                util::monotonic_arena::scope scope(*arena);
+                handle_request<arena_u8_string>(*input);
+            }
+            arena->reset();
+        }
+    }
+};
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Anderson ");
+    fragments.push_back("M\xC3\xBCller ");
+    fragments.push_back("\xE7\x8E\x8B ");
+    fragments.push_back("Smithers ");
+    fragments.push_back("\xF0\x9F\x98\x80 ");
+
+    std::vector<std::string> input;
+    size_t bytes = 0;
+    unsigned int seed = 7;
+
+    while(input.size() < 4000) {
+        std::string str;
+        for(int i = 0; i < 4; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            str += fragments[(seed >> 16) % fragments.size()];
+        }
+
+        input.push_back(str);
+        bytes += 10 * str.size();
+    }
+
+    util::monotonic_arena arena;
+    heap_requests heap_benchmark = { &input };
+    arena_requests arena_benchmark = { &input, &arena };
+
+    report("u8_string requests", bytes, measure(heap_benchmark));
+    report("arena u8 string requests", bytes, measure(arena_benchmark));
+}
@@ -0,0 +1,232 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Bulk operations on mostly ASCII text, next to a plain memcpy of the
+ * same number of bytes for reference.
+ */
+
+typedef unicode_string_adapter< std::vector<char> >         u8_vector;
+
+struct copy_bytes {
+    const std::string* str;
+    void operator()() const {
+        std::vector<char> copy(str->size());
+        std::memcpy(&copy[0], str->data(), str->size());
+        do_not_optimize(copy[copy.size() / 2]);
+    }
+};
+
+struct iterate {
+    const u8_string* str;
+    void operator()() const {
+        codepoint_type sum = 0;
+        for(u8_string::iterator it = str->begin(); it != str->end(); ++it) {
+            sum += *it;
+        }
+        do_not_optimize(sum);
+    }
+};
+
+struct length {
+    const u8_string* str;
+    void operator()() const {
+        do_not_optimize(str->length());
+    }
+};
+
+struct codepoint_distance {
+    const u8_string* str;
+    void operator()() const {
+        do_not_optimize(distance(str->begin(), str->end()));
+    }
+};
+
+struct count {
+    const u8_string* str;
+    void operator()() const {
+        do_not_optimize(u8_string::encoding_traits::codepoint_length(
+            str->codeunit_begin(), str->codeunit_end()));
+    }
+};
+
+struct copy_into_builder {
+    const u8_string* str;
+    void operator()() const {
+        u8_vector::mutable_adapter_type builder;
+        builder.append(*str);
+
+        u8_vector::mutable_strptr_type result(builder.release());
+        do_not_optimize(result->size());
+    }
+};
+
+struct transcode_into_builder {
+    const u8_string* str;
+    void operator()() const {
+        u16_string::mutable_adapter_type builder;
+        builder.append(*str);
+
+        u16_string::mutable_strptr_type result(builder.release());
+        do_not_optimize(result->size());
+    }
+};
+
+/*
+ * Splits the string on spaces, either into slices sharing its buffer
+ * or into new strings copied through a builder.
+ */
+template <bool Copy>
+struct tokenize {
+    const u8_string* str;
+    void operator()() const {
+        size_t total = 0;
+        u8_string::iterator first = str->begin();
+        const u8_string::iterator last = str->end();
+
+        while(first != last) {
+            u8_string::iterator current = first;
+            while(current != last && *current != ' ') {
+                ++current;
+            }
+
+            u8_string word = token(first, current);
+            total += word.codeunit_end() - word.codeunit_begin();
+
+            first = current;
+            if(first != last) {
+                ++first;
+            }
+        }
+        do_not_optimize(total);
+    }
+
+    u8_string token(const u8_string::iterator& first,
+        const u8_string::iterator& last) const
+    {
+        if(!Copy) {
+            return str->slice(first, last);
+        }
+
+        u8_string::mutable_adapter_type builder;
+        std::copy(first, last, builder.begin());
+        return builder.freeze();
+    }
+};
+
+/*
+ * Looks up code points spread over the whole string, either through
+ * at() and its code point index or by walking the code point iterators.
+ */
+template <bool Index>
+struct random_access {
+    const u8_string* str;
+    void operator()() const {
+        const size_t length = str->length();
+        codepoint_type sum = 0;
+
+        for(size_t n = 7; n < length; n += length / 64) {
+            if(Index) {
+                sum += str->at(n);
+            } else {
+                u8_string::iterator it = str->begin();
+                std::advance(it, n);
+                sum += *it;
+            }
+        }
+        do_not_optimize(sum);
+    }
+};
+
+template <typename String>
+struct hash {
+    const String* str;
+    void operator()() const {
+        do_not_optimize(util::codepoint_hash<typename String::encoding_traits>::hash(
+            str->codeunit_begin(), str->codeunit_end()));
+    }
+};
+
+struct cached_hash {
+    const u8_string* str;
+    void operator()() const {
+        do_not_optimize(str->hash());
+    }
+};
+
+template <typename Other>
+struct compare {
+    const u8_string* str;
+    const Other* other;
+    void operator()() const {
+        do_not_optimize(*str == *other);
+    }
+};
+
+void run(const char* name, const std::vector<std::string>& fragments) {
+    std::string corpus = make_corpus(fragments, 1 << 20);
+    u8_string str(corpus);
+    u16_string other(str);
+    u8_string same(corpus);
+
+    copy_bytes memcpy_benchmark = { &corpus };
+    iterate iterate_benchmark = { &str };
+    length length_benchmark = { &str };
+    codepoint_distance distance_benchmark = { &str };
+    count count_benchmark = { &str };
+    copy_into_builder copy_benchmark = { &str };
+    transcode_into_builder transcode_benchmark = { &str };
+    tokenize<false> slice_benchmark = { &str };
+    tokenize<true> token_copy_benchmark = { &str };
+    random_access<true> at_benchmark = { &str };
+    random_access<false> walk_benchmark = { &str };
+    hash<u8_string> hash_benchmark = { &str };
+    hash<u16_string> utf16_hash_benchmark = { &other };
+    cached_hash cached_hash_benchmark = { &str };
+    compare<u8_string> same_compare_benchmark = { &str, &same };
+    compare<u16_string> compare_benchmark = { &str, &other };
+
+    std::printf("%s\n", name);
+    report("  memcpy", corpus.size(), measure(memcpy_benchmark));
+    report("  iterate", corpus.size(), measure(iterate_benchmark));
+    report("  length", corpus.size(), measure(length_benchmark));
+    report("  distance", corpus.size(), measure(distance_benchmark));
+    report("  uncached count", corpus.size(), measure(count_benchmark));
+    report("  append to utf-8 builder", corpus.size(), measure(copy_benchmark));
+    report("  append to utf-16 builder", corpus.size(), measure(transcode_benchmark));
+    report("  tokenize into slices", corpus.size(), measure(slice_benchmark));
+    report("  tokenize into copies", corpus.size(), measure(token_copy_benchmark));
+    report("  64 x at()", corpus.size(), measure(at_benchmark));
+    report("  64 x std::advance()", corpus.size(), measure(walk_benchmark));
+    report("  hash", corpus.size(), measure(hash_benchmark));
+    report("  hash utf-16", corpus.size(), measure(utf16_hash_benchmark));
+    report("  cached hash", corpus.size(), measure(cached_hash_benchmark));
+    report("  compare with utf-8", corpus.size(), measure(same_compare_benchmark));
+    report("  compare with utf-16", corpus.size(), measure(compare_benchmark));
+}
+
+int main() {
+    std::vector<std::string> ascii;
+    ascii.push_back("The quick brown fox ");
+    ascii.push_back("jumps over the lazy dog. ");
+    ascii.push_back("0123456789\n");
+
+    // about one code point in fifty is not ASCII
+    std::vector<std::string> mostly_ascii(ascii);
+    mostly_ascii.push_back("caf\xC3\xA9 ");
+    mostly_ascii.push_back(ascii[0] + ascii[1] + ascii[2]);
+
+    run("ascii", ascii);
+    run("mostly ascii", mostly_ascii);
+}
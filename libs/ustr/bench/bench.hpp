@@ -0,0 +1,77 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+namespace boost {
+namespace ustr {
+namespace bench {
+
+/*
+ * Keeps the optimizer from discarding results that are otherwise unused.
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+
+/*
+ * Runs the function repeatedly for at least the given duration and
+ * returns the average number of seconds per run.
+ */
+template <typename Function>
+double measure(Function function, double min_seconds = 0.5) {
+    typedef std::chrono::steady_clock clock;
+
+    function(); // warm up caches and branch predictors
+
+    size_t runs = 0;
+    clock::time_point start = clock::now();
+    double elapsed = 0;
+
+    do {
+        function();
+        ++runs;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while(elapsed < min_seconds);
+
+    return elapsed / runs;
+}
+
+inline void report(const char* name, size_t bytes, double seconds) {
+    std::printf("%-40s %10.3f GB/s %12.1f us\n", 
+            name, bytes / seconds / 1e9, seconds * 1e6);
+}
+
+/*
+ * Repeats the fragments in a fixed pseudo random order until the
+ * corpus reaches the requested size in code units.
+ */
+template <typename StringT>
+StringT make_corpus(const std::vector<StringT>& fragments, size_t size) {
+    StringT corpus;
+    unsigned int seed = 42;
+
+    while(corpus.size() < size) {
+        seed = seed * 1103515245u + 12345u;
+        corpus += fragments[(seed >> 16) % fragments.size()];
+    }
+
+    return corpus;
+}
+
+} // namespace bench
+} // namespace ustr
+} // namespace boost
@@ -0,0 +1,77 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Passing validated strings along by copy, by move and through their
+ * shared buffer, for strings of growing length. Each of these only shares
+ * the buffer, so the time per hop should not depend on the length.
+ */
+
+static const size_t hops = 1000;
+
+struct copy_hops {
+    const u8_string* str;
+    void operator()() const {
+        for(size_t i = 0; i < hops; ++i) {
+            u8_string copy(*str);
+            do_not_optimize(copy);
+        }
+    }
+};
+
+struct move_hops {
+    const u8_string* str;
+    void operator()() const {
+        u8_string current(*str);
+
+        for(size_t i = 0; i < hops; ++i) {
+            u8_string next(std::move(current));
+            current = std::move(next);
+        }
+        do_not_optimize(current);
+    }
+};
+
+struct shared_buffer_hops {
+    const u8_string* str;
+    void operator()() const {
+        for(size_t i = 0; i < hops; ++i) {
+            do_not_optimize(u8_string::from_const_strptr(str->get_buffer()));
+        }
+    }
+};
+
+void report_hops(const char* name, size_t length, double seconds) {
+    std::printf("%-24s %8lu bytes %10.1f ns per hop\n",
+        name, static_cast<unsigned long>(length), seconds / hops * 1e9);
+}
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Hello world. ");
+    fragments.push_back("Gr\xC3\xBC\xC3\x9F Gott. ");
+    fragments.push_back("\xE4\xBD\xA0\xE5\xA5\xBD\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82");
+
+    for(size_t size = 16; size <= (1 << 20); size *= 16) {
+        std::string raw = make_corpus(fragments, size);
+        u8_string str = u8_string::from_codeunits(raw.begin(), raw.end());
+
+        copy_hops copy_benchmark = { &str };
+        move_hops move_benchmark = { &str };
+        shared_buffer_hops shared_benchmark = { &str };
+
+        report_hops("copy", raw.size(), measure(copy_benchmark));
+        report_hops("move", raw.size(), measure(move_benchmark));
+        report_hops("from_const_strptr", raw.size(), measure(shared_benchmark));
+    }
+}
@@ -0,0 +1,62 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/file_io.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Loading a UTF-8 file into a UTF-16 string: reading it into a std::string
+ * with an ifstream, then validating and converting it, against read_file().
+ */
+
+static const char* path = "file_bench.txt";
+
+struct ifstream_read {
+    void operator()() const {
+        std::ifstream file(path, std::ios::binary);
+        std::string raw((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        u8_string str = u8_string::from_codeunits(raw.begin(), raw.end());
+        u16_string::mutable_adapter_type builder;
+        builder.append(str);
+        do_not_optimize(builder.freeze());
+    }
+};
+
+struct file_read {
+    void operator()() const {
+        do_not_optimize(read_file<u16_string>(path));
+    }
+};
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Hello world. ");
+    fragments.push_back("Gr\xC3\xBC\xC3\x9F Gott. ");
+    fragments.push_back("\xE4\xBD\xA0\xE5\xA5\xBD\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82");
+
+    std::string corpus = make_corpus(fragments, 64 << 20);
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << corpus;
+    }
+
+    ifstream_read ifstream_benchmark;
+    file_read file_benchmark;
+
+    report("ifstream to u16_string", corpus.size(), measure(ifstream_benchmark));
+    report("read_file<u16_string>", corpus.size(), measure(file_benchmark));
+
+    std::remove(path);
+}
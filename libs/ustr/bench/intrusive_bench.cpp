@@ -0,0 +1,146 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <new>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/intrusive_string_traits.hpp>
+#include <boost/ustr/detail/small_string_traits.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Many short strings held by the default string traits, a shared_ptr to
+ * a std::string, next to the same strings held by intrusive_string_traits
+ * in a single allocation each, and by small_string_traits, which keeps
+ * them inline: the allocations made per string, the time to create them,
+ * and the time to walk the code points of all of them. Names of two
+ * fragments fit inline, names of four do not.
+ */
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+
+    if(void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+typedef unicode_string_adapter<
+    util::intrusive_string<char>, intrusive_string_traits<char> >      intrusive_u8_string;
+typedef unicode_string_adapter<
+    util::small_string<char>, small_string_traits<char> >              small_u8_string;
+
+template <typename String>
+struct create_strings {
+    const std::vector<std::string>* names;
+    void operator()() const {
+        std::vector<String> strings;
+        strings.reserve(names->size());
+
+        for(size_t i = 0; i < names->size(); ++i) {
+            const std::string& name = (*names)[i];
+            strings.push_back(String::from_codeunits(name.begin(), name.end()));
+        }
+        do_not_optimize(strings.back());
+    }
+};
+
+template <typename String>
+struct iterate_strings {
+    const std::vector<String>* strings;
+    void operator()() const {
+        codepoint_type sum = 0;
+
+        for(size_t i = 0; i < strings->size(); ++i) {
+            const String& str = (*strings)[i];
+            for(typename String::const_iterator it = str.begin(); it != str.end(); ++it) {
+                sum += *it;
+            }
+        }
+        do_not_optimize(sum);
+    }
+};
+
+template <typename String>
+void run(const char* name, const std::vector<std::string>& names, size_t bytes) {
+    std::vector<String> strings;
+    strings.reserve(names.size());
+
+    size_t before = allocations;
+    for(size_t i = 0; i < names.size(); ++i) {
+        strings.push_back(String::from_codeunits(names[i].begin(), names[i].end()));
+    }
+    size_t made = allocations - before;
+
+    create_strings<String> create_benchmark = { &names };
+    iterate_strings<String> iterate_benchmark = { &strings };
+
+    std::printf("%s: %.2f allocations per string\n", name,
+        static_cast<double>(made) / names.size());
+    report("  create", bytes, measure(create_benchmark));
+    report("  iterate", bytes, measure(iterate_benchmark));
+}
+
+std::vector<std::string> make_names(const std::vector<std::string>& fragments,
+    int length, size_t& bytes)
+{
+    std::vector<std::string> names;
+    bytes = 0;
+    unsigned int seed = 7;
+
+    while(names.size() < 200000) {
+        std::string str;
+        for(int i = 0; i < length; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            str += fragments[(seed >> 16) % fragments.size()];
+        }
+
+        names.push_back(str);
+        bytes += str.size();
+    }
+
+    return names;
+}
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Anderson ");
+    fragments.push_back("M\xC3\xBCller ");
+    fragments.push_back("\xE7\x8E\x8B ");
+    fragments.push_back("Smithers ");
+    fragments.push_back("\xF0\x9F\x98\x80 ");
+
+    size_t bytes;
+    std::vector<std::string> short_names = make_names(fragments, 2, bytes);
+
+    std::printf("short names\n");
+    run<u8_string>("u8_string", short_names, bytes);
+    run<intrusive_u8_string>("intrusive u8 string", short_names, bytes);
+    run<small_u8_string>("small u8 string", short_names, bytes);
+
+    // long enough to leave the small string buffer of std::string
+    std::vector<std::string> names = make_names(fragments, 4, bytes);
+
+    std::printf("long names\n");
+    run<u8_string>("u8_string", names, bytes);
+    run<intrusive_u8_string>("intrusive u8 string", names, bytes);
+    run<small_u8_string>("small u8 string", names, bytes);
+}
@@ -0,0 +1,184 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <boost/ustr/detail/encoding_traits.hpp>
+#include <boost/ustr/string_traits.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+using boost::ustr::encoding::utf8::utf8_encoder;
+using boost::ustr::encoding::utf16::utf16_encoder;
+
+/*
+ * Validation and sanitization of many short records, a given percentage
+ * of which contain a malformed sequence. The exception based variants are
+ * what validate() and the sanitizing path did before try_decode().
+ */
+
+typedef std::basic_string<utf16_codeunit_type>                 u16string;
+typedef replace_policy<0xFFFD>                                  policy;
+
+template <typename Encoder, typename StringT>
+bool throw_validate(const StringT& str) {
+    try {
+        typename StringT::const_iterator it = str.begin();
+        while(it != str.end()) {
+            Encoder::decode(it, str.end(), error_policy());
+        }
+        return true;
+    } catch(const encoding_error&) {
+        return false;
+    }
+}
+
+template <typename Encoder, typename StringT>
+bool status_validate(const StringT& str) {
+    typename StringT::const_iterator it = str.begin();
+    while(it != str.end()) {
+        if(!Encoder::try_decode(it, str.end()).valid()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Encoder, typename StringT>
+void decode_sanitize(const StringT& str, StringT& out) {
+    typename StringT::const_iterator it = str.begin();
+    while(it != str.end()) {
+        Encoder::encode(Encoder::decode(it, str.end(), policy()),
+            std::back_inserter(out), policy());
+    }
+}
+
+template <typename StringT>
+struct record_benchmark {
+    typedef utf_encoding_traits<
+        string_traits<StringT>,
+        typename util::encoding_engine<sizeof(typename StringT::value_type)>::type,
+        policy >                                                encoding_traits;
+    typedef typename encoding_traits::encoder                   encoder;
+    typedef typename encoding_traits::mutable_strptr_type       mutable_strptr_type;
+
+    enum variant { throwing, status, validate, old_sanitize, new_sanitize };
+
+    const std::vector<StringT>* records;
+    variant which;
+
+    void operator()() const {
+        size_t valid = 0;
+
+        for(size_t i = 0; i < records->size(); ++i) {
+            const StringT& record = (*records)[i];
+
+            switch(which) {
+              case throwing:
+                valid += throw_validate<encoder>(record);
+                break;
+              case status:
+                valid += status_validate<encoder>(record);
+                break;
+              case validate:
+                valid += encoding_traits::validate(record.begin(), record.end());
+                break;
+              case old_sanitize:
+                if(!throw_validate<encoder>(record)) {
+                    StringT sanitized;
+                    decode_sanitize<encoder>(record, sanitized);
+                    valid += sanitized.size();
+                }
+                break;
+              case new_sanitize:
+                if(!encoding_traits::validate(record.begin(), record.end())) {
+                    mutable_strptr_type sanitized;
+                    encoding_traits::sanitize(record.begin(), record.end(), sanitized);
+                    valid += sanitized->size();
+                }
+                break;
+            }
+        }
+
+        do_not_optimize(valid);
+    }
+};
+
+/*
+ * Builds records of about 64 code units from the fragments and inserts
+ * the malformed fragment in the middle of percent out of every hundred.
+ */
+template <typename StringT>
+std::vector<StringT> make_records(const std::vector<StringT>& fragments,
+        const StringT& malformed, int percent)
+{
+    const size_t count = 16384;
+    std::vector<StringT> records;
+    unsigned int seed = 42;
+
+    for(size_t i = 0; i < count; ++i) {
+        StringT record;
+        while(record.size() < 64) {
+            seed = seed * 1103515245u + 12345u;
+            record += fragments[(seed >> 16) % fragments.size()];
+        }
+
+        if(int(i % 100) < percent) {
+            record.insert(record.size() / 2, malformed);
+        }
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+template <typename StringT>
+void run(const char* encoding, const std::vector<StringT>& fragments, const StringT& malformed) {
+    static const int percents[] = { 0, 1, 10, 50 };
+    static const char* names[] = { "throw", "try_decode", "validate", "sanitize (throw)", "sanitize" };
+
+    for(size_t p = 0; p < sizeof(percents) / sizeof(int); ++p) {
+        std::vector<StringT> records = make_records(fragments, malformed, percents[p]);
+
+        size_t bytes = 0;
+        for(size_t i = 0; i < records.size(); ++i) {
+            bytes += records[i].size() * sizeof(typename StringT::value_type);
+        }
+
+        for(int which = 0; which < 5; ++which) {
+            record_benchmark<StringT> benchmark = {
+                &records, typename record_benchmark<StringT>::variant(which) };
+
+            char name[64];
+            std::sprintf(name, "%s %2d%% %s", encoding, percents[p], names[which]);
+            report(name, bytes, measure(benchmark));
+        }
+    }
+}
+
+int main() {
+    std::vector<std::string> u8_fragments;
+    u8_fragments.push_back("The quick brown fox ");
+    u8_fragments.push_back("\xE4\xB8\x96\xE7\x95\x8C");          // 世界
+    u8_fragments.push_back("\xC3\xA9t\xC3\xA9 ");                // été
+    u8_fragments.push_back("\xF0\x9F\x98\x80");                  // emoji
+
+    run("utf8 ", u8_fragments, std::string("\xE4\xB8"));
+
+    std::vector<u16string> u16_fragments;
+    for(size_t i = 0; i < u8_fragments.size(); ++i) {
+        const std::string& source = u8_fragments[i];
+        u16string fragment;
+        std::string::const_iterator it = source.begin();
+        while(it != source.end()) {
+            utf16_encoder::encode(utf8_encoder::decode(it, source.end(), policy()),
+                std::back_inserter(fragment), policy());
+        }
+        u16_fragments.push_back(fragment);
+    }
+
+    run("utf16", u16_fragments, u16string(1, 0xDC00));
+}
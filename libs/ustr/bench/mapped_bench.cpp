@@ -0,0 +1,73 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/mapped_string.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Turning a UTF-8 log file into a validated string: reading it into a
+ * std::string first, against mapping it, with and without telling the
+ * system that validation reads it sequentially.
+ */
+
+typedef unicode_string_adapter< util::mapped_string<char> >    mapped_u8_string;
+
+static const char* path = "mapped_bench.log";
+
+struct read_file {
+    void operator()() const {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        std::string raw(static_cast<size_t>(file.tellg()), '\0');
+
+        file.seekg(0);
+        file.read(&raw[0], raw.size());
+
+        do_not_optimize(u8_string::from_codeunits(raw.begin(), raw.end()).length());
+    }
+};
+
+struct map_file {
+    bool sequential;
+    void operator()() const {
+        util::mapped_string<char>* mapped = new util::mapped_string<char>(path);
+
+        if(sequential) {
+            mapped->advise(util::mapped_string<char>::sequential_access);
+        }
+
+        do_not_optimize(mapped_u8_string::from_ptr(mapped).length());
+    }
+};
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("2011-08-01 12:00:00 INFO request served\n");
+    fragments.push_back("2011-08-01 12:00:01 WARN Zeit\xC3\xBC" "berschreitung\n");
+    fragments.push_back("2011-08-01 12:00:02 INFO \xE8\xAF\xB7\xE6\xB1\x82\xE5\xB7\xB2\xE5\xA4\x84\xE7\x90\x86\n");
+
+    std::string corpus = make_corpus(fragments, 64 << 20);
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << corpus;
+    }
+
+    read_file read_benchmark;
+    map_file map_benchmark = { false };
+    map_file sequential_benchmark = { true };
+
+    report("read into std::string", corpus.size(), measure(read_benchmark));
+    report("mapped", corpus.size(), measure(map_benchmark));
+    report("mapped sequential", corpus.size(), measure(sequential_benchmark));
+
+    std::remove(path);
+}
@@ -0,0 +1,95 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Sorting a batch of short names, next to sorting the same names as
+ * plain std::string and through a comparator decoding code points.
+ */
+
+template <typename String>
+struct sort_strings {
+    const std::vector<String>* names;
+    void operator()() const {
+        std::vector<String> sorted(*names);
+        std::sort(sorted.begin(), sorted.end());
+        do_not_optimize(sorted.front());
+    }
+};
+
+struct decoding_less {
+    bool operator()(const u8_string& left, const u8_string& right) const {
+        return std::lexicographical_compare(
+            left.begin(), left.end(), right.begin(), right.end());
+    }
+};
+
+struct sort_decoding {
+    const std::vector<u8_string>* names;
+    void operator()() const {
+        std::vector<u8_string> sorted(*names);
+        std::sort(sorted.begin(), sorted.end(), decoding_less());
+        do_not_optimize(sorted.front());
+    }
+};
+
+void run(const char* name, const std::vector<std::string>& fragments) {
+    std::vector<std::string> names;
+    std::vector<u8_string> u8_names;
+    std::vector<u16_string> u16_names;
+    size_t bytes = 0;
+    unsigned int seed = 7;
+
+    while(names.size() < 100000) {
+        std::string str;
+        for(int i = 0; i < 3; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            str += fragments[(seed >> 16) % fragments.size()];
+        }
+
+        names.push_back(str);
+        u8_names.push_back(u8_string(str));
+        u16_names.push_back(u16_string(u8_names.back()));
+        bytes += str.size();
+    }
+
+    sort_strings<std::string> string_benchmark = { &names };
+    sort_strings<u8_string> u8_benchmark = { &u8_names };
+    sort_strings<u16_string> u16_benchmark = { &u16_names };
+    sort_decoding decoding_benchmark = { &u8_names };
+
+    std::printf("%s\n", name);
+    report("  std::string", bytes, measure(string_benchmark));
+    report("  u8_string", bytes, measure(u8_benchmark));
+    report("  u16_string", bytes, measure(u16_benchmark));
+    report("  u8_string decoding comparator", bytes, measure(decoding_benchmark));
+}
+
+int main() {
+    std::vector<std::string> ascii;
+    ascii.push_back("Anderson ");
+    ascii.push_back("Andersen ");
+    ascii.push_back("Brown ");
+    ascii.push_back("Browning ");
+    ascii.push_back("Smith ");
+    ascii.push_back("Smithers ");
+
+    std::vector<std::string> mixed(ascii);
+    mixed.push_back("M\xC3\xBCller ");
+    mixed.push_back("\xE7\x8E\x8B ");
+    mixed.push_back("\xE6\x9D\x8E ");
+    mixed.push_back("\xF0\x9F\x98\x80 ");
+
+    run("ascii names", ascii);
+    run("mixed names", mixed);
+}
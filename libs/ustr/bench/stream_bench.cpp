@@ -0,0 +1,70 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/stream_decoder.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Decoding UTF-8 arriving in 4 KB chunks into a UTF-16 string: gathering
+ * the chunks into one string before decoding it, against decoding each
+ * chunk as it arrives.
+ */
+
+static const size_t chunk_size = 4096;
+
+struct concatenated_chunks {
+    const std::string* input;
+    void operator()() const {
+        std::string gathered;
+
+        for(size_t offset = 0; offset < input->size(); offset += chunk_size) {
+            gathered.append(*input, offset, chunk_size);
+        }
+
+        u8_string str = u8_string::from_codeunits(gathered.begin(), gathered.end());
+        u16_string::mutable_adapter_type builder;
+        builder.append(str);
+        do_not_optimize(builder.freeze());
+    }
+};
+
+struct streamed_chunks {
+    const std::string* input;
+    void operator()() const {
+        stream_decoder<char> decoder;
+        u16_string::mutable_adapter_type builder;
+        const char* data = input->data();
+
+        for(size_t offset = 0; offset < input->size(); offset += chunk_size) {
+            size_t size = (std::min)(chunk_size, input->size() - offset);
+            decoder.decode(data + offset, data + offset + size, builder);
+        }
+
+        decoder.finish(builder);
+        do_not_optimize(builder.freeze());
+    }
+};
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Hello world. ");
+    fragments.push_back("Gr\xC3\xBC\xC3\x9F Gott. ");
+    fragments.push_back("\xE4\xBD\xA0\xE5\xA5\xBD\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82");
+    fragments.push_back("\xF0\x9F\x98\x80 ");
+
+    std::string input = make_corpus(fragments, 16 << 20);
+
+    concatenated_chunks concatenated_benchmark = { &input };
+    streamed_chunks streamed_benchmark = { &input };
+
+    report("concatenated chunks", input.size(), measure(concatenated_benchmark));
+    report("stream_decoder chunks", input.size(), measure(streamed_benchmark));
+}
@@ -0,0 +1,71 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/transcoding_streambuf.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Writing a large UTF-16 string to a UTF-8 stream: converting it into a
+ * temporary u8_string written as it is, against converting it through a
+ * transcoding_sink. The stream discards what it is given.
+ */
+
+class null_streambuf : public std::streambuf {
+  protected:
+    virtual std::streamsize xsputn(const char*, std::streamsize size) {
+        return size;
+    }
+
+    virtual int_type overflow(int_type c) {
+        return traits_type::not_eof(c);
+    }
+};
+
+struct temporary_string {
+    const u16_string* str;
+    void operator()() const {
+        null_streambuf target;
+        std::ostream out(&target);
+
+        u8_string::mutable_adapter_type converted;
+        converted.append(*str);
+        out << converted.freeze();
+    }
+};
+
+struct sink_string {
+    const u16_string* str;
+    void operator()() const {
+        null_streambuf target;
+        transcoding_sink<char> sink(&target);
+
+        do_not_optimize(sink.write(*str));
+    }
+};
+
+int main() {
+    std::vector<std::string> fragments;
+    fragments.push_back("Hello world. ");
+    fragments.push_back("Gr\xC3\xBC\xC3\x9F Gott. ");
+    fragments.push_back("\xE4\xBD\xA0\xE5\xA5\xBD\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82");
+
+    std::string raw = make_corpus(fragments, 64 << 20);
+    u16_string::mutable_adapter_type converted;
+    converted.append(u8_string::from_codeunits(raw.begin(), raw.end()));
+    u16_string str = converted.freeze();
+
+    temporary_string temporary_benchmark = { &str };
+    sink_string sink_benchmark = { &str };
+
+    report("temporary u8_string", raw.size(), measure(temporary_benchmark));
+    report("transcoding_sink", raw.size(), measure(sink_benchmark));
+}
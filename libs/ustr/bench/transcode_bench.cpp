@@ -0,0 +1,190 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+
+/*
+ * Conversion between encodings through the converting constructor, next to
+ * the code point by code point copy into a builder that it replaces.
+ */
+
+template <typename Source, typename Target>
+struct convert {
+    const Source* str;
+    void operator()() const {
+        Target converted(*str);
+        do_not_optimize(converted.get_buffer().get());
+    }
+};
+
+template <typename Source, typename Target>
+struct copy_codepoints {
+    const Source* str;
+    void operator()() const {
+        typename Target::mutable_adapter_type builder;
+        std::copy(str->begin(), str->end(), builder.begin());
+
+        typename Target::mutable_strptr_type converted(builder.release());
+        do_not_optimize(converted.get());
+    }
+};
+
+template <typename Target>
+struct from_codepoints {
+    const std::vector<codepoint_type>* codepoints;
+    void operator()() const {
+        Target converted = Target::from_codepoints(codepoints->begin(), codepoints->end());
+        do_not_optimize(converted.get_buffer().get());
+    }
+};
+
+template <typename Target>
+struct copy_into_builder {
+    const std::vector<codepoint_type>* codepoints;
+    void operator()() const {
+        typename Target::mutable_adapter_type builder;
+        std::copy(codepoints->begin(), codepoints->end(), builder.begin());
+
+        typename Target::mutable_strptr_type converted(builder.release());
+        do_not_optimize(converted.get());
+    }
+};
+
+template <typename Target>
+void run_codepoints(const char* name, const std::vector<codepoint_type>& codepoints) {
+    size_t bytes = codepoints.size() * sizeof(codepoint_type);
+
+    from_codepoints<Target> from_benchmark = { &codepoints };
+    copy_into_builder<Target> copy_benchmark = { &codepoints };
+
+    std::printf("%s\n", name);
+    report("  from_codepoints", bytes, measure(from_benchmark));
+    report("  code point copy", bytes, measure(copy_benchmark));
+}
+
+template <typename Left, typename Right>
+struct concatenate {
+    const Left* left;
+    const Right* right;
+    void operator()() const {
+        Left concatenated = *left + *right;
+        do_not_optimize(concatenated.get_buffer().get());
+    }
+};
+
+/*
+ * Pre-encoded code units arriving in chunks, as from a socket, appended
+ * in bulk or through the code unit output iterator.
+ */
+static const size_t chunk_size = 4096;
+
+struct append_chunks {
+    const std::string* encoded;
+    void operator()() const {
+        u8_string::mutable_adapter_type builder;
+        for(size_t offset = 0; offset < encoded->size(); offset += chunk_size) {
+            builder.append_codeunits(encoded->data() + offset,
+                (std::min)(chunk_size, encoded->size() - offset));
+        }
+
+        u8_string::mutable_strptr_type appended(builder.release());
+        do_not_optimize(appended.get());
+    }
+};
+
+struct copy_chunks {
+    const std::string* encoded;
+    void operator()() const {
+        u8_string::mutable_adapter_type builder;
+        for(size_t offset = 0; offset < encoded->size(); offset += chunk_size) {
+            const char* chunk = encoded->data() + offset;
+            std::copy(chunk, chunk + (std::min)(chunk_size, encoded->size() - offset),
+                builder.codeunit_begin());
+        }
+
+        u8_string::mutable_strptr_type appended(builder.release());
+        do_not_optimize(appended.get());
+    }
+};
+
+template <typename Source, typename Target>
+void run(const char* name, const Source& str) {
+    size_t bytes = str.to_string().size() * Source::codeunit_size;
+
+    convert<Source, Target> convert_benchmark = { &str };
+    copy_codepoints<Source, Target> copy_benchmark = { &str };
+
+    std::printf("%s\n", name);
+    report("  converting constructor", bytes, measure(convert_benchmark));
+    report("  code point copy", bytes, measure(copy_benchmark));
+}
+
+void run_corpus(const char* name, const std::vector<std::string>& fragments) {
+    u8_string u8(make_corpus(fragments, 1 << 20));
+
+    u16_string u16(u8);
+    u32_string u32(u8);
+    std::vector<codepoint_type> codepoints(u8.begin(), u8.end());
+
+    std::string u8_to_u16 = std::string(name) + " utf-8 to utf-16";
+    run<u8_string, u16_string>(u8_to_u16.c_str(), u8);
+
+    std::string u16_to_u8 = std::string(name) + " utf-16 to utf-8";
+    run<u16_string, u8_string>(u16_to_u8.c_str(), u16);
+
+    std::string u8_to_u32 = std::string(name) + " utf-8 to utf-32";
+    run<u8_string, u32_string>(u8_to_u32.c_str(), u8);
+
+    std::string u32_to_u8 = std::string(name) + " utf-32 to utf-8";
+    run<u32_string, u8_string>(u32_to_u8.c_str(), u32);
+
+    std::string u32_to_u16 = std::string(name) + " utf-32 to utf-16";
+    run<u32_string, u16_string>(u32_to_u16.c_str(), u32);
+
+    std::string codepoints_to_u8 = std::string(name) + " code points to utf-8";
+    run_codepoints<u8_string>(codepoints_to_u8.c_str(), codepoints);
+
+    std::string codepoints_to_u16 = std::string(name) + " code points to utf-16";
+    run_codepoints<u16_string>(codepoints_to_u16.c_str(), codepoints);
+
+    std::string encoded = u8.to_string();
+    append_chunks append_benchmark = { &encoded };
+    copy_chunks chunk_benchmark = { &encoded };
+
+    std::printf("%s utf-8 code units in %u byte chunks\n", name, static_cast<unsigned>(chunk_size));
+    report("  append_codeunits", encoded.size(), measure(append_benchmark));
+    report("  code unit copy", encoded.size(), measure(chunk_benchmark));
+
+    concatenate<u8_string, u16_string> concat_benchmark = { &u8, &u16 };
+    report("  utf-8 + utf-16", u8.to_string().size() * 2, measure(concat_benchmark));
+}
+
+int main() {
+    std::vector<std::string> ascii;
+    ascii.push_back("The quick brown fox ");
+    ascii.push_back("jumps over the lazy dog. ");
+    ascii.push_back("0123456789\n");
+
+    std::vector<std::string> cjk;
+    cjk.push_back("\xE4\xB8\x96\xE7\x95\x8C");          // 世界
+    cjk.push_back("\xE4\xBD\xA0\xE5\xA5\xBD");          // 你好
+    cjk.push_back("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E"); // 日本語
+
+    std::vector<std::string> mixed(ascii);
+    mixed.insert(mixed.end(), cjk.begin(), cjk.end());
+    mixed.push_back("\xC3\xA9t\xC3\xA9 ");              // été
+    mixed.push_back("\xF0\x9F\x98\x80");                // emoji
+
+    run_corpus("ascii", ascii);
+    run_corpus("cjk", cjk);
+    run_corpus("mixed", mixed);
+}
@@ -0,0 +1,80 @@
+//          Copyright Soares Chen Ruo Fei 2011.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <boost/ustr/detail/encoding_traits.hpp>
+#include <boost/ustr/string_traits.hpp>
+#include <libs/ustr/bench/bench.hpp>
+
+using namespace boost::ustr;
+using namespace boost::ustr::bench;
+using boost::ustr::encoding::utf8::utf8_encoder;
+
+typedef utf_encoding_traits< string_traits<std::string> >   encoding_traits;
+
+/*
+ * The code point by code point validation that the kernels replace.
+ */
+bool decode_validate(const std::string& str) {
+    try {
+        std::string::const_iterator it = str.begin();
+        while(it != str.end()) {
+            utf8_encoder::decode(it, str.end(), error_policy());
+        }
+        return true;
+    } catch(const encoding_error&) {
+        return false;
+    }
+}
+
+struct kernel_validation {
+    const std::string* str;
+    void operator()() const {
+        do_not_optimize(encoding_traits::validate(str->begin(), str->end()));
+    }
+};
+
+struct decode_validation {
+    const std::string* str;
+    void operator()() const {
+        do_not_optimize(decode_validate(*str));
+    }
+};
+
+void run(const char* name, const std::vector<std::string>& fragments) {
+    const size_t size = 1 << 20;
+    std::string corpus = make_corpus(fragments, size);
+
+    kernel_validation kernel = { &corpus };
+    decode_validation decode = { &corpus };
+
+    std::string kernel_name = std::string(name) + " kernel";
+    std::string decode_name = std::string(name) + " decode";
+
+    report(kernel_name.c_str(), corpus.size(), measure(kernel));
+    report(decode_name.c_str(), corpus.size(), measure(decode));
+}
+
+int main() {
+    std::vector<std::string> ascii;
+    ascii.push_back("The quick brown fox ");
+    ascii.push_back("jumps over the lazy dog. ");
+    ascii.push_back("0123456789\n");
+
+    std::vector<std::string> cjk;
+    cjk.push_back("\xE4\xB8\x96\xE7\x95\x8C");          // 世界
+    cjk.push_back("\xE4\xBD\xA0\xE5\xA5\xBD");          // 你好
+    cjk.push_back("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E"); // 日本語
+
+    std::vector<std::string> mixed(ascii);
+    mixed.insert(mixed.end(), cjk.begin(), cjk.end());
+    mixed.push_back("\xC3\xA9t\xC3\xA9 ");              // été
+    mixed.push_back("\xF0\x9F\x98\x80");                // emoji
+
+    run("ascii", ascii);
+    run("cjk", cjk);
+    run("mixed", mixed);
+}
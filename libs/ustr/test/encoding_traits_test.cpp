@@ -11,6 +11,7 @@
 #include <algorithm>
 #include "gtest.h"
 #include <boost/ustr/detail/encoding_traits.hpp>
+#include <boost/ustr/detail/transcode.hpp>
 #include <boost/ustr/string_traits.hpp>
 #include <boost/ustr/policy.hpp>
 #include <libs/ustr/test/fixture.hpp>
@@ -219,7 +220,439 @@ TEST(utf8_validity_test, invalid_chars) {
     EXPECT_THROW(utf8_encoder::encode(invalid, std::back_inserter(output), error_policy()), encoding_error);
 }
 
+/*
+ * Reference answer from decoding code point by code point, which is
+ * what utf_encoding_traits::validate() did before it had kernels.
+ */
+inline bool decode_validate(const string& str) {
+    try {
+        string::const_iterator it = str.begin();
+        while(it != str.end()) {
+            utf8_encoder::decode(it, str.end(), error_policy());
+        }
+        return true;
+    } catch(const encoding_error&) {
+        return false;
+    }
+}
+
+/*
+ * Validates the sequence at several offsets so that it straddles
+ * the block boundaries of the SSE and AVX2 kernels.
+ */
+inline void expect_same_validity(const string& sequence) {
+    typedef utf_encoding_traits< string_traits<string> > EncodingTraits;
+
+    static const size_t offsets[] = { 0, 14, 30, 62 };
+
+    for(size_t i = 0; i < sizeof(offsets) / sizeof(size_t); ++i) {
+        string str = string(offsets[i], 'a') + sequence + string(5, 'z');
+
+        ASSERT_EQ(decode_validate(str), EncodingTraits::validate(str.begin(), str.end()))
+            << "offset " << offsets[i] << " length " << sequence.size();
+    }
+
+    ASSERT_EQ(decode_validate(sequence), EncodingTraits::validate(sequence.begin(), sequence.end()));
+}
+
+TEST(utf8_validity_test, kernel_matches_decoder) {
+    // Representative trailing bytes: ASCII, the boundaries of the
+    // continuation byte ranges and each kind of lead byte.
+    static const unsigned char samples[] = {
+        0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF,
+        0xC0, 0xC1, 0xC2, 0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF
+    };
+    const size_t sample_count = sizeof(samples) / sizeof(unsigned char);
+
+    for(unsigned first = 0; first < 0x100; ++first) {
+        expect_same_validity(string(1, char(first)));
+
+        for(unsigned second = 0; second < 0x100; ++second) {
+            string sequence;
+            sequence += char(first);
+            sequence += char(second);
+            expect_same_validity(sequence);
+        }
+    }
+
+    for(unsigned first = 0xC0; first < 0x100; ++first) {
+        for(size_t second = 0; second < sample_count; ++second) {
+            for(size_t third = 0; third < sample_count; ++third) {
+                string sequence;
+                sequence += char(first);
+                sequence += char(samples[second]);
+                sequence += char(samples[third]);
+                expect_same_validity(sequence);
+
+                for(size_t fourth = 0; first >= 0xF0 && fourth < sample_count; ++fourth) {
+                    expect_same_validity(sequence + char(samples[fourth]));
+                }
+            }
+        }
+    }
+}
+
+TEST(utf8_validity_test, random_sequences) {
+    typedef utf_encoding_traits< string_traits<string> > EncodingTraits;
+
+    static const char* fragments[] = {
+        "a", "Hello, ", "\xC3\xA9", "\xE4\xB8\x96", "\xE7\x95\x8C", "\xF0\x9F\x98\x80",
+        "\xF4\x8F\xBF\xBF", "\xE0\x80\x80", "\xED\xA0\x80", "\x80", "\xC0\xAF", "\xF4\x90\x80\x80",
+        "\xE4\xB8", "\xF0\x9F", "\xFF"
+    };
+    const size_t fragment_count = sizeof(fragments) / sizeof(const char*);
+
+    // Mostly well formed fragments with the occasional malformed one, so
+    // that both the accepting and the rejecting paths get exercised.
+    unsigned int seed = 12345;
+    for(int i = 0; i < 2000; ++i) {
+        string str;
+        int fragment_length = (i % 100) + 1;
+
+        for(int j = 0; j < fragment_length; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            size_t index = (seed >> 16) % fragment_count;
+
+            if(index >= 9 && (seed >> 8) % 16 != 0) {
+                index = index % 7;
+            }
+            str += fragments[index];
+        }
+
+        ASSERT_EQ(decode_validate(str), EncodingTraits::validate(str.begin(), str.end())) << i;
+
+        size_t length = 0;
+        if(EncodingTraits::validate(str.begin(), str.end(), length)) {
+            ASSERT_EQ(EncodingTraits::codepoint_length(str.begin(), str.end()), length) << i;
+        }
+    }
+}
+
+template <typename CodeUnit>
+inline void expect_find_non_ascii() {
+    for(size_t length = 0; length < 100; ++length) {
+        std::vector<CodeUnit> units(length, CodeUnit('a'));
+        const CodeUnit* begin = units.empty() ? NULL : &units[0];
+
+        EXPECT_EQ(begin + length, util::find_non_ascii(begin, begin + length));
+
+        for(size_t position = 0; position < length; ++position) {
+            units[position] = CodeUnit(0x80);
+            EXPECT_EQ(begin + position, util::find_non_ascii(begin, begin + length));
+
+            units[position] = CodeUnit(-1);
+            EXPECT_EQ(begin + position, util::find_non_ascii(begin, begin + length));
+
+            units[position] = CodeUnit(0x7F);
+        }
+    }
+}
+
+TEST(ascii_test, find_non_ascii) {
+    expect_find_non_ascii<char>();
+    expect_find_non_ascii<utf16_codeunit_type>();
+    expect_find_non_ascii<codepoint_type>();
+}
+
+TEST(utf16_validity_test, kernel_matches_decoder) {
+    typedef std::basic_string<utf16_codeunit_type> u16string;
+    typedef utf_encoding_traits< string_traits<u16string> > EncodingTraits;
+
+    static const utf16_codeunit_type samples[] = {
+        0x0041, 0x00E9, 0xD7FF, 0xD800, 0xDBFF, 0xDC00, 0xDFFF, 0xE000, 0xFFFF
+    };
+    const size_t sample_count = sizeof(samples) / sizeof(utf16_codeunit_type);
+
+    for(size_t offset = 0; offset < 20; ++offset) {
+        for(size_t first = 0; first < sample_count; ++first) {
+            for(size_t second = 0; second < sample_count; ++second) {
+                for(size_t third = 0; third <= sample_count; ++third) {
+                    u16string str(offset, 0x61);
+                    str += samples[first];
+                    str += samples[second];
+                    if(third < sample_count) {
+                        str += samples[third];
+                    }
+
+                    bool expected = true;
+                    const u16string& units = str;
+                    for(u16string::const_iterator it = units.begin(); expected && it != units.end(); ) {
+                        expected = utf16_encoder::try_decode(it, units.end()).valid();
+                    }
+
+                    ASSERT_EQ(expected, EncodingTraits::validate(str.begin(), str.end()));
+
+                    size_t length = 0;
+                    ASSERT_EQ(expected, EncodingTraits::validate(str.begin(), str.end(), length));
+                    if(expected) {
+                        ASSERT_EQ(EncodingTraits::codepoint_length(str.begin(), str.end()), length);
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename Encoder, typename StringT>
+inline decode_result try_decode_first(const StringT& str) {
+    typename StringT::const_iterator begin = str.begin();
+    decode_result result = Encoder::try_decode(begin, str.end());
+
+    EXPECT_EQ(static_cast<size_t>(begin - str.begin()), result.consumed);
+    return result;
+}
+
+TEST(try_decode_test, utf8_status) {
+    decode_result result = try_decode_first<utf8_encoder>(string("\xE4\xB8\x96z"));
+    EXPECT_EQ(decode_success, result.status);
+    EXPECT_EQ(0x4E16u, result.codepoint);
+    EXPECT_EQ(3u, result.consumed);
+
+    result = try_decode_first<utf8_encoder>(string("\x80\x80"));
+    EXPECT_EQ(decode_malformed, result.status);
+    EXPECT_EQ(1u, result.consumed);
+
+    result = try_decode_first<utf8_encoder>(string("\xE4\xB8X"));
+    EXPECT_EQ(decode_malformed, result.status);
+    EXPECT_EQ(3u, result.consumed);
+
+    result = try_decode_first<utf8_encoder>(string("\xF0\x9F"));
+    EXPECT_EQ(decode_incomplete, result.status);
+    EXPECT_EQ(2u, result.consumed);
+
+    result = try_decode_first<utf8_encoder>(string("\xF4\x90\x80\x80"));
+    EXPECT_EQ(decode_out_of_range, result.status);
+    EXPECT_EQ(0x110000u, result.codepoint);
+    EXPECT_EQ(4u, result.consumed);
+}
+
+TEST(try_decode_test, utf16_status) {
+    typedef std::basic_string<utf16_codeunit_type> u16string;
+    const utf16_codeunit_type pair[] = { 0xD83D, 0xDE00 };
+    const utf16_codeunit_type unpaired[] = { 0xD83D, 0x0041 };
 
+    decode_result result = try_decode_first<utf16_encoder>(u16string(pair, pair + 2));
+    EXPECT_EQ(decode_success, result.status);
+    EXPECT_EQ(0x1F600u, result.codepoint);
+    EXPECT_EQ(2u, result.consumed);
+
+    result = try_decode_first<utf16_encoder>(u16string(unpaired, unpaired + 2));
+    EXPECT_EQ(decode_malformed, result.status);
+    EXPECT_EQ(2u, result.consumed);
+
+    result = try_decode_first<utf16_encoder>(u16string(pair, pair + 1));
+    EXPECT_EQ(decode_incomplete, result.status);
+    EXPECT_EQ(1u, result.consumed);
+
+    result = try_decode_first<utf16_encoder>(u16string(pair + 1, pair + 2));
+    EXPECT_EQ(decode_malformed, result.status);
+    EXPECT_EQ(1u, result.consumed);
+}
+
+TEST(try_decode_test, utf32_status) {
+    std::vector<codepoint_type> str;
+    str.push_back(0x10FFFF);
+    str.push_back(0x110000);
+
+    decode_result result = try_decode_first<utf32_encoder>(str);
+    EXPECT_EQ(decode_success, result.status);
+    EXPECT_EQ(1u, result.consumed);
+
+    str.erase(str.begin());
+    result = try_decode_first<utf32_encoder>(str);
+    EXPECT_EQ(decode_out_of_range, result.status);
+    EXPECT_EQ(0x110000u, result.codepoint);
+}
+
+TEST(try_decode_test, sanitize_matches_decode) {
+    typedef string_traits<string> StringTraits;
+    typedef utf_encoding_traits< StringTraits, utf8_encoder, 
+        replace_policy<0xFFFD, true> > EncodingTraits;
+
+    const string str("a\x80\xC3\xA9\xE4\xB8X\xF4\x90\x80\x80\xF0\x9F");
+
+    string expected;
+    for(string::const_iterator it = str.begin(); it != str.end(); ) {
+        utf8_encoder::encode(utf8_encoder::decode(it, str.end(), replace_policy<0xFFFD, true>()),
+            std::back_inserter(expected), error_policy());
+    }
+
+    StringTraits::mutable_strptr_type sanitized;
+    EncodingTraits::sanitize(str.begin(), str.end(), sanitized);
+    EXPECT_EQ(expected, *sanitized);
+}
+
+TEST(try_decode_test, sanitize_overlong) {
+    typedef string_traits<string> StringTraits;
+    typedef utf_encoding_traits< StringTraits, utf8_encoder,
+        replace_policy<0xFFFD, true> > EncodingTraits;
+
+    // overlong forms are well formed to the decoder, but are written
+    // in the shortest form along with the replaced sequences
+    const string str("a\x80\xE0\x80\x8F\xF0\x80\x80\x8F\xC3\xA9\xF0\x9F\x98\x80");
+
+    StringTraits::mutable_strptr_type sanitized;
+    EncodingTraits::sanitize(str.begin(), str.end(), sanitized);
+    EXPECT_EQ(string("a\xEF\xBF\xBD\x0F\x0F\xC3\xA9\xF0\x9F\x98\x80"), *sanitized);
+}
+
+/*
+ * Converts with util::transcoder and with a plain decode and encode loop,
+ * which must agree whether or not the kernel can handle the whole input.
+ */
+template <typename SourceString, typename TargetString>
+inline void expect_same_conversion(const SourceString& source) {
+    typedef replace_policy<0xFFFD, false>                       lax_policy;
+    typedef utf_encoding_traits<string_traits<SourceString>,
+        typename util::encoding_engine<sizeof(typename SourceString::value_type)>::type,
+        lax_policy>                                             SourceTraits;
+    typedef utf_encoding_traits<string_traits<TargetString>,
+        typename util::encoding_engine<sizeof(typename TargetString::value_type)>::type,
+        lax_policy>                                             TargetTraits;
+
+    TargetString expected(1, 'x');
+    for(typename SourceString::const_iterator it = source.begin(); it != source.end(); ) {
+        TargetTraits::encoder::encode(SourceTraits::encoder::decode(it, source.end(), lax_policy()),
+            std::back_inserter(expected), lax_policy());
+    }
+
+    typename TargetTraits::mutable_strptr_type converted(new TargetString(1, 'x'));
+    util::transcoder<SourceTraits, TargetTraits>::append(source.begin(), source.end(), converted);
+
+    ASSERT_TRUE(expected == *converted) << source.size();
+}
+
+TEST(transcode_test, utf8_to_utf16) {
+    typedef std::basic_string<utf16_codeunit_type> u16string;
+
+    static const char* fragments[] = {
+        "a", "Hello, world ", "\xC3\xA9", "\xE4\xB8\x96", "\xEF\xBF\xBF", "\xF0\x9F\x98\x80",
+        "\xF4\x8F\xBF\xBF", "\xE0\x80\x80", "\xED\xA0\x80", "\xF0\x80\x80\x80", "\x80",
+        "\xC0\xAF", "\xF4\x90\x80\x80", "\xE4\xB8", "\xF0\x9F", "\xFF"
+    };
+    const size_t fragment_count = sizeof(fragments) / sizeof(const char*);
+
+    unsigned int seed = 54321;
+    for(int i = 0; i < 2000; ++i) {
+        string str;
+        int fragment_length = (i % 100) + 1;
+
+        for(int j = 0; j < fragment_length; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            size_t index = (seed >> 16) % fragment_count;
+
+            // mostly well formed, with one in four strings left alone
+            if(index >= 7 && (i % 4 != 0 || (seed >> 8) % 8 != 0)) {
+                index = index % 7;
+            }
+            str += fragments[index];
+        }
+
+        expect_same_conversion<string, u16string>(str);
+        expect_same_conversion<string, std::vector<utf16_codeunit_type> >(str);
+        expect_same_conversion<string, std::vector<codepoint_type> >(str);
+    }
+
+    expect_same_conversion<string, u16string>(string());
+    expect_same_conversion<string, std::vector<codepoint_type> >(string());
+}
+
+TEST(transcode_test, utf16_to_utf8) {
+    typedef std::basic_string<utf16_codeunit_type> u16string;
+
+    static const utf16_codeunit_type fragments[][3] = {
+        { 0x61, 0 }, { 0x7F, 0x20, 0 }, { 0x80, 0 }, { 0xE9, 0x7FF, 0 }, { 0x800, 0 },
+        { 0x4E16, 0x754C, 0 }, { 0xFFFF, 0 }, { 0xD83D, 0xDE00, 0 }, { 0xDBFF, 0xDFFF, 0 },
+        { 0xD800, 0 }, { 0xDC00, 0 }, { 0xD800, 0x61, 0 }
+    };
+    const size_t fragment_count = sizeof(fragments) / sizeof(fragments[0]);
+
+    unsigned int seed = 13579;
+    for(int i = 0; i < 2000; ++i) {
+        u16string str;
+        int fragment_length = (i % 100) + 1;
+
+        for(int j = 0; j < fragment_length; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            size_t index = (seed >> 16) % fragment_count;
+
+            // mostly well formed, with one in four strings left alone
+            if(index >= 9 && (i % 4 != 0 || (seed >> 8) % 8 != 0)) {
+                index = index % 9;
+            }
+
+            // runs of ASCII long enough for the vectorized loop
+            if(index == 0) {
+                str.append((seed >> 4) % 40, 0x61);
+            }
+            str += fragments[index];
+        }
+
+        expect_same_conversion<u16string, string>(str);
+        expect_same_conversion<std::vector<utf16_codeunit_type>, std::vector<char> >(
+            std::vector<utf16_codeunit_type>(str.begin(), str.end()));
+        expect_same_conversion<u16string, std::vector<codepoint_type> >(str);
+    }
+
+    expect_same_conversion<u16string, string>(u16string());
+    expect_same_conversion<u16string, std::vector<codepoint_type> >(u16string());
+}
+
+TEST(transcode_test, utf32_to_utf8_and_utf16) {
+    typedef std::basic_string<utf16_codeunit_type> u16string;
+    typedef std::vector<codepoint_type> u32string;
+
+    static const codepoint_type samples[] = {
+        0x61, 0x7F, 0x80, 0x7FF, 0x800, 0x4E16, 0xD7FF, 0xE000, 0xFFFF,
+        0x10000, 0x1F600, 0x10FFFF, 0xD800, 0xDFFF, 0x110000, 0xFFFFFFFF
+    };
+    const size_t sample_count = sizeof(samples) / sizeof(codepoint_type);
+
+    unsigned int seed = 24680;
+    for(int i = 0; i < 2000; ++i) {
+        u32string str;
+        int sample_length = (i % 100) + 1;
+
+        for(int j = 0; j < sample_length; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            size_t index = (seed >> 16) % sample_count;
+
+            // mostly valid, with one in four strings left alone
+            if(index >= 12 && (i % 4 != 0 || (seed >> 8) % 8 != 0)) {
+                index = index % 12;
+            }
+
+            // runs of ASCII long enough for the vectorized loops
+            if(index == 0) {
+                str.insert(str.end(), (seed >> 4) % 40, 0x61);
+            }
+            str.push_back(samples[index]);
+        }
+
+        expect_same_conversion<u32string, string>(str);
+        expect_same_conversion<u32string, u16string>(str);
+    }
+
+    expect_same_conversion<u32string, string>(u32string());
+    expect_same_conversion<u32string, u16string>(u32string());
+}
+
+TEST(utf32_validity_test, kernel_matches_decoder) {
+    typedef std::vector<codepoint_type> u32string;
+    typedef utf_encoding_traits< string_traits<u32string> > EncodingTraits;
+
+    u32string str(40, 0x61);
+    EXPECT_TRUE(EncodingTraits::validate(str.begin(), str.end()));
+
+    for(size_t position = 0; position < str.size(); ++position) {
+        u32string invalid(str);
+        invalid[position] = 0x110000;
+        EXPECT_FALSE(EncodingTraits::validate(invalid.begin(), invalid.end())) << position;
+
+        invalid[position] = 0x10FFFF;
+        EXPECT_TRUE(EncodingTraits::validate(invalid.begin(), invalid.end())) << position;
+    }
+}
 
 } // namespace test
 } // namespace ustr
@@ -6,16 +6,39 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <cstdio>
+#include <fstream>
 #include <boost/ustr/string_traits.hpp>
+#include <boost/ustr/unicode_string_adapter.hpp>
+#include <boost/ustr/detail/intrusive_string_traits.hpp>
+#include <boost/ustr/detail/small_string_traits.hpp>
+#include <boost/ustr/detail/arena_string_traits.hpp>
+#include <boost/ustr/detail/mapped_string.hpp>
 #include "gtest.h"
 
 using boost::ustr::string_traits;
+using boost::ustr::intrusive_string_traits;
+using boost::ustr::small_string_traits;
+using boost::ustr::arena_string_traits;
+using boost::ustr::unicode_string_adapter;
 
 template <typename T>
 class string_traits_test : public ::testing::Test { };
 
 TYPED_TEST_CASE_P(string_traits_test);
 
+// lists cannot reserve, and always have room for one more element
+template <typename StringT>
+size_t capacity_of(const StringT& str) {
+    return str.capacity();
+}
+
+template <typename CharT>
+size_t capacity_of(const std::list<CharT>&) {
+    return static_cast<size_t>(-1);
+}
+
 TYPED_TEST_P(string_traits_test, raw_pointer) {
     typedef TypeParam                       StringT;
     typedef string_traits<StringT>          StringTraits;
@@ -171,10 +194,48 @@ TYPED_TEST_P(string_traits_test, mutable_strptr) {
     StringTraits::raw_strptr::delete_string(str3);
 }
 
+TYPED_TEST_P(string_traits_test, reserve_space) {
+    typedef TypeParam                       StringT;
+    typedef string_traits<StringT>          StringTraits;
+    typedef typename
+        StringTraits::string_type           string_type;
+    typedef typename
+        StringTraits::codeunit_type         codeunit_type;
+    typedef typename
+        StringTraits::raw_strptr_type       raw_strptr_type;
+    typedef typename
+        StringTraits::mutable_strptr_type   mutable_strptr_type;
+
+    mutable_strptr_type str;
+
+    StringTraits::mutable_strptr::reserve_space(str, 100);
+    raw_strptr_type raw = StringTraits::mutable_strptr::get(str);
+
+    EXPECT_NE(raw, (raw_strptr_type) NULL);
+    EXPECT_TRUE(raw->empty());
+    EXPECT_LE(100u, capacity_of(*raw));
+
+    StringTraits::mutable_strptr::append(str, codeunit_type('t'));
+    StringTraits::mutable_strptr::append(str, codeunit_type('e'));
+    StringTraits::mutable_strptr::reserve_space(str, 200);
+
+    EXPECT_LE(202u, capacity_of(*raw));
+
+    codeunit_type expected_[] = { 't', 'e' };
+    string_type expected(expected_, expected_ + sizeof(expected_)/sizeof(codeunit_type));
+
+    EXPECT_TRUE(StringTraits::raw_strptr::equals(raw, expected));
+
+    // a smaller reservation leaves the capacity alone
+    size_t capacity = capacity_of(*raw);
+    StringTraits::mutable_strptr::reserve_space(str, 10);
+    EXPECT_EQ(capacity, capacity_of(*raw));
+}
+
 
 REGISTER_TYPED_TEST_CASE_P(string_traits_test, 
         raw_pointer, const_pointer, null_raw_strptr, 
-        null_const_strptr, mutable_strptr);
+        null_const_strptr, mutable_strptr, reserve_space);
 
 typedef ::testing::Types< 
         std::string, std::vector<char>, std::list<char>,
@@ -183,3 +244,181 @@ typedef ::testing::Types<
 
 INSTANTIATE_TYPED_TEST_CASE_P(stl_containers, string_traits_test, string_traits_test_types);
 
+TEST(intrusive_string_traits_test, single_allocation) {
+    typedef intrusive_string_traits<char>                   StringTraits;
+    typedef StringTraits::string_type                       string_type;
+    typedef unicode_string_adapter<
+        string_type, StringTraits>                          UString;
+
+    const std::string raw("Hello World!");
+    UString str = UString::from_codeunits(raw.begin(), raw.end());
+    UString copy = str;
+
+    // the code units follow the header, in a string sized exactly
+    const string_type* buffer = str.get_buffer().get();
+    EXPECT_EQ(buffer, copy.get_buffer().get());
+    EXPECT_EQ(raw.size(), buffer->size());
+    EXPECT_EQ(raw.size(), buffer->capacity());
+    EXPECT_EQ(static_cast<const void*>(buffer + 1), static_cast<const void*>(buffer->data()));
+
+    // and so does the metadata, shared by the copies
+    const boost::ustr::util::buffer_metadata* metadata =
+        StringTraits::const_strptr::metadata(str.get_buffer());
+
+    EXPECT_EQ(&buffer->metadata(), metadata);
+    EXPECT_TRUE(metadata->has_codepoint_length());
+    EXPECT_EQ(raw.size(), copy.length());
+
+    // a buffer grows geometrically, and a reservation is allocated at its size
+    StringTraits::mutable_strptr_type mutable_str;
+    StringTraits::mutable_strptr::reserve_space(mutable_str, 100);
+    EXPECT_EQ(100u, mutable_str.get()->capacity());
+
+    for(size_t i = 0; i < 101; ++i) {
+        StringTraits::mutable_strptr::append(mutable_str, 'a');
+    }
+
+    EXPECT_EQ(101u, StringTraits::mutable_strptr::size(mutable_str));
+    EXPECT_EQ(200u, mutable_str.get()->capacity());
+}
+
+TEST(small_string_traits_test, inline_storage) {
+    typedef small_string_traits<char>                       StringTraits;
+    typedef StringTraits::string_type                       string_type;
+    typedef unicode_string_adapter<
+        string_type, StringTraits>                          UString;
+
+    // short strings are kept within the adapter, and copied along with it
+    const std::string short_raw("Hello World!");
+    UString str = UString::from_codeunits(short_raw.begin(), short_raw.end());
+    UString copy = str;
+
+    const string_type& buffer = str.to_string();
+    EXPECT_TRUE(buffer.is_inline());
+    EXPECT_TRUE(static_cast<const void*>(buffer.data()) >= static_cast<const void*>(&str));
+    EXPECT_TRUE(static_cast<const void*>(buffer.end()) <= static_cast<const void*>(&str + 1));
+    EXPECT_NE(buffer.data(), copy.to_string().data());
+    EXPECT_TRUE(StringTraits::const_strptr::metadata(str.get_buffer()) == 0);
+    EXPECT_EQ(short_raw.size(), copy.length());
+
+    // longer strings are shared on the heap, along with their metadata
+    const std::string long_raw(100, 'a');
+    UString long_str = UString::from_codeunits(long_raw.begin(), long_raw.end());
+    UString long_copy = long_str;
+
+    EXPECT_FALSE(long_str.to_string().is_inline());
+    EXPECT_EQ(long_str.to_string().data(), long_copy.to_string().data());
+    EXPECT_EQ(StringTraits::const_strptr::metadata(long_str.get_buffer()),
+        StringTraits::const_strptr::metadata(long_copy.get_buffer()));
+    EXPECT_TRUE(StringTraits::const_strptr::metadata(long_copy.get_buffer())->has_codepoint_length());
+
+    // a buffer moves to the heap when reserved beyond its inline length,
+    // and back when shrunk to fit again
+    StringTraits::mutable_strptr_type mutable_str;
+    StringTraits::mutable_strptr::append(mutable_str, short_raw.begin(), short_raw.end());
+    EXPECT_TRUE(mutable_str.is_inline());
+
+    StringTraits::mutable_strptr::reserve_space(mutable_str, 100);
+    EXPECT_FALSE(mutable_str.is_inline());
+    EXPECT_TRUE(std::equal(short_raw.begin(), short_raw.end(), mutable_str.begin()));
+
+    StringTraits::mutable_strptr::shrink_space(mutable_str, 2);
+    EXPECT_TRUE(mutable_str.is_inline());
+    EXPECT_EQ(short_raw.substr(0, short_raw.size() - 2),
+        std::string(mutable_str.begin(), mutable_str.end()));
+}
+
+TEST(arena_string_traits_test, arena_allocation) {
+    typedef arena_string_traits<char>                       StringTraits;
+    typedef StringTraits::string_type                       string_type;
+    typedef unicode_string_adapter<
+        string_type, StringTraits>                          UString;
+    typedef unicode_string_adapter<std::string>             HeapString;
+
+    using boost::ustr::util::monotonic_arena;
+
+    const std::string raw("Hello World!");
+    HeapString heap_str = HeapString::from_codeunits(raw.begin(), raw.end());
+    monotonic_arena arena;
+
+    {
+        monotonic_arena::scope scope(arena);
+        EXPECT_EQ(&arena, monotonic_arena::current());
+
+        UString str = UString::from_codeunits(raw.begin(), raw.end());
+        EXPECT_EQ(&arena, str.to_string().get_allocator().arena());
+        EXPECT_TRUE(arena.allocated() > raw.size());
+
+        // the metadata lives in the control block, allocated in the arena too
+        EXPECT_TRUE(StringTraits::const_strptr::metadata(str.get_buffer()) != 0);
+        EXPECT_EQ(raw.size(), str.length());
+
+        // arena strings mix with heap strings
+        EXPECT_TRUE(str == heap_str);
+        EXPECT_EQ(heap_str.hash(), str.hash());
+        EXPECT_TRUE(str + heap_str == heap_str + str);
+        EXPECT_TRUE(HeapString(str) == heap_str);
+        EXPECT_TRUE(UString(heap_str) == str);
+
+        // and so do builders
+        size_t allocated = arena.allocated();
+        UString::mutable_adapter_type builder;
+        builder.append(heap_str);
+        builder.append(str);
+
+        EXPECT_TRUE(arena.allocated() > allocated);
+        EXPECT_TRUE(builder.freeze() == heap_str + heap_str);
+    }
+
+    EXPECT_TRUE(monotonic_arena::current() == 0);
+    arena.reset();
+    EXPECT_EQ(0u, arena.allocated());
+
+    // outside of any scope strings live on the heap
+    UString str = UString::from_codeunits(raw.begin(), raw.end());
+    EXPECT_TRUE(str.to_string().get_allocator().arena() == 0);
+    EXPECT_EQ(0u, arena.allocated());
+    EXPECT_TRUE(str == heap_str);
+}
+
+TEST(mapped_string_test, file_mapping) {
+    typedef boost::ustr::util::mapped_string<char>          string_type;
+    typedef unicode_string_adapter<string_type>             UString;
+    typedef unicode_string_adapter<std::string>             HeapString;
+
+    const char* path = "mapped_string_test.txt";
+    const std::string raw("Hello \xE4\xB8\x96\xE7\x95\x8C!\n");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << raw;
+    }
+
+    string_type* mapped = new string_type(path);
+    mapped->advise(string_type::sequential_access);
+
+    UString str = UString::from_ptr(mapped);
+    HeapString heap_str = HeapString::from_codeunits(raw.begin(), raw.end());
+
+    // the code units are read in place
+    EXPECT_TRUE(str.to_string().is_mapped());
+    EXPECT_EQ(raw.size(), str.to_string().size());
+    EXPECT_EQ(10u, str.length());
+    EXPECT_TRUE(str == heap_str);
+    EXPECT_TRUE(str.substr(6, 2) == HeapString(USTR("世界")));
+
+    // regions are mapped from any offset, not only page boundaries
+    UString region = UString::from_ptr(new string_type(path, 6, 6));
+    EXPECT_TRUE(region.to_string().is_mapped());
+    EXPECT_TRUE(region == HeapString(USTR("世界")));
+
+    UString past_end = UString::from_ptr(new string_type(path, 100));
+    EXPECT_EQ(0u, past_end.length());
+
+    // strings built from mapped strings live on the heap
+    UString joined = str + region;
+    EXPECT_FALSE(joined.to_string().is_mapped());
+    EXPECT_EQ(12u, joined.length());
+
+    std::remove(path);
+    EXPECT_THROW(string_type("mapped_string_test.missing"), std::runtime_error);
+}
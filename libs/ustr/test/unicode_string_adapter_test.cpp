@@ -10,9 +10,24 @@
 #include <vector>
 #include <list>
 #include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <fstream>
+#include <boost/functional/hash.hpp>
 #include <boost/ustr/unicode_string_adapter.hpp>
 #include <boost/ustr/detail/alt_string_traits.hpp>
+#include <boost/ustr/detail/intrusive_string_traits.hpp>
+#include <boost/ustr/detail/small_string_traits.hpp>
+#include <boost/ustr/detail/intern_pool.hpp>
+#include <boost/ustr/detail/arena_string_traits.hpp>
+#include <boost/ustr/detail/mapped_string.hpp>
+#include <boost/ustr/detail/stream_decoder.hpp>
+#include <boost/ustr/detail/transcoding_streambuf.hpp>
+#include <boost/ustr/detail/file_io.hpp>
 #include <libs/ustr/test/fixture.hpp>
+#ifdef BOOST_USTR_CPP0X
+#include <thread>
+#endif
 #include "gtest.h"
 
 namespace boost {
@@ -30,6 +45,73 @@ class string_adapter_double_test : public ::testing::Test {};
 TYPED_TEST_CASE_P(string_adapter_single_test);
 TYPED_TEST_CASE_P(string_adapter_double_test);
 
+/*
+ * ASCII runs of every length up to a few SIMD blocks, separated by
+ * code points of 2, 3 and 4 UTF-8 code units, so that the bulk ASCII
+ * paths are entered and left at every block offset.
+ */
+inline std::vector<codepoint_type> ascii_run_codepoints() {
+    static const codepoint_type separators[] = { 0xE9, 0x4E16, 0x1F600 };
+
+    std::vector<codepoint_type> codepoints;
+    for(size_t run = 0; run < 140; ++run) {
+        for(size_t i = 0; i < run; ++i) {
+            codepoints.push_back('a' + (i % 26));
+        }
+        codepoints.push_back(separators[run % 3]);
+    }
+    return codepoints;
+}
+
+/*
+ * Every string of up to three code points drawn from ASCII, a two byte
+ * UTF-8 code point, a code point above the UTF-16 surrogates and one
+ * beyond the BMP, whose code units order unlike their code points.
+ */
+inline std::vector< std::vector<codepoint_type> > ordering_codepoints() {
+    static const codepoint_type alphabet[] = { 'a', 'z', 0xE9, 0xFF5E, 0x1F600 };
+
+    std::vector< std::vector<codepoint_type> > strings(1);
+    for(size_t begin = 0, end = 1, length = 0; length < 3; ++length) {
+        for(size_t i = begin; i < end; ++i) {
+            for(size_t c = 0; c < 5; ++c) {
+                std::vector<codepoint_type> str(strings[i]);
+                str.push_back(alphabet[c]);
+                strings.push_back(str);
+            }
+        }
+        begin = end;
+        end = strings.size();
+    }
+    return strings;
+}
+
+template <typename UString1, typename UString2>
+void check_ordering() {
+    typedef std::vector< std::vector<codepoint_type> > strings_t;
+    strings_t strings = ordering_codepoints();
+
+    std::vector<UString1> ustrs1;
+    std::vector<UString2> ustrs2;
+    for(strings_t::iterator it = strings.begin(); it != strings.end(); ++it) {
+        ustrs1.push_back(UString1::from_codepoints(it->begin(), it->end()));
+        ustrs2.push_back(UString2::from_codepoints(it->begin(), it->end()));
+    }
+
+    for(size_t i = 0; i < strings.size(); ++i) {
+        for(size_t j = 0; j < strings.size(); ++j) {
+            bool less = std::lexicographical_compare(
+                strings[i].begin(), strings[i].end(), strings[j].begin(), strings[j].end());
+            int expected = less ? -1 : (strings[i] != strings[j]);
+
+            int result = ustrs1[i].compare(ustrs2[j]);
+            EXPECT_EQ(expected, (result > 0) - (result < 0)) << i << ", " << j;
+            EXPECT_EQ(less, ustrs1[i] < ustrs2[j]) << i << ", " << j;
+            EXPECT_EQ(!less, ustrs1[i] >= ustrs2[j]) << i << ", " << j;
+        }
+    }
+}
+
 TYPED_TEST_P(string_adapter_single_test, encoding) {
 
     typedef TypeParam                                   UString;
@@ -110,6 +192,210 @@ TYPED_TEST_P(string_adapter_single_test, stl_algorithms) {
     }
 }
 
+TYPED_TEST_P(string_adapter_single_test, cached_length) {
+    typedef TypeParam                                   UString;
+    typedef typename
+        UString::string_traits                          StringTraits;
+
+    const size_t codeunit_size = UString::codeunit_size;
+
+    typedef fixture_encoding<codeunit_size>             fixture_encoder;
+    typedef typename
+        fixture_encoder::encoded_type                   encoded_type;
+
+    typedef std::vector<utf_string_fixture>             fixture_t;
+    fixture_t fixtures = get_utf_fixtures();
+
+    for(fixture_t::iterator fixture = fixtures.begin(); fixture != fixtures.end(); ++fixture) {
+        utf_string_fixture param = *fixture;
+        encoded_type encoded = fixture_encoder::get_encoded(param);
+
+        UString ustr1 = UString::from_codeunits(encoded.begin(), encoded.end());
+        UString ustr2 = ustr1;
+
+        EXPECT_EQ(param.decoded.size(), ustr1.length());
+        EXPECT_EQ(param.decoded.size(), ustr2.length());
+        EXPECT_EQ(static_cast<ptrdiff_t>(param.decoded.size()), std::distance(ustr1.begin(), ustr1.end()));
+
+        // counted in bulk when found by argument dependent lookup
+        using std::distance;
+        EXPECT_EQ(static_cast<ptrdiff_t>(param.decoded.size()), distance(ustr1.begin(), ustr1.end()));
+
+        // copies share the metadata of the buffer instead of counting again
+        const util::buffer_metadata* metadata =
+            StringTraits::const_strptr::metadata(ustr2.get_buffer());
+
+        if(metadata) {
+            EXPECT_TRUE(metadata->has_codepoint_length());
+            EXPECT_EQ(metadata, StringTraits::const_strptr::metadata(ustr1.get_buffer()));
+        }
+    }
+}
+
+TYPED_TEST_P(string_adapter_single_test, slices) {
+    typedef TypeParam                                   UString;
+    typedef utf_string_fixture::decoded_t               decoded_t;
+
+    typedef std::vector<utf_string_fixture> fixture_t;
+    fixture_t fixtures = get_utf_fixtures();
+
+    for(fixture_t::iterator fixture = fixtures.begin(); fixture != fixtures.end(); ++fixture) {
+        const decoded_t& decoded = fixture->decoded;
+        UString ustr = UString::from_codepoints(decoded.begin(), decoded.end());
+
+        for(size_t pos = 0; pos <= decoded.size(); ++pos) {
+            for(size_t count = 0; pos + count <= decoded.size(); ++count) {
+                UString slice = ustr.substr(pos, count);
+                UString copy = UString::from_codepoints(
+                    decoded.begin() + pos, decoded.begin() + pos + count);
+
+                EXPECT_EQ(count, slice.length());
+                EXPECT_TRUE(std::equal(slice.begin(), slice.end(), decoded.begin() + pos));
+                EXPECT_TRUE(std::equal(slice.rbegin(), slice.rend(),
+                    decoded.rbegin() + (decoded.size() - pos - count)));
+                EXPECT_TRUE(slice == copy);
+                EXPECT_EQ(0, slice.compare(copy));
+                EXPECT_EQ(copy.hash(), slice.hash());
+
+                UString inner = slice.substr(1, count > 2 ? count - 2 : 0);
+                EXPECT_TRUE(std::equal(inner.begin(), inner.end(), decoded.begin() + pos + 1));
+
+                typename UString::mutable_adapter_type builder;
+                slice.edit(builder);
+
+                UString edited = builder.freeze();
+                EXPECT_FALSE(edited.is_slice());
+                EXPECT_TRUE(edited == copy);
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+                EXPECT_TRUE(slice.edit().freeze() == copy);
+#endif
+            }
+        }
+
+        // past the end positions and counts are clamped
+        EXPECT_EQ(0u, ustr.substr(decoded.size() + 1).length());
+        EXPECT_EQ(decoded.size() - 1, ustr.substr(1, decoded.size()).length());
+    }
+}
+
+TEST(string_adapter_slice_test, lifetime) {
+    u8_string slice;
+    {
+        u8_string str(USTR("Hello 世界!"));
+        u8_string::iterator first = str.begin();
+        std::advance(first, 6);
+
+        slice = str.slice(first, str.end());
+    }
+
+    EXPECT_TRUE(slice == u8_string(USTR("世界!")));
+    EXPECT_EQ(3u, slice.length());
+
+    // copies and slices of slices refer to the same buffer
+    u8_string copy = slice;
+    u8_string inner = slice.substr(1, 1);
+    EXPECT_TRUE(copy.is_slice());
+    EXPECT_TRUE(copy.get_buffer() == slice.get_buffer());
+    EXPECT_TRUE(inner.get_buffer() == slice.get_buffer());
+    EXPECT_TRUE(inner == u8_string(USTR("界")));
+
+    // the raw string of a slice is its own, printed or not
+    u8_string world = u8_string(USTR("hello world")).substr(6);
+    std::ostringstream printed;
+    printed << world;
+    EXPECT_EQ("world", printed.str());
+    EXPECT_EQ("world", *world);
+    EXPECT_EQ("world", world.to_string());
+    EXPECT_EQ(5u, world.length());
+    EXPECT_FALSE(world.is_slice());
+    EXPECT_TRUE(world == u8_string(USTR("world")));
+
+    u16_string wide = u16_string(USTR("hello world")).substr(6);
+    EXPECT_TRUE(*wide == *u16_string(USTR("world")));
+}
+
+TYPED_TEST_P(string_adapter_single_test, random_access) {
+    typedef TypeParam                                   UString;
+    typedef typename UString::iterator                  iterator;
+
+    std::vector<codepoint_type> codepoints = ascii_run_codepoints();
+    UString ustr = UString::from_codepoints(codepoints.begin(), codepoints.end());
+
+    for(size_t n = 0; n < codepoints.size(); n += 97) {
+        EXPECT_EQ(codepoints[n], ustr.at(n)) << n;
+    }
+    EXPECT_EQ(codepoints.back(), ustr.at(codepoints.size() - 1));
+    EXPECT_THROW(ustr.at(codepoints.size()), std::out_of_range);
+
+    // forward and backward by more and less than the index interval
+    static const ptrdiff_t steps[] = { 1000, -300, 5, 129, -128, -7, 2000 };
+    iterator it = ustr.begin();
+    ptrdiff_t position = 0;
+
+    for(size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+        ustr.advance(it, steps[i]);
+        position += steps[i];
+
+        EXPECT_EQ(codepoints[position], *it) << position;
+        EXPECT_EQ(position, ustr.distance(ustr.begin(), it));
+    }
+
+    ustr.advance(it, codepoints.size() - position);
+    EXPECT_TRUE(it == ustr.end());
+    EXPECT_EQ(static_cast<ptrdiff_t>(codepoints.size()), ustr.distance(ustr.begin(), ustr.end()));
+
+    // slices share the index of their buffer
+    UString slice = ustr.substr(300, 5000);
+    for(size_t n = 0; n < 5000; n += 101) {
+        EXPECT_EQ(codepoints[300 + n], slice.at(n)) << n;
+    }
+    EXPECT_THROW(slice.at(5000), std::out_of_range);
+
+    UString empty;
+    EXPECT_THROW(empty.at(0), std::out_of_range);
+}
+
+TYPED_TEST_P(string_adapter_single_test, ordering) {
+    check_ordering<TypeParam, TypeParam>();
+
+    std::vector<codepoint_type> codepoints = ordering_codepoints().back();
+    TypeParam ustr = TypeParam::from_codepoints(codepoints.begin(), codepoints.end());
+    TypeParam copy = ustr;
+
+    EXPECT_EQ(0, ustr.compare(copy));
+    EXPECT_FALSE(ustr < copy);
+    EXPECT_TRUE(ustr <= copy);
+}
+
+template <typename UString>
+void check_sort() {
+    typedef std::vector< std::vector<codepoint_type> > strings_t;
+    strings_t strings = ordering_codepoints();
+    std::reverse(strings.begin(), strings.end());
+
+    std::vector<UString> ustrs;
+    for(strings_t::iterator it = strings.begin(); it != strings.end(); ++it) {
+        ustrs.push_back(UString::from_codepoints(it->begin(), it->end()));
+    }
+
+    std::sort(strings.begin(), strings.end());
+    std::sort(ustrs.begin(), ustrs.end());
+
+    for(size_t i = 0; i < strings.size(); ++i) {
+        EXPECT_TRUE(std::equal(strings[i].begin(), strings[i].end(), ustrs[i].begin())) << i;
+    }
+}
+
+TEST(string_adapter_ordering_test, sort) {
+    check_sort<u8_string>();
+    check_sort<u16_string>();
+    check_sort<u32_string>();
+    check_sort< unicode_string_adapter<
+        util::intrusive_string<char>, intrusive_string_traits<char> > >();
+    check_sort< unicode_string_adapter<
+        util::small_string<char>, small_string_traits<char> > >();
+}
 
 TYPED_TEST_P(string_adapter_double_test, conversion) {
     typedef typename
@@ -157,6 +443,19 @@ TYPED_TEST_P(string_adapter_double_test, conversion) {
         UString    ustr1_2(ustr2_1);
         UString2   ustr2_2(ustr1_1);
 
+        // conversions keep their code point length with the buffer
+        const util::buffer_metadata* metadata =
+            UString::string_traits::const_strptr::metadata(ustr1_2.get_buffer());
+        const util::buffer_metadata* metadata2 =
+            UString2::string_traits::const_strptr::metadata(ustr2_2.get_buffer());
+
+        if(metadata) {
+            EXPECT_TRUE(metadata->has_codepoint_length());
+        }
+        if(metadata2) {
+            EXPECT_TRUE(metadata2->has_codepoint_length());
+        }
+
         EXPECT_EQ(ustr1_1, ustr1_2);
         EXPECT_EQ(ustr2_1, ustr2_2);
 
@@ -210,6 +509,85 @@ TYPED_TEST_P(string_adapter_double_test, concatenation) {
     }
 }
 
+TYPED_TEST_P(string_adapter_double_test, ascii_runs) {
+    typedef typename
+        TypeParam::UString1                             UString1;
+    typedef typename
+        TypeParam::UString2                             UString2;
+
+    std::vector<codepoint_type> codepoints = ascii_run_codepoints();
+
+    UString1 ustr1 = UString1::from_codepoints(codepoints.begin(), codepoints.end());
+    UString2 ustr2 = ustr1;
+    UString1 ustr3 = ustr2;
+
+    EXPECT_EQ(codepoints.size(), ustr1.length());
+    EXPECT_EQ(codepoints.size(), ustr2.length());
+    EXPECT_TRUE(std::equal(codepoints.begin(), codepoints.end(), ustr2.begin()));
+    EXPECT_TRUE(std::equal(codepoints.rbegin(), codepoints.rend(), ustr2.rbegin()));
+
+    EXPECT_TRUE(ustr1 == ustr2);
+    EXPECT_TRUE(ustr2 == ustr1);
+    EXPECT_TRUE(ustr3 == ustr1);
+    EXPECT_TRUE(*ustr3 == *ustr1);
+
+    // differ in a single code point, either inside or at the end of a run
+    for(size_t i = 0; i < codepoints.size(); i += 37) {
+        std::vector<codepoint_type> changed(codepoints);
+        changed[i] = (changed[i] < 0x80) ? 0xE9 : 'z';
+
+        UString2 other = UString2::from_codepoints(changed.begin(), changed.end());
+        EXPECT_FALSE(ustr1 == other) << i;
+        EXPECT_FALSE(other == ustr1) << i;
+
+        UString2 prefix = UString2::from_codepoints(codepoints.begin(), codepoints.begin() + i);
+        EXPECT_FALSE(ustr1 == prefix) << i;
+        EXPECT_FALSE(prefix == ustr1) << i;
+    }
+}
+
+TYPED_TEST_P(string_adapter_double_test, ordering) {
+    check_ordering<typename TypeParam::UString1, typename TypeParam::UString2>();
+    check_ordering<typename TypeParam::UString2, typename TypeParam::UString1>();
+}
+
+TYPED_TEST_P(string_adapter_double_test, hashing) {
+    typedef typename
+        TypeParam::UString1                             UString1;
+    typedef typename
+        TypeParam::UString2                             UString2;
+
+    std::vector<codepoint_type> codepoints = ascii_run_codepoints();
+
+    // long enough for surrogate pairs to straddle the transcoded chunks
+    for(size_t i = 0; i < codepoints.size(); i += 113) {
+        UString1 ustr1 = UString1::from_codepoints(codepoints.begin(), codepoints.begin() + i);
+        UString2 ustr2 = ustr1;
+        u32_string ustr3 = ustr1;
+
+        EXPECT_EQ(ustr1.hash(), ustr2.hash()) << i;
+        EXPECT_EQ(ustr1.hash(), ustr3.hash()) << i;
+        EXPECT_EQ(ustr1.hash(), boost::hash<UString1>()(ustr1)) << i;
+        EXPECT_EQ(ustr2.hash(), boost::hash<UString2>()(ustr2)) << i;
+
+        // computed once and shared with copies
+        UString1 copy = ustr1;
+        EXPECT_EQ(ustr1.hash(), copy.hash()) << i;
+
+        std::vector<codepoint_type> changed(codepoints.begin(), codepoints.begin() + i + 1);
+        changed[i] = (changed[i] < 0x80) ? 0xE9 : 'z';
+
+        UString2 other = UString2::from_codepoints(changed.begin(), changed.end());
+        EXPECT_NE(ustr1.hash(), other.hash()) << i;
+    }
+
+#ifdef BOOST_USTR_CPP0X
+    UString1 ustr1 = UString1::from_codepoints(codepoints.begin(), codepoints.end());
+    UString2 ustr2 = ustr1;
+    EXPECT_EQ(std::hash<UString1>()(ustr1), std::hash<UString2>()(ustr2));
+#endif
+}
+
 class ustr_test_type_param1 {
   public:
     typedef unicode_string_adapter< std::string >           UString1;
@@ -237,8 +615,36 @@ class ustr_test_type_param4 {
         std::list<utf16_codeunit_type> >                    UString2;
 };
 
-REGISTER_TYPED_TEST_CASE_P(string_adapter_single_test, encoding, stl_algorithms);
-REGISTER_TYPED_TEST_CASE_P(string_adapter_double_test, conversion, concatenation);
+class ustr_test_type_param5 {
+  public:
+    typedef unicode_string_adapter<
+        util::intrusive_string<char>,
+        intrusive_string_traits<char> >                     UString1;
+    typedef unicode_string_adapter< 
+        std::basic_string<utf16_codeunit_type> >            UString2;
+};
+
+class ustr_test_type_param6 {
+  public:
+    typedef unicode_string_adapter<
+        util::small_string<char>,
+        small_string_traits<char> >                         UString1;
+    typedef unicode_string_adapter<
+        util::intrusive_string<utf16_codeunit_type>,
+        intrusive_string_traits<utf16_codeunit_type> >      UString2;
+};
+
+class ustr_test_type_param7 {
+  public:
+    typedef unicode_string_adapter<
+        arena_string_traits<char>::string_type,
+        arena_string_traits<char> >                         UString1;
+    typedef unicode_string_adapter<
+        std::basic_string<utf16_codeunit_type> >            UString2;
+};
+
+REGISTER_TYPED_TEST_CASE_P(string_adapter_single_test, encoding, stl_algorithms, cached_length, slices, random_access, ordering);
+REGISTER_TYPED_TEST_CASE_P(string_adapter_double_test, conversion, concatenation, ascii_runs, ordering, hashing);
 
 typedef ::testing::Types<
         unicode_string_adapter< std::string >,
@@ -247,7 +653,16 @@ typedef ::testing::Types<
         unicode_string_adapter< std::vector<utf16_codeunit_type> >,
         unicode_string_adapter< std::list<char> >,
         unicode_string_adapter< std::list<utf16_codeunit_type> >,
-        unicode_string_adapter< std::string, alt_string_traits<std::string> >
+        unicode_string_adapter< std::string, alt_string_traits<std::string> >,
+        unicode_string_adapter< util::intrusive_string<char>, intrusive_string_traits<char> >,
+        unicode_string_adapter< util::intrusive_string<utf16_codeunit_type>,
+            intrusive_string_traits<utf16_codeunit_type> >,
+        unicode_string_adapter< util::small_string<char>, small_string_traits<char> >,
+        unicode_string_adapter< util::small_string<utf16_codeunit_type>,
+            small_string_traits<utf16_codeunit_type> >,
+        unicode_string_adapter< arena_string_traits<utf16_codeunit_type>::string_type,
+            arena_string_traits<utf16_codeunit_type> >,
+        unicode_string_adapter< util::mapped_string<char> >
     > single_test_type_params;
 
 INSTANTIATE_TYPED_TEST_CASE_P(basic, string_adapter_single_test, single_test_type_params);
@@ -256,11 +671,121 @@ typedef ::testing::Types<
         ustr_test_type_param1,
         ustr_test_type_param2,
         ustr_test_type_param3,
-        ustr_test_type_param4
+        ustr_test_type_param4,
+        ustr_test_type_param5,
+        ustr_test_type_param6,
+        ustr_test_type_param7
     > double_test_type_params;
 
 INSTANTIATE_TYPED_TEST_CASE_P(basic, string_adapter_double_test, double_test_type_params);
 
+TEST(string_adapter_builder_test, reserve) {
+    typedef unicode_string_adapter< std::list<char> >   list_string;
+
+    std::vector<codepoint_type> codepoints = ascii_run_codepoints();
+    list_string source = list_string::from_codepoints(codepoints.begin(), codepoints.end());
+    u8_string expected = u8_string::from_codepoints(codepoints.begin(), codepoints.end());
+
+    // appends decoding the source code point by code point make room
+    // for the worst case, which is bounded by the code point length
+    u8_string::mutable_adapter_type builder;
+    builder.append(source);
+
+    u8_string str = builder.freeze();
+    EXPECT_TRUE(str == expected);
+    EXPECT_GE(4 * codepoints.size(), str.get_buffer()->capacity());
+
+    u8_string::mutable_adapter_type reserved;
+    reserved.reserve(3);
+    reserved.append(USTR("世"));
+
+    EXPECT_TRUE(reserved.freeze() == USTR("世"));
+}
+
+TEST(string_adapter_builder_test, append_codeunits) {
+    const char encoded[] = "Hello \xE4\xB8\x96\xE7\x95\x8C!";
+    std::list<char> rest(encoded + 9, encoded + 13);
+
+    u8_string::mutable_adapter_type builder;
+    builder.append_codeunits(encoded, 9);
+    builder.append_codeunits(rest.begin(), rest.end());
+    builder.append_codeunits(encoded, 0);
+
+    EXPECT_TRUE(builder.freeze() == USTR("Hello 世界!"));
+
+    // malformed code units are left for freeze() to replace
+    const utf16_codeunit_type units[] = { 'a', 0xDC00, 'b' };
+    std::vector<utf16_codeunit_type> more(units, units + 3);
+
+    u16_string::mutable_adapter_type u16_builder;
+    u16_builder.append_codeunits(units, 3);
+    u16_builder.append_codeunits(more.begin(), more.end());
+
+    u16_string str = u16_builder.freeze();
+    const codepoint_type expected[] = { 'a', 0xFFFD, 'b', 'a', 0xFFFD, 'b' };
+
+    EXPECT_EQ(6u, str.length());
+    EXPECT_TRUE(std::equal(str.begin(), str.end(), expected));
+}
+
+/*
+ * Freezes code units appended in chunks of chunk_size, with a code point
+ * appended through the encoder after each, and checks the result against
+ * the same code units validated at once by from_ptr().
+ */
+inline void check_incremental_validation(const std::string& encoded, size_t chunk_size) {
+    u8_string::mutable_adapter_type builder;
+    std::string appended;
+
+    for(size_t offset = 0; offset < encoded.size(); offset += chunk_size) {
+        size_t length = (std::min)(chunk_size, encoded.size() - offset);
+        builder.append_codeunits(encoded.data() + offset, length);
+        appended.append(encoded, offset, length);
+
+        if(offset % (3 * chunk_size) == 0) {
+            builder.append_codepoint(0xE9);
+            appended += "\xC3\xA9";
+        }
+    }
+
+    u8_string frozen = builder.freeze();
+    u8_string expected = u8_string::from_ptr(new std::string(appended));
+
+    EXPECT_EQ(expected.to_string(), frozen.to_string());
+    EXPECT_EQ(expected.length(), frozen.length());
+    EXPECT_EQ(static_cast<ptrdiff_t>(frozen.length()), std::distance(frozen.begin(), frozen.end()));
+}
+
+TEST(string_adapter_builder_test, incremental_validation) {
+    std::string encoded;
+    for(size_t i = 0; i < 30000; ++i) {
+        encoded += "a\xE4\xB8\x96\xF0\x9F\x98\x80";
+    }
+
+    // chunks cutting code points in two, across several pending blocks
+    check_incremental_validation(encoded, 1000);
+    check_incremental_validation(encoded, 7);
+
+    // a code point cut short by the end of the buffer
+    check_incremental_validation(encoded.substr(0, encoded.size() - 2), 1000);
+
+    // malformed code units in a block validated before freeze()
+    std::string malformed(encoded);
+    malformed[10] = '\x80';
+    check_incremental_validation(malformed, 1000);
+
+    // surrogates are encoded as they are, and replaced by freeze()
+    u8_string::mutable_adapter_type builder;
+    builder.append_codepoint('a');
+    builder.append_codepoint(0xD800);
+
+    u8_string str = builder.freeze();
+    u8_string expected = u8_string::from_ptr(new std::string("a\xED\xA0\x80"));
+
+    EXPECT_EQ(expected.to_string(), str.to_string());
+    EXPECT_EQ(expected.length(), str.length());
+}
+
 TEST(string_adapter_validation_test, codepoint_replacement) {
     std::string *raw_string = new std::string("\x80\x80X");
 
@@ -286,9 +811,402 @@ TEST(string_adapter_validation_test, codepoint_replacement) {
     EXPECT_EQ(*sit++, '\xBD');
 
     EXPECT_EQ(*sit++, 'X');
+
+    EXPECT_EQ(3u, malformed_string.length());
+}
+
+TEST(string_adapter_validation_test, malformed_length) {
+    typedef unicode_string_adapter< std::string, string_traits<std::string>,
+        util::utf8_encoder, replace_policy<0xFFFD, false> > lax_string;
+
+    // long enough for the vectorized kernels, with the malformed
+    // sequences left in place by the policy
+    std::string raw(40, 'a');
+    raw += "\x80\xE4\xB8\x96\xC3";
+
+    lax_string str = lax_string::from_ptr(new std::string(raw));
+
+    size_t decoded = 0;
+    for(lax_string::iterator it = str.begin(); it != str.end(); ++it) {
+        ++decoded;
+    }
+
+    EXPECT_EQ(43u, decoded);
+    EXPECT_EQ(decoded, str.length());
+    EXPECT_EQ(static_cast<ptrdiff_t>(decoded), std::distance(str.begin(), str.end()));
+    EXPECT_EQ(static_cast<ptrdiff_t>(decoded), distance(str.begin(), str.end()));
 }
 
 
+TEST(string_adapter_validation_test, shared_buffer) {
+    u8_string str(USTR("Hello 世界!"));
+
+    // validated buffers are shared as they are by copies and moves
+    u8_string copy = str;
+    u8_string shared = u8_string::from_const_strptr(str.get_buffer());
+    EXPECT_TRUE(copy.get_buffer() == str.get_buffer());
+    EXPECT_TRUE(shared.get_buffer() == str.get_buffer());
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    u8_string moved(std::move(copy));
+    EXPECT_TRUE(moved.get_buffer() == str.get_buffer());
+#endif
+
+    // buffers from elsewhere are still checked
+    u8_string::const_strptr_type malformed(new std::string("a\xFF"));
+    u8_string sanitized = u8_string::from_const_strptr(malformed);
+    EXPECT_TRUE(sanitized.get_buffer() != malformed);
+    EXPECT_TRUE(sanitized == u8_string(USTR("a\xEF\xBF\xBD")));
+    EXPECT_EQ(2u, sanitized.length());
+}
+
+TEST(string_adapter_validation_test, overlong_equality) {
+    // the decoder accepts overlong forms, here of U+000F inside an
+    // ASCII run, which equal the code points they decode to
+    u8_string overlong = u8_string::from_ptr(new std::string("n\xE0\x80\x8Fh"));
+    u16_string utf16 = USTR("n\x0Fh");
+
+    EXPECT_EQ(3u, overlong.length());
+    EXPECT_TRUE(overlong == utf16);
+    EXPECT_TRUE(utf16 == overlong);
+    EXPECT_FALSE(overlong == u16_string(USTR("n\x0F")));
+    EXPECT_FALSE(overlong == u16_string(USTR("n\x0Fi")));
+    EXPECT_FALSE(overlong == u16_string(USTR("nh")));
+
+    // and in the same encoding, where equality stays transitive
+    u8_string shortest = u8_string::from_ptr(new std::string("n\x0Fh"));
+    std::list<char> listed(overlong.to_string().begin(), overlong.to_string().end());
+    unicode_string_adapter< std::list<char> > overlong_list =
+        unicode_string_adapter< std::list<char> >::from_codeunits(listed.begin(), listed.end());
+
+    EXPECT_TRUE(overlong == shortest);
+    EXPECT_TRUE(shortest == overlong);
+    EXPECT_TRUE(overlong_list == shortest);
+    EXPECT_TRUE(shortest.substr(1) == overlong.substr(1));
+    EXPECT_FALSE(overlong == u8_string(USTR("n\x0Fi")));
+}
+
+TEST(string_adapter_validation_test, overlong_ordering) {
+    u8_string overlong = u8_string::from_ptr(new std::string("n\xE0\x80\x8Fh"));
+    u8_string shortest = u8_string::from_ptr(new std::string("n\x0Fh"));
+    u32_string utf32 = shortest;
+
+    // ordered by the code points the overlong forms decode to
+    EXPECT_EQ(0, overlong.compare(shortest));
+    EXPECT_EQ(0, shortest.compare(overlong));
+    EXPECT_EQ(0, overlong.compare(utf32));
+    EXPECT_LT(overlong.compare(u8_string(USTR("n\x10"))), 0);
+    EXPECT_GT(overlong.compare(u8_string(USTR("n\x0E\x7F"))), 0);
+    EXPECT_GT(u8_string(USTR("n\x10")).compare(overlong), 0);
+}
+
+TEST(string_adapter_validation_test, overlong_hash) {
+    // the decoder accepts overlong forms, which stand for the
+    // code points they decode to in any encoding
+    std::string padding(20, 'a');
+    u8_string overlong = u8_string::from_ptr(
+        new std::string(padding + "n\xE0\x80\x8F\xF0\x80\x80\x8Fh" + padding));
+    u8_string shortest = u8_string::from_ptr(
+        new std::string(padding + "n\x0F\x0Fh" + padding));
+
+    u16_string utf16 = shortest;
+    u32_string utf32 = shortest;
+
+    EXPECT_EQ(shortest.hash(), overlong.hash());
+    EXPECT_EQ(utf16.hash(), overlong.hash());
+    EXPECT_EQ(utf32.hash(), overlong.hash());
+    EXPECT_EQ(boost::hash<u32_string>()(utf32), boost::hash<u8_string>()(overlong));
+
+    EXPECT_EQ(shortest.substr(10, 25).hash(), overlong.substr(10, 25).hash());
+    EXPECT_EQ(shortest.substr(0, 20).hash(), overlong.substr(0, 20).hash());
+}
+
+TEST(string_adapter_intern_test, canonical_buffer) {
+    intern_pool<u8_string> pool;
+
+    u8_string hello = pool.intern(u8_string(USTR("Hello 世界!")));
+    u8_string same = pool.intern(u8_string(USTR("Hello 世界!")));
+    u8_string other = pool.intern(u8_string(USTR("Hello")));
+
+    EXPECT_TRUE(hello.get_buffer() == same.get_buffer());
+    EXPECT_TRUE(hello.get_buffer() != other.get_buffer());
+    EXPECT_TRUE(hello == u8_string(USTR("Hello 世界!")));
+    EXPECT_EQ(2u, pool.size());
+
+    // overlong UTF-8 is interned in the shortest form
+    u8_string overlong = pool.intern(u8_string::from_ptr(new std::string("Hello 世界\xE0\x80\xA1")));
+    EXPECT_TRUE(overlong.get_buffer() == hello.get_buffer());
+    EXPECT_EQ(2u, pool.size());
+
+    // slices are interned as a buffer of their own
+    u8_string slice = u8_string(USTR("Hello 世界!")).substr(0, 5);
+    u8_string interned_slice = pool.intern(slice);
+    EXPECT_TRUE(interned_slice.get_buffer() == other.get_buffer());
+    EXPECT_FALSE(interned_slice.is_slice());
+
+    // entries of strings no longer referenced are evicted
+    other = u8_string();
+    interned_slice = u8_string();
+    EXPECT_EQ(2u, pool.size());
+    EXPECT_EQ(1u, pool.purge());
+    EXPECT_EQ(1u, pool.size());
+
+    u8_string again = pool.intern(u8_string(USTR("Hello")));
+    EXPECT_TRUE(again == u8_string(USTR("Hello")));
+    EXPECT_EQ(2u, pool.size());
+}
+
+#ifdef BOOST_USTR_CPP0X
+struct intern_strings {
+    intern_pool<u8_string>* pool;
+    std::vector<u8_string>* interned;
+
+    void operator()() const {
+        for(size_t i = 0; i < 2000; ++i) {
+            std::ostringstream out;
+            out << "string " << i % 500;
+
+            std::string raw = out.str();
+            interned->push_back(pool->intern(u8_string::from_codeunits(raw.begin(), raw.end())));
+        }
+    }
+};
+
+TEST(string_adapter_intern_test, concurrent_interning) {
+    intern_pool<u8_string> pool;
+    std::vector< std::vector<u8_string> > interned(4);
+    std::vector<std::thread> threads;
+
+    for(size_t i = 0; i < interned.size(); ++i) {
+        intern_strings worker = { &pool, &interned[i] };
+        threads.push_back(std::thread(worker));
+    }
+
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    // every thread got the one buffer of each string
+    EXPECT_EQ(500u, pool.size());
+
+    for(size_t i = 1; i < interned.size(); ++i) {
+        for(size_t j = 0; j < interned[i].size(); ++j) {
+            EXPECT_TRUE(interned[i][j].get_buffer() == interned[0][j].get_buffer()) << j;
+        }
+    }
+
+    interned.clear();
+    EXPECT_EQ(500u, pool.purge());
+    EXPECT_EQ(0u, pool.size());
+}
+#endif
+
+
+/*
+ * Decodes encoded in three chunks cut at every pair of positions, which
+ * must give the same string as decoding it whole.
+ */
+template <typename String, typename CodeunitT>
+inline void check_stream_decoding(const std::basic_string<CodeunitT>& encoded, const String& expected) {
+    const CodeunitT* begin = encoded.data();
+    const CodeunitT* end = begin + encoded.size();
+
+    for(size_t first = 0; first <= encoded.size(); ++first) {
+        for(size_t second = first; second <= encoded.size(); ++second) {
+            stream_decoder<CodeunitT> decoder;
+            typename String::mutable_adapter_type builder;
+
+            decoder.decode(begin, begin + first, builder);
+            decoder.decode(begin + first, begin + second, builder);
+            decoder.decode(begin + second, end, builder);
+            decoder.finish(builder);
+
+            String decoded = builder.freeze();
+            ASSERT_EQ(expected.to_string(), decoded.to_string()) << first << ' ' << second;
+            ASSERT_EQ(expected.length(), decoded.length());
+        }
+    }
+}
+
+TEST(stream_decoder_test, chunk_boundaries) {
+    // code points of every length, then malformed and incomplete sequences
+    std::string encoded("ab\xC3\xA9" "c\xE4\xB8\x96\xF0\x9F\x98\x80x"
+        "\xE4\xB8y\xFF\xC3z\xF0\x9F");
+
+    u8_string str = u8_string::from_codeunits(encoded.begin(), encoded.end());
+    u16_string::mutable_adapter_type converted;
+    converted.append(str);
+    u16_string str16 = converted.freeze();
+
+    check_stream_decoding(encoded, str);
+    check_stream_decoding(encoded, str16);
+
+    // UTF-16 ending with a surrogate pair cut short
+    std::basic_string<utf16_codeunit_type> encoded16(
+        str16.codeunit_begin(), str16.codeunit_end());
+    encoded16 += static_cast<utf16_codeunit_type>(0xD83D);
+
+    u8_string::mutable_adapter_type expected;
+    expected.append(str);
+    expected.append_codepoint(0xFFFD);
+
+    check_stream_decoding(encoded16, expected.freeze());
+
+    // UTF-32, whose code points are never cut short
+    std::basic_string<codepoint_type> encoded32(str.begin(), str.end());
+    check_stream_decoding(encoded32, str);
+}
+
+TEST(stream_decoder_test, codepoint_output) {
+    std::string encoded("a\xE4\xB8\x96\xF0\x9F\x98\x80\xC3");
+
+    stream_decoder<char> decoder;
+    std::vector<codepoint_type> codepoints;
+    std::back_insert_iterator< std::vector<codepoint_type> > out(codepoints);
+
+    // one code unit at a time, with the code points left pending in between
+    for(size_t i = 0; i < encoded.size(); ++i) {
+        out = decoder.decode(encoded.data() + i, encoded.data() + i + 1, out);
+    }
+
+    EXPECT_EQ(1u, decoder.pending());
+    decoder.finish(out);
+    EXPECT_EQ(0u, decoder.pending());
+
+    ASSERT_EQ(4u, codepoints.size());
+    EXPECT_EQ(0x61u, codepoints[0]);
+    EXPECT_EQ(0x4E16u, codepoints[1]);
+    EXPECT_EQ(0x1F600u, codepoints[2]);
+    EXPECT_EQ(0xFFFDu, codepoints[3]);
+}
+
+TEST(transcoding_streambuf_test, sink) {
+    // several buffers full, with code points across their boundaries
+    std::string encoded;
+    for(size_t i = 0; i < 3000; ++i) {
+        encoded += "a\xC3\xA9\xE4\xB8\x96\xF0\x9F\x98\x80";
+    }
+
+    u8_string str = u8_string::from_codeunits(encoded.begin(), encoded.end());
+    u16_string::mutable_adapter_type converted;
+    converted.append(str);
+    u16_string str16 = converted.freeze();
+
+    std::ostringstream utf8_out;
+    {
+        transcoding_sink<char> sink(utf8_out.rdbuf());
+        std::ostream out(&sink);
+
+        EXPECT_TRUE(sink.write(str16));
+        out << " #" << 42;
+    }
+    EXPECT_EQ(encoded + " #42", utf8_out.str());
+
+    // a buffer too small to hold as many code points as code units
+    std::ostringstream small_out;
+    {
+        transcoding_sink<char, util::utf8_encoder, replace_policy<0xFFFD>, 8> sink(
+            small_out.rdbuf());
+        EXPECT_TRUE(sink.write(str));
+    }
+    EXPECT_EQ(encoded, small_out.str());
+
+    // characters written one at a time, ending with an incomplete code point
+    std::ostringstream utf16_out;
+    {
+        transcoding_sink<utf16_codeunit_type> sink(utf16_out.rdbuf());
+        std::ostream out(&sink);
+
+        for(size_t i = 0; i < encoded.size(); ++i) {
+            out.put(encoded[i]);
+        }
+        out << "\xE4\xB8";
+    }
+
+    std::basic_string<utf16_codeunit_type> expected(
+        str16.codeunit_begin(), str16.codeunit_end());
+    expected += static_cast<utf16_codeunit_type>(0xFFFD);
+
+    EXPECT_TRUE(std::string(reinterpret_cast<const char*>(expected.data()),
+        expected.size() * sizeof(utf16_codeunit_type)) == utf16_out.str());
+}
+
+TEST(transcoding_streambuf_test, source) {
+    std::string encoded;
+    for(size_t i = 0; i < 3000; ++i) {
+        encoded += "a\xC3\xA9\xE4\xB8\x96\xF0\x9F\x98\x80";
+    }
+
+    u8_string str = u8_string::from_codeunits(encoded.begin(), encoded.end());
+    u16_string::mutable_adapter_type converted;
+    converted.append(str);
+    u16_string str16 = converted.freeze();
+
+    std::string bytes((str16.codeunit_end() - str16.codeunit_begin()) *
+        sizeof(utf16_codeunit_type), '\0');
+    std::copy(str16.codeunit_begin(), str16.codeunit_end(),
+        reinterpret_cast<utf16_codeunit_type*>(&bytes[0]));
+
+    // characters, ending with a surrogate pair cut short
+    {
+        std::istringstream in(bytes + "\x3D\xD8");
+        transcoding_source<utf16_codeunit_type> source(in.rdbuf());
+        std::istream text(&source);
+
+        std::string decoded((std::istreambuf_iterator<char>(text)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(encoded + "\xEF\xBF\xBD", decoded);
+    }
+
+    // a few characters, then the rest into a builder
+    {
+        std::istringstream in(bytes);
+        transcoding_source<utf16_codeunit_type> source(in.rdbuf());
+        std::istream text(&source);
+
+        char head[3];
+        text.read(head, 3);
+
+        u8_string::mutable_adapter_type builder;
+        source.read(builder);
+
+        EXPECT_EQ(encoded, std::string(head, 3) + builder.freeze().to_string());
+    }
+}
+
+TEST(file_io_test, byte_order_marks) {
+    const char* path = "file_io_test.txt";
+
+    // more than a block of the largest code units
+    std::string encoded;
+    for(size_t i = 0; i < 20000; ++i) {
+        encoded += "a\xC3\xA9\xE4\xB8\x96\xF0\x9F\x98\x80";
+    }
+    u8_string str = u8_string::from_codeunits(encoded.begin(), encoded.end());
+
+    const file_encoding encodings[] = {
+        utf8_file, utf16le_file, utf16be_file, utf32le_file, utf32be_file };
+
+    for(size_t i = 0; i < 5; ++i) {
+        // told by the byte order mark, or by the encoding given
+        write_file(path, str, encodings[i], true);
+        u16_string::mutable_adapter_type builder;
+        EXPECT_EQ(encodings[i], read_file(path, builder));
+        EXPECT_EQ(str.length(), builder.freeze().length()) << i;
+
+        write_file(path, str, encodings[i]);
+        EXPECT_EQ(encoded, read_file<u8_string>(path, encodings[i]).to_string()) << i;
+    }
+
+    // UTF-16BE written by hand, ending with a surrogate pair cut short
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write("\xFE\xFF\x00\x41\xD8\x3D\xDE\x00\xD8\x3D", 10);
+    }
+    EXPECT_EQ("A\xF0\x9F\x98\x80\xEF\xBF\xBD", read_file<u8_string>(path).to_string());
+
+    std::remove(path);
+    EXPECT_THROW(read_file<u8_string>(path), std::runtime_error);
+}
 
 } // namespace test
 } // namespace ustr